@@ -19,6 +19,34 @@ using namespace mylog::sinks;
 
 
 void bench_mt(int howmany, std::shared_ptr<mylog::logger> logger, int thread_count);
+void bench_lanes(int howmany, int queue_size, int workers, async_lane_policy lane_policy);
+
+const char* queue_type_name(async_queue_type queue_type)
+{
+    switch (queue_type)
+    {
+    case async_queue_type::lockfree:
+        return "lockfree";
+    case async_queue_type::per_thread:
+        return "per_thread";
+    case async_queue_type::byte_ring:
+        return "byte_ring";
+    default:
+        return "blocking";
+    }
+}
+
+// 1, 2, 4, ... up to max_threads (max_threads itself included)
+std::vector<int> thread_counts(int max_threads)
+{
+    std::vector<int> counts;
+    for (int n = 1; n < max_threads; n *= 2)
+    {
+        counts.push_back(n);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
 
 int count_lines(const char* filename)
 {
@@ -82,24 +110,62 @@ int main(int argc, char *argv[])
         auto slot_size = sizeof(mylog::details::async_msg);
         mylog::info("-------------------------------------------------");
         mylog::info("Messages     : {:L}", howmany);
-        mylog::info("Threads      : {:L}", threads);
+        mylog::info("Threads      : up to {:L}", threads);
         mylog::info("Queue        : {:L} slots", queue_size);
         mylog::info("Queue memory : {:L} x {:L} = {:L} KB ", queue_size, slot_size, (queue_size * slot_size) / 1024);
         mylog::info("Total iters  : {:L}", iters);
         mylog::info("-------------------------------------------------");
 
         const char *filename = "logs/basic_async.log";
+        for (auto queue_type : {async_queue_type::blocking, async_queue_type::lockfree, async_queue_type::per_thread, async_queue_type::byte_ring})
+        {
+            mylog::info("");
+            mylog::info("*********************************");
+            mylog::info("Queue: {}, Overflow Policy: block", queue_type_name(queue_type));
+            mylog::info("*********************************");
+            for (int thread_count : thread_counts(threads))
+            {
+                mylog::info("Producer threads: {}", thread_count);
+                for (int i = 0; i < iters; i++)
+                {
+                    // the byte ring gets the memory of the slot queues, in bytes
+                    auto q_max_size = queue_type == async_queue_type::byte_ring ? queue_size * slot_size : static_cast<size_t>(queue_size);
+                    auto tp = std::make_shared<details::thread_pool>(q_max_size, thread_pool_thread, queue_type);
+                    auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(filename, true);
+                    auto logger = std::make_shared<async_logger>("async_logger", std::move(file_sink), std::move(tp), async_overflow_policy::block);
+                    bench_mt(howmany, std::move(logger), thread_count);
+                    // verify_file(filename, howmany);
+                }
+            }
+        }
+
         mylog::info("");
         mylog::info("*********************************");
-        mylog::info("Queue Overflow Policy: block");
+        mylog::info("Deferred formatting, Overflow Policy: block");
         mylog::info("*********************************");
+        // the workers format the messages instead of the producers
+        filename = "logs/basic_async-deferred.log";
         for (int i = 0; i < iters; i++)
         {
             auto tp = std::make_shared<details::thread_pool>(queue_size, thread_pool_thread);
             auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(filename, true);
             auto logger = std::make_shared<async_logger>("async_logger", std::move(file_sink), std::move(tp), async_overflow_policy::block);
+            logger->set_deferred_formatting(true);
             bench_mt(howmany, std::move(logger), threads);
-            // verify_file(filename, howmany);
+        }
+
+        mylog::info("");
+        mylog::info("*********************************");
+        mylog::info("Lanes, one logger and file per worker");
+        mylog::info("*********************************");
+        // shared: any worker writes any file. per_logger: each file has its own worker
+        for (auto lane_policy : {async_lane_policy::shared, async_lane_policy::per_logger})
+        {
+            mylog::info("Lane policy: {}", lane_policy == async_lane_policy::shared ? "shared" : "per_logger");
+            for (int i = 0; i < iters; i++)
+            {
+                bench_lanes(howmany, queue_size, 4, lane_policy);
+            }
         }
 
         mylog::info("");
@@ -159,4 +225,30 @@ void bench_mt(int howmany, std::shared_ptr<mylog::logger> logger, int thread_cou
     auto delta = steady_clock::now() - start;
     auto delta_d = duration_cast<duration<double>>(delta).count();
     mylog::info("Elapsed: {} secs\t {:L}/sec", delta_d, int(howmany / delta_d));
-}
\ No newline at end of file
+}
+// one producer thread per logger, timed until the files are written
+void bench_lanes(int howmany, int queue_size, int workers, async_lane_policy lane_policy)
+{
+    using std::chrono::steady_clock;
+    auto start = steady_clock::now();
+    {
+        auto tp = std::make_shared<details::thread_pool>(
+            queue_size, workers, async_queue_type::blocking, details::thread_pool::default_batch_size, async_wait_strategy::park, lane_policy);
+        vector<std::thread> threads;
+        for (int t = 0; t < workers; ++t)
+        {
+            auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(fmt::format("logs/basic_async-lane{}.log", t), true);
+            auto logger = std::make_shared<async_logger>(fmt::format("lane{}", t), std::move(file_sink), tp);
+            threads.push_back(std::thread(thread_fun, std::move(logger), howmany / workers));
+        }
+
+        for (auto& t : threads)
+        {
+            t.join();
+        }
+    }
+
+    auto delta = steady_clock::now() - start;
+    auto delta_d = duration_cast<duration<double>>(delta).count();
+    mylog::info("Elapsed: {} secs\t {:L}/sec", delta_d, int(howmany / delta_d));
+}
@@ -37,6 +37,11 @@ void bench_threaded_logging(size_t threads, int iters)
     auto basic_mt = mylog::basic_logger_mt("basic_mt", "logs/basic_mt.log", true);
     bench_mt(iters, std::move(basic_mt), threads);
 
+    mylog::info("");
+    auto unlocked_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>("logs/basic_mt_unlocked.log", true);
+    unlocked_sink->set_format_outside_lock(true);
+    bench_mt(iters, std::make_shared<mylog::logger>("basic_mt/format_outside_lock", std::move(unlocked_sink)), threads);
+
     mylog::info("");
     auto rotating_mt = mylog::rotating_logger_mt("rotating_mt", "logs/rotating_mt.log", file_size, rotating_files);
     bench_mt(iters, std::move(rotating_mt), threads);
@@ -60,6 +65,10 @@ void bench_single_threaded(int iters)
     auto basic_st = mylog::basic_logger_st("basic_st", "logs/basic_st.log", true);
     bench(iters, std::move(basic_st));
 
+    mylog::info("");
+    auto fd_sink = std::make_shared<mylog::sinks::basic_fd_file_sink_st>("logs/basic_fd_st.log", true);
+    bench(iters, std::make_shared<mylog::logger>("basic_fd_st", std::move(fd_sink)));
+
     mylog::info("");
     auto rotating_st = mylog::rotating_logger_st("rotating_st", "logs/rotating_st.log", file_size, rotating_files);
     bench(iters, std::move(rotating_st));
@@ -0,0 +1,102 @@
+#include "log/mylog.h"
+#include "log/async.h"
+#include "log/details/coarse_clock.h"
+#include "log/details/time_zone.h"
+#include "log/details/tsc_clock.h"
+#include "log/sinks/basic_file_sink.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <memory>
+
+using namespace std::chrono;
+using namespace mylog;
+
+// Cost of taking a message timestamp with each clock source, alone and as
+// part of an async log call.
+
+// keeps the compiler from dropping the timed calls
+static std::uint64_t sink_value;
+
+template<typename Fn>
+double ns_per_call(int howmany, Fn&& fn)
+{
+    auto start = steady_clock::now();
+    for (int i = 0; i < howmany; i++)
+    {
+        sink_value += fn();
+    }
+    auto delta = steady_clock::now() - start;
+    return static_cast<double>(duration_cast<nanoseconds>(delta).count()) / howmany;
+}
+
+double async_ns_per_call(int howmany, log_clock_source source)
+{
+    auto tp = std::make_shared<details::thread_pool>(8192, 1);
+    auto file_sink = std::make_shared<sinks::basic_file_sink_mt>("logs/clock_bench.log", true);
+    auto logger = std::make_shared<async_logger>("async_logger", std::move(file_sink), std::move(tp));
+    logger->set_clock_source(source);
+    return ns_per_call(howmany, [&logger]() {
+        logger->info("Hello logger: msg number {}", 42);
+        return 0;
+    });
+}
+
+int main(int argc, char* argv[])
+{
+    int howmany = 10000000;
+    try
+    {
+        if (argc > 1)
+            howmany = atoi(argv[1]);
+
+        mylog::info("-------------------------------------------------");
+        mylog::info("Calls        : {:L}", howmany);
+        mylog::info("Invariant tsc: {}", details::tsc_clock::available());
+        mylog::info("Coarse res.  : {} ns", details::coarse_clock::resolution().count());
+        mylog::info("-------------------------------------------------");
+
+        mylog::info("log_clock::now()          {:>7.2f} ns", ns_per_call(howmany, [] {
+            return static_cast<std::uint64_t>(log_clock::now().time_since_epoch().count());
+        }));
+        mylog::info("tsc_clock::ticks()        {:>7.2f} ns", ns_per_call(howmany, [] { return details::tsc_clock::ticks(); }));
+        mylog::info("tsc_clock::now()          {:>7.2f} ns", ns_per_call(howmany, [] {
+            return static_cast<std::uint64_t>(details::tsc_clock::now().time_since_epoch().count());
+        }));
+        mylog::info("coarse_clock::now()       {:>7.2f} ns", ns_per_call(howmany, [] {
+            return static_cast<std::uint64_t>(details::coarse_clock::now().time_since_epoch().count());
+        }));
+
+        // broken-down time, once per second per formatter
+        std::time_t when = ::time(nullptr);
+        mylog::info("localtime_r()             {:>7.2f} ns", ns_per_call(howmany / 10, [&when] {
+            std::tm tm;
+            ++when;
+            ::localtime_r(&when, &tm);
+            return static_cast<std::uint64_t>(tm.tm_sec);
+        }));
+        mylog::info("time_zone::to_tm()        {:>7.2f} ns", ns_per_call(howmany / 10, [&when] {
+            ++when;
+            return static_cast<std::uint64_t>(details::time_zone::local().to_tm(when).tm_sec);
+        }));
+        mylog::info("time_zone::utc_tm()       {:>7.2f} ns", ns_per_call(howmany / 10, [&when] {
+            ++when;
+            return static_cast<std::uint64_t>(details::time_zone::utc_tm(when).tm_sec);
+        }));
+
+        // the async calls also wait for the queue, keep their count lower
+        auto async_calls = howmany / 10;
+        mylog::info("async info(), system      {:>7.2f} ns", async_ns_per_call(async_calls, log_clock_source::system));
+        mylog::info("async info(), tsc         {:>7.2f} ns", async_ns_per_call(async_calls, log_clock_source::tsc));
+        mylog::info("async info(), coarse      {:>7.2f} ns", async_ns_per_call(async_calls, log_clock_source::coarse));
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include "log/mylog.h"
+#include "log/pattern_formatter.h"
+#include "log/static_pattern_formatter.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+using namespace mylog;
+
+// Formatting cost of pattern_formatter, which calls one virtual flag_formatter
+// per flag, against static_pattern_formatter, which inlines the whole pattern.
+
+double ns_per_message(formatter& f, int howmany)
+{
+    std::string logger_name = "bench_logger";
+    details::log_msg msg(source_loc{"bench/formatter_bench.cc", 42, "main"}, logger_name, level::info, "Hello logger: msg number 42");
+    memory_buf_t dest;
+    std::size_t total = 0;
+
+    auto start = steady_clock::now();
+    for (int i = 0; i < howmany; i++)
+    {
+        dest.clear();
+        f.format(msg, dest);
+        total += dest.size();
+    }
+    auto delta = steady_clock::now() - start;
+    if (total == 0)
+    {
+        std::cerr << "nothing formatted" << std::endl;
+    }
+    return static_cast<double>(duration_cast<nanoseconds>(delta).count()) / howmany;
+}
+
+// every formatter sees a new second, as when hundreds of sinks log around a second change
+double ns_per_new_second(int formatters, int seconds)
+{
+    std::vector<std::unique_ptr<formatter>> all;
+    for (int i = 0; i < formatters; i++)
+    {
+        all.emplace_back(std::make_unique<pattern_formatter>("[%Y-%m-%d %H:%M:%S] %v"));
+    }
+    std::string logger_name = "bench_logger";
+    details::log_msg msg(logger_name, level::info, "Hello logger");
+    memory_buf_t dest;
+
+    auto start = steady_clock::now();
+    for (int s = 0; s < seconds; s++)
+    {
+        msg.time += std::chrono::seconds(1);
+        for (auto& f : all)
+        {
+            dest.clear();
+            f->format(msg, dest);
+        }
+    }
+    auto delta = steady_clock::now() - start;
+    return static_cast<double>(duration_cast<nanoseconds>(delta).count()) / (formatters * seconds);
+}
+
+int main(int argc, char* argv[])
+{
+    int howmany = 5000000;
+
+    try
+    {
+        if (argc > 1)
+            howmany = atoi(argv[1]);
+
+        mylog::info("-------------------------------------------------");
+        mylog::info("Messages     : {:L}", howmany);
+        mylog::info("-------------------------------------------------");
+
+        pattern_formatter full("%+");
+        auto static_full = make_static_formatter(MYLOG_PATTERN("%+"));
+        mylog::info("%+      runtime {:>7.2f} ns  static {:>7.2f} ns", ns_per_message(full, howmany), ns_per_message(*static_full, howmany));
+
+        pattern_formatter custom("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%s:%L] %v");
+        auto static_custom = make_static_formatter(MYLOG_PATTERN("[%Y-%m-%d %H:%M:%S.%e] [%n] [%^%l%$] [%s:%L] %v"));
+        mylog::info("custom  runtime {:>7.2f} ns  static {:>7.2f} ns", ns_per_message(custom, howmany), ns_per_message(*static_custom, howmany));
+
+        pattern_formatter padded("[%Y-%m-%d %H:%M:%S.%e] [%-12n] [%^%=8l%$] [%!16s:%-4L] %v");
+        auto static_padded = make_static_formatter(MYLOG_PATTERN("[%Y-%m-%d %H:%M:%S.%e] [%-12n] [%^%=8l%$] [%!16s:%-4L] %v"));
+        mylog::info("padded  runtime {:>7.2f} ns  static {:>7.2f} ns", ns_per_message(padded, howmany), ns_per_message(*static_padded, howmany));
+
+        mylog::info("new second, 500 formatters {:>7.2f} ns per formatter", ns_per_new_second(500, 2000));
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
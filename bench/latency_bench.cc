@@ -0,0 +1,102 @@
+#include "log/mylog.h"
+#include "log/async.h"
+#include "log/sinks/basic_file_sink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+using namespace mylog;
+
+// Enqueue latency (time spent in logger->info() on the calling thread) of the
+// async logger for each worker wait strategy.
+
+const char* wait_strategy_name(async_wait_strategy strategy)
+{
+    switch (strategy)
+    {
+    case async_wait_strategy::busy_spin:
+        return "busy_spin";
+    case async_wait_strategy::spin_yield:
+        return "spin_yield";
+    case async_wait_strategy::spin_park:
+        return "spin_park";
+    default:
+        return "park";
+    }
+}
+
+// per call latencies in nanoseconds
+std::vector<int64_t> bench_latency(std::shared_ptr<logger> logger, int howmany, microseconds pause)
+{
+    std::vector<int64_t> latencies;
+    latencies.reserve(static_cast<size_t>(howmany));
+    for (int i = 0; i < howmany; i++)
+    {
+        auto start = steady_clock::now();
+        logger->info("Hello logger: msg number {}", i);
+        latencies.push_back(duration_cast<nanoseconds>(steady_clock::now() - start).count());
+        if (pause.count() > 0)
+        {
+            // let the worker drain the queue and go idle again
+            std::this_thread::sleep_for(pause);
+        }
+    }
+    return latencies;
+}
+
+int64_t percentile(std::vector<int64_t>& sorted, double p)
+{
+    auto index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[])
+{
+    int howmany = 100000;
+    int pause_us = 0;
+    size_t queue_size = 8192;
+
+    try
+    {
+        if (argc > 1)
+            howmany = atoi(argv[1]);
+        if (argc > 2)
+            pause_us = atoi(argv[2]);
+
+        mylog::info("-------------------------------------------------");
+        mylog::info("Messages     : {:L}", howmany);
+        mylog::info("Pause        : {} us between messages", pause_us);
+        mylog::info("-------------------------------------------------");
+
+        for (auto queue_type : {async_queue_type::blocking, async_queue_type::byte_ring})
+        {
+            for (auto strategy : {async_wait_strategy::park, async_wait_strategy::busy_spin, async_wait_strategy::spin_yield,
+                     async_wait_strategy::spin_park})
+            {
+                auto q_max_size = queue_type == async_queue_type::byte_ring ? queue_size * 256 : queue_size;
+                auto tp = std::make_shared<details::thread_pool>(q_max_size, 1, queue_type, details::thread_pool::default_batch_size, strategy);
+                auto file_sink = std::make_shared<sinks::basic_file_sink_mt>("logs/latency_bench.log", true);
+                auto logger = std::make_shared<async_logger>("async_logger", std::move(file_sink), std::move(tp));
+
+                auto latencies = bench_latency(std::move(logger), howmany, microseconds(pause_us));
+                std::sort(latencies.begin(), latencies.end());
+                mylog::info("{:<10} {:<11} p50: {:>6} ns  p99: {:>7} ns  p99.9: {:>8} ns",
+                    queue_type == async_queue_type::byte_ring ? "byte_ring" : "blocking", wait_strategy_name(strategy),
+                    percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 0.999));
+            }
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
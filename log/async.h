@@ -57,12 +57,34 @@ inline std::shared_ptr<mylog::logger> create_async_nb(std::string logger_name, S
 }
 
 // set global thread pool.
-inline void init_thread_pool(size_t q_size, size_t thread_count)
+inline void init_thread_pool(size_t q_size, size_t thread_count, async_queue_type queue_type = async_queue_type::blocking,
+    async_wait_strategy wait_strategy = async_wait_strategy::park, async_lane_policy lane_policy = async_lane_policy::shared)
 {
-    auto tp = std::make_shared<details::thread_pool>(q_size, thread_count);
+    auto tp = std::make_shared<details::thread_pool>(
+        q_size, thread_count, queue_type, details::thread_pool::default_batch_size, wait_strategy, lane_policy);
     details::registry::instance().set_tp(std::move(tp));
 }
 
+// set global thread pool with thread settings (cpu pinning, names, scheduling,
+// start/stop hooks) and the other thread pool options.
+inline void init_thread_pool(size_t q_size, size_t thread_count, const details::thread_pool_options& options)
+{
+    auto tp = std::make_shared<details::thread_pool>(q_size, thread_count, options);
+    details::registry::instance().set_tp(std::move(tp));
+}
+
+// set global thread pool with a queue bounded by max_bytes of queued messages
+// instead of a message count. the overflow policy of each logger applies
+// when the budget is used up.
+// throw if max_bytes is below details::byte_ring_queue::min_capacity(), the
+// size of one record without logger name or payload; the global thread pool
+// is left unchanged then. a log message needs that plus its logger name and
+// payload, so budgets should be much larger.
+inline void init_thread_pool_bytes(size_t max_bytes, size_t thread_count)
+{
+    init_thread_pool(max_bytes, thread_count, async_queue_type::byte_ring);
+}
+
 // get the global thread pool.
 inline std::shared_ptr<mylog::details::thread_pool> thread_pool()
 {
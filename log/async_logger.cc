@@ -1,8 +1,55 @@
 #include "log/async_logger.h"
 #include "log/details/thread_pool.h"
 
+#include <algorithm>
+
 namespace mylog {
 
+async_logger::async_logger(const async_logger& other)
+    : std::enable_shared_from_this<async_logger>()
+    , logger(other)
+    , thread_pool_(other.thread_pool_)
+    , overflow_policy_(other.overflow_policy_)
+{
+    register_();
+}
+
+async_logger::~async_logger()
+{
+    try
+    {
+        if (thread_pool_)
+        {
+            thread_pool_->unregister_logger(handle_);
+            details::thread_pool::release(std::move(thread_pool_));
+        }
+    }
+    catch (const std::exception&)
+    {}
+}
+
+void async_logger::register_()
+{
+    // without a pool the logger can't log anyway
+    backend_converts_tsc_ = !thread_pool_ || thread_pool_->converts_tsc();
+    // queues merge and order messages by their time
+    base_fields_ |= msg_field::time;
+    // the format plan is read by the dispatcher, published by register_logger() along with the logger
+    update_from_sinks_();
+    // without a pool the logger can't log anyway, see sink_it_()
+    if (thread_pool_)
+    {
+        handle_ = thread_pool_->register_logger(this);
+    }
+}
+
+void async_logger::use_pool_clock_source_()
+{
+    if (thread_pool_)
+    {
+        set_clock_source(thread_pool_->clock_source());
+    }
+}
         
 std::shared_ptr<logger> async_logger::clone(std::string new_name)
 {
@@ -13,21 +60,64 @@ std::shared_ptr<logger> async_logger::clone(std::string new_name)
 
 void async_logger::sink_it_(const details::log_msg& msg)
 {
-    if (auto pool_ptr = thread_pool_.lock())
+    post_(msg, nullptr, overflow_policy_);
+}
+
+void async_logger::set_deferred_formatting(bool enabled)
+{
+    defer_formatting_.store(enabled);
+}
+
+bool async_logger::deferred_formatting() const
+{
+    return defer_formatting_.load(std::memory_order_relaxed);
+}
+
+void async_logger::sink_deferred_(const details::log_msg& msg, details::deferred_format_fn format_fn)
+{
+    post_(msg, format_fn, overflow_policy_);
+}
+
+bool async_logger::queue_full_() const
+{
+    return thread_pool_ && thread_pool_->queue_full();
+}
+
+bool async_logger::post_(const details::log_msg& msg, details::deferred_format_fn format_fn, async_overflow_policy overflow_policy)
+{
+    if (!thread_pool_)
+    {
+        throw_mylog_ex("async log: thread pool doesn't exist anymore");
+    }
+
+    if (!thread_pool_->post_log(handle_, msg, overflow_policy, format_fn))
     {
-        pool_ptr->post_log(shared_from_this(), msg, overflow_policy_);
+        dropped_[msg.level].fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
-    else
+    return true;
+}
+
+std::size_t async_logger::dropped_count(level::level_enum lvl) const
+{
+    return dropped_[lvl].load(std::memory_order_relaxed);
+}
+
+std::size_t async_logger::dropped_count() const
+{
+    std::size_t total = 0;
+    for (auto& count : dropped_)
     {
-        throw_mylog_ex("async log: thread pool doesn't exist anymore");
+        total += count.load(std::memory_order_relaxed);
     }
+    return total;
 }
 
 void async_logger::flush_()
 {
-    if (auto pool_ptr = thread_pool_.lock())
+    if (thread_pool_)
     {
-        pool_ptr->post_flush(shared_from_this(), overflow_policy_);
+        thread_pool_->post_flush(handle_, overflow_policy_);
     }
     else
     {
@@ -35,26 +125,116 @@ void async_logger::flush_()
     }
 }
 
+std::future<void> async_logger::flush_async()
+{
+    if (!thread_pool_)
+    {
+        throw_mylog_ex("async flush: thread pool doesn't exist anymore");
+    }
+    return thread_pool_->post_flush_barrier(handle_);
+}
+
+bool async_logger::flush_for(std::chrono::milliseconds timeout)
+{
+    if (!thread_pool_)
+    {
+        throw_mylog_ex("async flush: thread pool doesn't exist anymore");
+    }
+    return thread_pool_->flush_for(handle_, timeout);
+}
+
 /* backend functions - called from the thread pool to do the actual job */
+bool async_logger::backend_format_(const details::log_msg& msg, details::deferred_format_fn format_fn, memory_buf_t& dest)
+{
+    try
+    {
+        format_fn(msg.payload, dest);
+        return true;
+    }
+    MYLOG_LOGGER_CATCH(msg.source)
+    return false;
+}
+
 void async_logger::backend_sink_it_(const details::log_msg& msg)
 {
-    for (auto& s : sinks_)
+    log_to_sinks_(msg);
+
+    if (should_flush_(msg))
+    {
+        backend_flush_();
+    }
+
+}
+
+void async_logger::backend_sink_batch_(const details::log_msg_span& msgs)
+{
+    for (auto& group : format_plan_().groups)
     {
-        if (s->should_log(msg.level))
+        if (group.size() == 1)
         {
             try
             {
-                s->log(msg);
+                sinks_[group.front()]->log_batch(msgs);
             }
-            MYLOG_LOGGER_CATCH(msg.source)
+            MYLOG_LOGGER_CATCH(source_loc{})
+            continue;
         }
+        backend_sink_group_batch_(group, msgs);
     }
 
-    if (should_flush_(msg))
+    for (auto& msg : msgs)
     {
-        backend_flush_();
+        if (should_flush_(msg))
+        {
+            backend_flush_();
+            break;
+        }
+    }
+}
+
+void async_logger::backend_sink_group_batch_(const std::vector<std::size_t>& group, const details::log_msg_span& msgs)
+{
+    // the messages some sink of the group logs, formatted once by the first sink
+    auto lowest = level::off;
+    for (auto i : group)
+    {
+        lowest = std::min(lowest, sinks_[i]->level());
+    }
+
+    details::scratch_buffer<details::batch_buffer_tag> scratch;
+    auto& lines = scratch.get();
+    fmt::basic_memory_buffer<std::size_t> ends;
+    ends.resize(msgs.size());
+    auto& first = sinks_[group.front()];
+    for (std::size_t m = 0; m < msgs.size(); m++)
+    {
+        auto begin = lines.size();
+        if (msgs[m].level >= lowest)
+        {
+            bool formatted = false;
+            try
+            {
+                first->format(msgs[m], lines);
+                formatted = true;
+            }
+            MYLOG_LOGGER_CATCH(msgs[m].source)
+            if (!formatted)
+            {
+                lines.resize(begin);
+            }
+        }
+        ends[m] = lines.size();
     }
 
+    sinks::formatted_batch formatted{ lines, ends.data() };
+    for (auto i : group)
+    {
+        try
+        {
+            sinks_[i]->log_batch_formatted(msgs, formatted);
+        }
+        MYLOG_LOGGER_CATCH(source_loc{})
+    }
 }
 
 void async_logger::backend_flush_()
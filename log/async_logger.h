@@ -2,6 +2,9 @@
 
 #include "log/logger.h"
 
+#include <chrono>
+#include <future>
+
 namespace mylog {
 
 namespace details {
@@ -12,10 +15,43 @@ namespace details {
 enum class  async_overflow_policy
 {
     block,          // Block until message can be enqueued
-    overrun_oldest  // Discard oldest message in the queue if full when trying to
+    overrun_oldest, // Discard oldest message in the queue if full when trying to
                     // add new item.
+    discard_new     // Discard the new message if the queue is full. never waits,
+                    // and a queue known to be full is detected without locking.
+};
+
+// Queue implementation used by the thread pool.
+enum class async_queue_type
+{
+    blocking,   // mutex and condition variables around a circular queue
+    lockfree,   // lock-free bounded queue, producers never take a lock
+    per_thread, // one single-producer ring per producer thread, merged by time
+                // on the backend: each thread's messages keep their order, the
+                // order across threads is by time on a best-effort basis only.
+                // overrun_oldest drops the new message instead.
+    byte_ring   // variable-length records in one byte buffer. the queue size is
+                // in bytes instead of messages.
 };
 
+// How a thread pool with several workers shares the messages among them.
+enum class async_lane_policy
+{
+    shared,     // any worker takes any message. messages of one logger may be
+                // written out of order, and workers contend for shared sinks.
+    per_logger, // each logger is pinned to one worker (its lane) and keeps its order.
+                // loggers sharing a sink may still write it from two workers.
+    per_sink    // loggers sharing a sink, directly or through other loggers, land
+                // in the same lane, so every sink is written by one worker. follows
+                // sinks added later through logger::sinks() while none of the
+                // logger's messages is queued; groups never split up.
+};
+
+// Queued messages refer to the logger through a handle in the thread pool's
+// logger table, so posting a message costs no reference counting. In return the
+// destructor waits until the pool is done with the messages already queued.
+// Log calls don't lock the pool's weak_ptr either: the logger takes a reference
+// to the pool once, when created, and keeps the pool alive until destroyed.
 class async_logger final : public std::enable_shared_from_this<async_logger>, public logger
 {
     friend class details::thread_pool;
@@ -25,9 +61,12 @@ public:
     async_logger(std::string logger_name, It begin, It end, std::weak_ptr<details::thread_pool> tp,
         async_overflow_policy overflow_policy = async_overflow_policy::block)
         : logger(std::move(logger_name), begin, end)
-        , thread_pool_(tp)
+        , thread_pool_(tp.lock())
         , overflow_policy_(overflow_policy)
-    {}
+    {
+        register_();
+        use_pool_clock_source_();
+    }
 
     async_logger(std::string logger_name, sinks_init_list sinks_list, std::weak_ptr<details::thread_pool> tp,
         async_overflow_policy overflow_policy = async_overflow_policy::block)
@@ -38,18 +77,111 @@ public:
         async_overflow_policy overflow_policy = async_overflow_policy::block)
         : async_logger(std::move(logger_name), {std::move(single_sink)}, std::move(tp), overflow_policy)
     {}
+
+    // the copy gets its own handle
+    async_logger(const async_logger& other);
+    async_logger& operator=(const async_logger&) = delete;
+
+    // blocks until the thread pool has written every message of this logger
+    // still queued, which takes as long as the queue ahead of them. so drop the
+    // last reference off the hot path, e.g. after flush_async().wait().
+    // on one of the pool's own threads (in a sink or an error handler) it
+    // can't wait for itself: the queued messages are skipped instead, and the
+    // logger's handle is not reused for the life of the pool. its reference
+    // to the pool is then dropped on another thread, see thread_pool::release().
+    ~async_logger() override;
         
     std::shared_ptr<logger> clone(std::string new_name) override;
 
+    // when enabled, the calling thread only copies the format string and the
+    // arguments, and the thread pool formats the message. calls with argument
+    // types other than numbers, strings and void pointers are still formatted
+    // on the calling thread.
+    void set_deferred_formatting(bool enabled);
+    bool deferred_formatting() const;
+
+    // log without ever waiting for the queue, whatever the overflow policy:
+    // return false if the message was dropped because the queue was full.
+    template<typename... Args>
+    bool try_log(source_loc loc, level::level_enum lvl, fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        if (!should_log(lvl))
+        {
+            return true;
+        }
+
+        // a full queue drops the message before it is even formatted
+        if (queue_full_())
+        {
+            dropped_[lvl].fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        try
+        {
+            details::scratch_buffer<details::payload_buffer_tag> scratch;
+            auto& buf = scratch.get();
+            auto format_fn = format_or_defer_(buf, fmt, std::forward<Args>(args)...);
+            auto fields = capture_fields_();
+            details::log_msg msg(fields, loc, name_, lvl, string_view_t(buf.data(), buf.size()));
+            stamp_(msg, fields);
+            return post_(msg, format_fn, async_overflow_policy::discard_new);
+        }
+        MYLOG_LOGGER_CATCH(loc)
+        return false;
+    }
+
+    template<typename... Args>
+    bool try_log(level::level_enum lvl, fmt::format_string<Args...> fmt, Args&&... args)
+    {
+        return try_log(source_loc{}, lvl, fmt, std::forward<Args>(args)...);
+    }
+
+    // flush() that tells when it is done: the future is ready once every message
+    // logged before was written and the sinks were flushed.
+    std::future<void> flush_async();
+
+    // flush and wait at most timeout for it. return false on timeout.
+    bool flush_for(std::chrono::milliseconds timeout);
+
+    // messages of this logger dropped by discard_new or try_log, per level and in total.
+    // messages dropped by overrun_oldest are only counted by the thread pool.
+    std::size_t dropped_count(level::level_enum lvl) const;
+    std::size_t dropped_count() const;
+
 protected:
     void sink_it_(const details::log_msg& msg) override;
+    void sink_deferred_(const details::log_msg& msg, details::deferred_format_fn format_fn) override;
     void flush_() override;
+    bool backend_format_(const details::log_msg& msg, details::deferred_format_fn format_fn, memory_buf_t& dest);
     void backend_sink_it_(const details::log_msg &msg);
+    void backend_sink_batch_(const details::log_msg_span& msgs);
+    // backend_sink_batch_ for a group of sinks with equivalent formatters, see format_plan
+    void backend_sink_group_batch_(const std::vector<std::size_t>& group, const details::log_msg_span& msgs);
     void backend_flush_();
 
 private:
-    std::weak_ptr<details::thread_pool> thread_pool_;
+    void register_();
+    void use_pool_clock_source_();
+
+    // the sinks of the current format plan, read by the dispatcher for
+    // async_lane_policy::per_sink. a log call refreshes the plan once the sinks
+    // changed, before posting its message, so that message is routed by them.
+    const std::vector<const void*>* current_sinks_() const
+    {
+        return &format_plan_ptr_.load(std::memory_order_acquire)->sinks;
+    }
+
+    // the pool's queue looks full, see thread_pool::queue_full()
+    bool queue_full_() const;
+    // return false if the message was discarded
+    bool post_(const details::log_msg& msg, details::deferred_format_fn format_fn, async_overflow_policy overflow_policy);
+
+    // null if the pool was gone already when the logger was created
+    std::shared_ptr<details::thread_pool> thread_pool_;
     async_overflow_policy overflow_policy_;
+    details::logger_handle handle_{ 0 };
+    std::atomic<std::size_t> dropped_[level::n_levels] = {};
 };
 
 
@@ -28,6 +28,65 @@ using sinks_init_list = std::initializer_list<sink_ptr>;
 using err_handler = std::function<void(const std::string& err_msg)>;
 using async_logger_ptr = std::shared_ptr<async_logger>;
 
+// How idle thread pool workers wait for new messages, and how producers
+// wait for room with async_overflow_policy::block.
+// The lockfree and per_thread queues have no condition variable to park on:
+// there park and spin_park end up sleeping for growing intervals of at most
+// 1ms, see details::backoff. Producers waiting for room do the same with
+// every queue but blocking and byte_ring.
+enum class async_wait_strategy
+{
+    park,       // sleep until a producer wakes them up
+    busy_spin,  // never sleep. lowest latency, keeps a core busy per worker
+    spin_yield, // spin for a while, then yield the cpu between checks
+    spin_park   // spin and yield for a while before going to sleep
+};
+
+// Time zone of the time flags in patterns.
+enum class pattern_time_type
+{
+    local,      // the zone of TZ or /etc/localtime, see details::time_zone
+    utc         // no zone conversion at all
+};
+
+// Where loggers take the time of their messages from.
+enum class log_clock_source
+{
+    system,     // log_clock::now() for every message
+    tsc,        // the cpu's time stamp counter, see details::tsc_clock. async loggers
+                // leave the conversion to wall-clock time to the thread pool.
+                // other loggers, and any logger without an invariant tsc, fall
+                // back to system. the tsc is calibrated when this is set.
+                // async_queue_type::per_thread merges messages by their time, so
+                // its loggers fall back to system, and its pools reject tsc.
+    coarse,     // CLOCK_REALTIME_COARSE, see details::coarse_clock. times only
+                // advance once per kernel tick
+    automatic   // coarse if every sink's pattern is fine with the coarse clock
+                // resolution, system otherwise. chosen again on set_pattern()
+                // and set_formatter() of the logger.
+};
+
+// Linux scheduling policy of the thread pool threads.
+enum class thread_sched_policy
+{
+    normal,     // SCHED_OTHER, the nice value applies
+    batch,      // SCHED_BATCH: cpu-bound, never preempts interactive threads
+    idle        // SCHED_IDLE: only runs when nothing else wants the cpu
+};
+
+// Fields of a log message besides the level and the payload. Loggers only
+// capture those some sink prints, see formatter::fields().
+using msg_fields = unsigned int;
+
+namespace msg_field {
+constexpr msg_fields none = 0;
+constexpr msg_fields time = 1u << 0;
+constexpr msg_fields thread_id = 1u << 1;
+constexpr msg_fields source = 1u << 2;
+constexpr msg_fields logger_name = 1u << 3;
+constexpr msg_fields all = time | thread_id | source | logger_name;
+} // namespace msg_field
+
 struct source_loc
 {
     constexpr source_loc() = default;
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <chrono>
+#include <cstddef>
+#include <utility>
+
+namespace mylog {
+namespace details {
+
+// Interface of the queue between async loggers and the thread pool workers,
+// so the thread pool can be built on different queue implementations.
+template<typename T>
+class async_queue
+{
+public:
+    using item_type = T;
+
+    virtual ~async_queue() = default;
+
+    // block if no room left
+    virtual void enqueue(T&& item) = 0;
+
+    // overrun oldest item in the queue if no room left
+    virtual void enqueue_nowait(T&& item) = 0;
+
+    // return false without waiting if no room left. item is left untouched then.
+    virtual bool try_enqueue(T&& item) = 0;
+
+    // wait up to timeout for an item. return false if none was found.
+    virtual bool dequeue_for(T& popped_item, std::chrono::milliseconds wait_duration) = 0;
+
+    // move up to max_items items into items, waiting up to timeout for the first one.
+    // return the number of items dequeued.
+    virtual std::size_t dequeue_bulk_for(T* items, std::size_t max_items, std::chrono::milliseconds wait_duration) = 0;
+
+    virtual std::size_t size() = 0;
+    virtual std::size_t overrun_counter() = 0;
+
+    // whether the queue has no room left, without locking. the answer may be
+    // stale: it is only used to reject discard_new items before building them.
+    virtual bool full() = 0;
+};
+
+// Wraps any queue offering the mpmc_blocking_queue interface.
+template<typename Q>
+class async_queue_adapter final : public async_queue<typename Q::item_type>
+{
+public:
+    using item_type = typename Q::item_type;
+
+    async_queue_adapter(std::size_t max_size, async_wait_strategy wait_strategy)
+        : q_(max_size, wait_strategy)
+    {}
+
+    void enqueue(item_type&& item) override
+    {
+        q_.enqueue(std::move(item));
+    }
+
+    void enqueue_nowait(item_type&& item) override
+    {
+        q_.enqueue_nowait(std::move(item));
+    }
+
+    bool try_enqueue(item_type&& item) override
+    {
+        return q_.try_enqueue(std::move(item));
+    }
+
+    bool dequeue_for(item_type& popped_item, std::chrono::milliseconds wait_duration) override
+    {
+        return q_.dequeue_for(popped_item, wait_duration);
+    }
+
+    std::size_t dequeue_bulk_for(item_type* items, std::size_t max_items, std::chrono::milliseconds wait_duration) override
+    {
+        return q_.dequeue_bulk_for(items, max_items, wait_duration);
+    }
+
+    std::size_t size() override
+    {
+        return q_.size();
+    }
+
+    std::size_t overrun_counter() override
+    {
+        return q_.overrun_counter();
+    }
+
+    bool full() override
+    {
+        return q_.full();
+    }
+
+private:
+    Q q_;
+};
+
+} // namespace details
+} // namespace mylog
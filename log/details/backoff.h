@@ -0,0 +1,80 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <chrono>
+#include <cstddef>
+#include <thread>
+
+namespace mylog {
+namespace details {
+
+// Assumed size of a cache line, used to keep hot atomics of lock-free
+// queues on separate lines.
+static constexpr std::size_t cache_line_size = 64;
+
+inline void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// Progressive back-off for lock-free waits:
+// spin for a short while, then yield, then sleep with a growing interval.
+// busy_spin never gets past spinning, spin_yield never gets past yielding.
+class backoff
+{
+public:
+    explicit backoff(async_wait_strategy strategy = async_wait_strategy::spin_park)
+        : strategy_(strategy)
+    {}
+
+    void pause()
+    {
+        if (count_ < spin_limit_ || strategy_ == async_wait_strategy::busy_spin)
+        {
+            cpu_relax();
+        }
+        else if (count_ < yield_limit_ || strategy_ == async_wait_strategy::spin_yield)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            std::this_thread::sleep_for(sleep_);
+            if (sleep_ < max_sleep_)
+            {
+                sleep_ *= 2;
+            }
+        }
+        ++count_;
+    }
+
+    void reset()
+    {
+        count_ = 0;
+        sleep_ = min_sleep_;
+    }
+
+    // true once the next pause() would sleep
+    bool done_spinning() const
+    {
+        return count_ >= yield_limit_;
+    }
+
+private:
+    static constexpr unsigned spin_limit_ = 64;
+    static constexpr unsigned yield_limit_ = 128;
+    const std::chrono::microseconds min_sleep_{ 50 };
+    const std::chrono::microseconds max_sleep_{ 1000 };
+
+    async_wait_strategy strategy_;
+    unsigned count_{ 0 };
+    std::chrono::microseconds sleep_{ min_sleep_ };
+};
+
+} // namespace details
+} // namespace mylog
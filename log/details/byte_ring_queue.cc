@@ -0,0 +1,288 @@
+#include "log/details/byte_ring_queue.h"
+#include "log/details/thread_pool.h"
+
+#include <cstring>
+
+namespace mylog {
+namespace details {
+
+struct byte_ring_queue::record_header
+{
+    std::size_t size;       // of the whole record. 0 marks a skipped end of the ring
+    log_clock::time_point time;
+    std::uint64_t tsc_ticks;
+    std::size_t thread_id;
+    source_loc source;
+    deferred_format_fn format_fn;
+    std::shared_ptr<async_barrier>* barrier;    // owned by the record
+    std::size_t name_size;
+    std::size_t payload_size;
+    logger_handle handle;
+    async_msg_type msg_type;
+    level::level_enum level;
+};
+
+static std::size_t round_up(std::size_t n, std::size_t align)
+{
+    return (n + align - 1) / align * align;
+}
+
+byte_ring_queue::byte_ring_queue(std::size_t capacity, async_wait_strategy wait_strategy)
+    : capacity_(round_up(capacity, record_align))
+    , push_waiter_(wait_strategy)
+{
+    if (capacity < min_capacity())
+    {
+        throw_mylog_ex(fmt::format("mylog::byte_ring_queue: capacity of {} bytes is below the minimum of {} bytes", capacity, min_capacity()));
+    }
+    buffer_.reset(new char[capacity_]);
+}
+
+byte_ring_queue::~byte_ring_queue()
+{
+    while (count_ > 0)
+    {
+        pop_(nullptr);
+    }
+}
+
+bool byte_ring_queue::enqueue_log(logger_handle handle, const log_msg& msg, deferred_format_fn format_fn, async_overflow_policy overflow_policy)
+{
+    return enqueue_(msg, handle, async_msg_type::log, format_fn, nullptr, overflow_policy);
+}
+
+void byte_ring_queue::enqueue(async_msg&& item)
+{
+    enqueue_(item, item.handle, item.msg_type, item.format_fn, &item.barrier, async_overflow_policy::block);
+}
+
+void byte_ring_queue::enqueue_nowait(async_msg&& item)
+{
+    enqueue_(item, item.handle, item.msg_type, item.format_fn, &item.barrier, async_overflow_policy::overrun_oldest);
+}
+
+bool byte_ring_queue::try_enqueue(async_msg&& item)
+{
+    return enqueue_(item, item.handle, item.msg_type, item.format_fn, &item.barrier, async_overflow_policy::discard_new);
+}
+
+bool byte_ring_queue::dequeue_for(async_msg& popped_item, std::chrono::milliseconds wait_duration)
+{
+    return dequeue_bulk_for(&popped_item, 1, wait_duration) == 1;
+}
+
+std::size_t byte_ring_queue::dequeue_bulk_for(async_msg* items, std::size_t max_items, std::chrono::milliseconds wait_duration)
+{
+    std::size_t count = 0;
+    bool wake;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        if (!push_waiter_.wait_for(lock, wait_duration, [this] { return this->used_bytes_.load(std::memory_order_relaxed) > 0; },
+                [this] { return this->count_ > 0; }))
+        {
+            return 0;
+        }
+        while (count < max_items && count_ > 0)
+        {
+            pop_(&items[count++]);
+        }
+        used_bytes_.store(tail_ - head_, std::memory_order_relaxed);
+        wake = pop_waiter_.has_parked();
+    }
+    if (wake)
+    {
+        pop_waiter_.notify_all();
+    }
+    return count;
+}
+
+std::size_t byte_ring_queue::size()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return count_;
+}
+
+std::size_t byte_ring_queue::overrun_counter()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return overrun_counter_;
+}
+
+bool byte_ring_queue::full()
+{
+    return capacity_ - used_bytes_.load(std::memory_order_relaxed) < sizeof(record_header);
+}
+
+std::size_t byte_ring_queue::bytes_used()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return tail_ - head_;
+}
+
+std::size_t byte_ring_queue::peak_bytes_used()
+{
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return peak_bytes_;
+}
+
+std::size_t byte_ring_queue::capacity() const
+{
+    return capacity_;
+}
+
+std::size_t byte_ring_queue::min_capacity()
+{
+    return round_up(sizeof(record_header), record_align);
+}
+
+// barrier is moved from only if the message is queued
+bool byte_ring_queue::enqueue_(const log_msg& msg, logger_handle handle, async_msg_type msg_type, deferred_format_fn format_fn,
+    std::shared_ptr<async_barrier>* barrier, async_overflow_policy overflow_policy)
+{
+    auto record_size = round_up(sizeof(record_header) + msg.logger_name.size() + msg.payload.size(), record_align);
+    if (record_size > capacity_)
+    {
+        throw_mylog_ex(fmt::format("mylog::byte_ring_queue: message of {} bytes exceeds the queue capacity of {} bytes", record_size, capacity_));
+    }
+
+    if (overflow_policy == async_overflow_policy::discard_new && record_size > capacity_ - used_bytes_.load(std::memory_order_relaxed))
+    {
+        return false;
+    }
+
+    record_header header;
+    header.size = record_size;
+    header.time = msg.time;
+    header.tsc_ticks = msg.tsc_ticks;
+    header.thread_id = msg.thread_id;
+    header.source = msg.source;
+    header.format_fn = format_fn;
+    header.barrier = nullptr;
+    header.name_size = msg.logger_name.size();
+    header.payload_size = msg.payload.size();
+    header.handle = handle;
+    header.msg_type = msg_type;
+    header.level = msg.level;
+
+    bool wake;
+    {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        switch (overflow_policy)
+        {
+        case async_overflow_policy::block:
+            pop_waiter_.wait(lock, [this, record_size] { return this->needed_bytes_(record_size) <= capacity_ - (tail_ - head_); });
+            break;
+
+        case async_overflow_policy::discard_new:
+            if (needed_bytes_(record_size) > capacity_ - (tail_ - head_))
+            {
+                return false;
+            }
+            break;
+
+        case async_overflow_policy::overrun_oldest:
+        default:
+            while (needed_bytes_(record_size) > capacity_ - (tail_ - head_))
+            {
+                pop_(nullptr);
+                ++overrun_counter_;
+            }
+            break;
+        }
+
+        if (barrier != nullptr && *barrier)
+        {
+            header.barrier = new std::shared_ptr<async_barrier>(std::move(*barrier));
+        }
+
+        if (head_ == tail_)
+        {
+            // empty: start over at the beginning of the buffer
+            head_ = tail_ = 0;
+        }
+
+        auto offset = tail_ % capacity_;
+        if (capacity_ - offset < record_size)
+        {
+            std::size_t skip = 0;
+            std::memcpy(buffer_.get() + offset, &skip, sizeof(skip));
+            tail_ += capacity_ - offset;
+            offset = 0;
+        }
+
+        auto* dest = buffer_.get() + offset;
+        std::memcpy(dest, &header, sizeof(header));
+        dest += sizeof(header);
+        std::memcpy(dest, msg.logger_name.data(), header.name_size);
+        std::memcpy(dest + header.name_size, msg.payload.data(), header.payload_size);
+        tail_ += record_size;
+        ++count_;
+        if (tail_ - head_ > peak_bytes_)
+        {
+            peak_bytes_ = tail_ - head_;
+        }
+        used_bytes_.store(tail_ - head_, std::memory_order_relaxed);
+        wake = push_waiter_.has_parked();
+    }
+    if (wake)
+    {
+        push_waiter_.notify_one();
+    }
+    return true;
+}
+
+std::size_t byte_ring_queue::needed_bytes_(std::size_t record_size) const
+{
+    if (head_ == tail_)
+    {
+        // an empty ring is reset to offset 0 before writing
+        return record_size;
+    }
+
+    auto contiguous = capacity_ - tail_ % capacity_;
+    return contiguous >= record_size ? record_size : contiguous + record_size;
+}
+
+void byte_ring_queue::pop_(async_msg* popped_item)
+{
+    auto offset = head_ % capacity_;
+    std::size_t size;
+    std::memcpy(&size, buffer_.get() + offset, sizeof(size));
+    if (size == 0)
+    {
+        head_ += capacity_ - offset;
+        offset = 0;
+    }
+
+    record_header header;
+    std::memcpy(&header, buffer_.get() + offset, sizeof(header));
+    const char* data = buffer_.get() + offset + sizeof(header);
+
+    if (popped_item != nullptr)
+    {
+        log_msg msg;
+        msg.logger_name = string_view_t(data, header.name_size);
+        msg.time = header.time;
+        msg.tsc_ticks = header.tsc_ticks;
+        msg.level = header.level;
+        msg.thread_id = header.thread_id;
+        msg.source = header.source;
+        msg.payload = string_view_t(data + header.name_size, header.payload_size);
+        popped_item->assign(msg);
+        popped_item->handle = header.handle;
+        popped_item->msg_type = header.msg_type;
+        popped_item->format_fn = header.format_fn;
+        popped_item->barrier.reset();
+        if (header.barrier != nullptr)
+        {
+            popped_item->barrier = std::move(*header.barrier);
+        }
+    }
+    delete header.barrier;
+
+    head_ += header.size;
+    --count_;
+}
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "log/details/async_queue.h"
+#include "log/details/log_msg.h"
+#include "log/details/queue_waiter.h"
+#include "log/async_logger.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace mylog {
+namespace details {
+
+// Queue of async messages stored as variable-length records in one contiguous
+// byte ring: a fixed header followed by the logger name and payload bytes.
+// Memory is bounded by bytes instead of slots, and enqueue_log() copies a
+// message straight into the ring, so long payloads never hit the heap on the
+// producer side.
+// A record never wraps around the end of the ring: when it doesn't fit the
+// rest of the buffer, that rest is skipped and the record starts over at 0.
+class byte_ring_queue final : public async_queue<async_msg>
+{
+public:
+    // capacity in bytes, rounded up to the record alignment.
+    // throw if capacity is below min_capacity(): not even a control message
+    // (flush, terminate) would fit, so the thread pool could never shut down.
+    // wait_strategy applies to consumers waiting for records.
+    explicit byte_ring_queue(std::size_t capacity, async_wait_strategy wait_strategy = async_wait_strategy::park);
+    ~byte_ring_queue() override;
+
+    byte_ring_queue(const byte_ring_queue&) = delete;
+    byte_ring_queue& operator=(const byte_ring_queue&) = delete;
+
+    // copy a log message into the ring, without building an async_msg first.
+    // throw if the message is larger than the whole ring.
+    // return false if the message was discarded (async_overflow_policy::discard_new).
+    bool enqueue_log(logger_handle handle, const log_msg& msg, deferred_format_fn format_fn, async_overflow_policy overflow_policy);
+
+    void enqueue(async_msg&& item) override;
+    void enqueue_nowait(async_msg&& item) override;
+    bool try_enqueue(async_msg&& item) override;
+    bool dequeue_for(async_msg& popped_item, std::chrono::milliseconds wait_duration) override;
+    std::size_t dequeue_bulk_for(async_msg* items, std::size_t max_items, std::chrono::milliseconds wait_duration) override;
+
+    // number of queued messages
+    std::size_t size() override;
+    std::size_t overrun_counter() override;
+    // no room for even an empty record. enqueue_log() checks the actual size
+    bool full() override;
+
+    // bytes held by queued records, skipped tail bytes included
+    std::size_t bytes_used();
+    // highest bytes_used() seen so far
+    std::size_t peak_bytes_used();
+    std::size_t capacity() const;
+
+    // smallest accepted capacity: one record without logger name or payload
+    static std::size_t min_capacity();
+
+private:
+    struct record_header;
+    static constexpr std::size_t record_align = 8;
+
+    bool enqueue_(const log_msg& msg, logger_handle handle, async_msg_type msg_type, deferred_format_fn format_fn,
+        std::shared_ptr<async_barrier>* barrier, async_overflow_policy overflow_policy);
+
+    // bytes needed at the current tail to store a record of record_size bytes
+    std::size_t needed_bytes_(std::size_t record_size) const;
+
+    // must be called while holding the lock and with a record available
+    void pop_(async_msg* popped_item);
+
+private:
+    const std::size_t capacity_;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t head_{ 0 };     // monotonic byte positions
+    std::size_t tail_{ 0 };
+    std::size_t count_{ 0 };
+    std::size_t overrun_counter_{ 0 };
+    std::size_t peak_bytes_{ 0 };
+    std::atomic<std::size_t> used_bytes_{ 0 };  // tail_ - head_, readable without the lock
+
+    std::mutex queue_mutex_;
+    queue_waiter pop_waiter_;   // producers waiting for room
+    queue_waiter push_waiter_;  // consumers waiting for records
+};
+
+} // namespace details
+} // namespace mylog
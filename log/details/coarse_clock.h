@@ -0,0 +1,40 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <time.h>
+
+namespace mylog {
+namespace details {
+
+// Wall-clock time from CLOCK_REALTIME_COARSE: the time of the last timer tick,
+// read from the vdso without touching the clock hardware. Good enough for
+// patterns printing seconds, or milliseconds when the tick is short enough.
+class coarse_clock
+{
+public:
+    static log_clock::time_point now() noexcept
+    {
+        timespec ts;
+        ::clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        return log_clock::time_point(std::chrono::duration_cast<log_clock::duration>(
+            std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec)));
+    }
+
+    // how far now() may lag behind log_clock::now(), usually 1-4ms
+    static std::chrono::nanoseconds resolution() noexcept
+    {
+        static const std::chrono::nanoseconds res = [] {
+            timespec ts;
+            if (::clock_getres(CLOCK_REALTIME_COARSE, &ts) != 0)
+            {
+                return std::chrono::nanoseconds(std::chrono::seconds(1));
+            }
+            return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+        }();
+        return res;
+    }
+};
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <cstring>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace mylog {
+namespace details {
+
+// Deferred formatting: the producer copies the format string and the raw
+// argument values into the payload, and the backend formats them later.
+
+// formats an encoded payload into dest
+using deferred_format_fn = void (*)(string_view_t encoded, memory_buf_t& dest);
+
+inline void append_raw(memory_buf_t& buf, const void* data, std::size_t size)
+{
+    auto* begin = static_cast<const char*>(data);
+    buf.append(begin, begin + size);
+}
+
+inline void read_raw(const char*& pos, void* data, std::size_t size)
+{
+    std::memcpy(data, pos, size);
+    pos += size;
+}
+
+inline void encode_string(memory_buf_t& buf, const char* str, std::size_t size)
+{
+    append_raw(buf, &size, sizeof(size));
+    buf.append(str, str + size);
+}
+
+inline string_view_t decode_string(const char*& pos)
+{
+    std::size_t size;
+    read_raw(pos, &size, sizeof(size));
+    string_view_t str(pos, size);
+    pos += size;
+    return str;
+}
+
+// How one argument type is captured. Types without a specialization are not
+// deferrable, and calls using them are formatted on the producer as usual.
+// encode() returns false for a value it can't capture, which sends the call
+// down the same path.
+template<typename T, typename = void>
+struct deferred_arg
+{
+    static constexpr bool supported = false;
+};
+
+// numbers, chars and bools are copied as they are
+template<typename T>
+struct deferred_arg<T, typename std::enable_if<std::is_arithmetic<T>::value>::type>
+{
+    static constexpr bool supported = true;
+    using decoded_type = T;
+
+    static bool encode(memory_buf_t& buf, T value)
+    {
+        append_raw(buf, &value, sizeof(value));
+        return true;
+    }
+
+    static T decode(const char*& pos)
+    {
+        T value;
+        read_raw(pos, &value, sizeof(value));
+        return value;
+    }
+};
+
+// formatted as an address
+template<typename T>
+struct deferred_arg<T*, typename std::enable_if<std::is_void<T>::value>::type>
+{
+    static constexpr bool supported = true;
+    using decoded_type = const void*;
+
+    static bool encode(memory_buf_t& buf, const void* value)
+    {
+        append_raw(buf, &value, sizeof(value));
+        return true;
+    }
+
+    static const void* decode(const char*& pos)
+    {
+        const void* value;
+        read_raw(pos, &value, sizeof(value));
+        return value;
+    }
+};
+
+// strings are copied, the caller's buffer may be gone by the time the backend runs
+struct deferred_string_arg
+{
+    static constexpr bool supported = true;
+    using decoded_type = string_view_t;
+
+    static string_view_t decode(const char*& pos)
+    {
+        return decode_string(pos);
+    }
+};
+
+template<>
+struct deferred_arg<const char*> : deferred_string_arg
+{
+    // a null pointer is left to fmt, which reports it to the error handler
+    static bool encode(memory_buf_t& buf, const char* value)
+    {
+        if (value == nullptr)
+        {
+            return false;
+        }
+        encode_string(buf, value, std::strlen(value));
+        return true;
+    }
+};
+
+template<>
+struct deferred_arg<char*> : deferred_arg<const char*>
+{};
+
+template<>
+struct deferred_arg<std::string> : deferred_string_arg
+{
+    static bool encode(memory_buf_t& buf, const std::string& value)
+    {
+        encode_string(buf, value.data(), value.size());
+        return true;
+    }
+};
+
+template<>
+struct deferred_arg<string_view_t> : deferred_string_arg
+{
+    static bool encode(memory_buf_t& buf, string_view_t value)
+    {
+        encode_string(buf, value.data(), value.size());
+        return true;
+    }
+};
+
+template<bool...>
+struct bool_pack;
+
+template<bool... Bs>
+using all_true = std::is_same<bool_pack<true, Bs...>, bool_pack<Bs..., true>>;
+
+template<bool Supported, typename... Args>
+struct deferred_codec_impl
+{
+    static deferred_format_fn encode(memory_buf_t&, string_view_t, const Args&...)
+    {
+        return nullptr;
+    }
+};
+
+template<typename... Args>
+struct deferred_codec_impl<true, Args...>
+{
+    // payload layout: format string size, format string, then every argument
+    static deferred_format_fn encode(memory_buf_t& buf, string_view_t fmt, const Args&... args)
+    {
+        auto start = buf.size();
+        encode_string(buf, fmt.data(), fmt.size());
+        bool encoded[] = {true, deferred_arg<Args>::encode(buf, args)...};
+        for (bool ok : encoded)
+        {
+            if (!ok)
+            {
+                buf.resize(start);
+                return nullptr;
+            }
+        }
+        return &format;
+    }
+
+    static void format(string_view_t encoded, memory_buf_t& dest)
+    {
+        const char* pos = encoded.data();
+        auto fmt = decode_string(pos);
+        format_(fmt, pos, dest, std::index_sequence_for<Args...>{});
+    }
+
+private:
+    template<std::size_t... I>
+    static void format_(string_view_t fmt, const char* pos, memory_buf_t& dest, std::index_sequence<I...>)
+    {
+        // braced initialization decodes the arguments left to right
+        std::tuple<typename deferred_arg<Args>::decoded_type...> values{deferred_arg<Args>::decode(pos)...};
+        (void)pos; // unused without arguments
+        (void)values;
+        fmt::detail::vformat_to(dest, fmt, fmt::make_format_args(std::get<I>(values)...));
+    }
+};
+
+// encode() appends the payload and returns the function formatting it,
+// or returns nullptr and leaves buf as it was if some argument is not deferrable.
+template<typename... Args>
+using deferred_codec = deferred_codec_impl<all_true<deferred_arg<Args>::supported...>::value, Args...>;
+
+} // namespace details
+} // namespace mylog
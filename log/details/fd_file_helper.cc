@@ -0,0 +1,202 @@
+#include "log/details/fd_file_helper.h"
+#include "log/details/os.h"
+#include "log/common.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/uio.h>
+
+namespace mylog {
+namespace details {
+
+fd_file_helper::fd_file_helper(std::size_t buffer_size)
+    : buffer_(buffer_size > 0 ? new char[buffer_size] : nullptr)
+    , capacity_(buffer_size)
+{}
+
+fd_file_helper::~fd_file_helper()
+{
+    try
+    {
+        close();
+    }
+    catch (...)
+    {}
+}
+
+void fd_file_helper::open(filename_t filename, bool truncate)
+{
+    close();
+    filename_ = std::move(filename);
+
+    int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0);
+    for (int i = 0; i < open_tries_; ++i)
+    {
+        os::create_dir(os::dirname(filename_));
+        if ((fd_ = ::open(filename_.c_str(), flags, 0644)) != -1)
+        {
+            return;
+        }
+        os::sleep_for_millis(open_iterval_);
+    }
+
+    throw_mylog_ex("Failed opening file " + os::filename_to_str(filename_) + " for writing", errno);
+}
+
+void fd_file_helper::reopen(bool truncate)
+{
+    if (filename_.empty())
+    {
+        throw_mylog_ex("Failed re opening file - was not opened before");
+    }
+    this->open(filename_, truncate);
+}
+
+void fd_file_helper::flush()
+{
+    if (used_ == 0)
+    {
+        return;
+    }
+
+    // the buffered data is dropped on errors, like a failed write() would
+    auto used = used_;
+    used_ = 0;
+    if (!write_all_(buffer_.get(), used, nullptr, 0))
+    {
+        throw_mylog_ex("Failed flush to file " + os::filename_to_str(filename_), errno);
+    }
+}
+
+void fd_file_helper::sync()
+{
+    flush();
+    if (fd_ != -1 && ::fdatasync(fd_) != 0)
+    {
+        throw_mylog_ex("Failed sync to file " + os::filename_to_str(filename_), errno);
+    }
+}
+
+void fd_file_helper::close()
+{
+    if (fd_ == -1)
+    {
+        return;
+    }
+
+    auto used = used_;
+    used_ = 0;
+    bool ok = write_all_(buffer_.get(), used, nullptr, 0);
+    int last_errno = errno;
+    ::close(fd_);
+    fd_ = -1;
+    if (!ok)
+    {
+        throw_mylog_ex("Failed flush to file " + os::filename_to_str(filename_), last_errno);
+    }
+}
+
+void fd_file_helper::write(const memory_buf_t& buf)
+{
+    auto msg_size = buf.size();
+    if (msg_size == 0)
+    {
+        // nothing to write. buffer_ is null with a buffer size of 0, keep it out of memcpy
+        return;
+    }
+
+    if (msg_size <= capacity_ - used_)
+    {
+        std::memcpy(buffer_.get() + used_, buf.data(), msg_size);
+        used_ += msg_size;
+        return;
+    }
+
+    // doesn't fit: the buffered data and the line in one go
+    auto used = used_;
+    used_ = 0;
+    if (!write_all_(buffer_.get(), used, buf.data(), msg_size))
+    {
+        throw_mylog_ex("Failed writing to file " + os::filename_to_str(filename_), errno);
+    }
+}
+
+std::size_t fd_file_helper::size() const
+{
+    if (fd_ == -1)
+    {
+        throw_mylog_ex("Cannot use size() on closed file " + os::filename_to_str(filename_));
+    }
+
+    struct stat64 stat_buf;
+    if (::fstat64(fd_, &stat_buf) != 0)
+    {
+        throw_mylog_ex("Failed getting file size", errno);
+    }
+    return static_cast<std::size_t>(stat_buf.st_size) + used_;
+}
+
+const filename_t& fd_file_helper::filename() const
+{
+    return filename_;
+}
+
+void fd_file_helper::set_buffer_size(std::size_t buffer_size)
+{
+    flush();
+    buffer_.reset(buffer_size > 0 ? new char[buffer_size] : nullptr);
+    capacity_ = buffer_size;
+}
+
+std::size_t fd_file_helper::buffer_size() const
+{
+    return capacity_;
+}
+
+bool fd_file_helper::write_all_(const char* data1, std::size_t size1, const char* data2, std::size_t size2)
+{
+    if (fd_ == -1)
+    {
+        errno = EBADF;
+        return size1 + size2 == 0;
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>(data1);
+    iov[0].iov_len = size1;
+    iov[1].iov_base = const_cast<char*>(data2);
+    iov[1].iov_len = size2;
+
+    struct iovec* next = size1 > 0 ? iov : iov + 1;
+    int count = static_cast<int>(iov + 2 - next);
+    while (count > 0 && next->iov_len > 0)
+    {
+        auto written = ::writev(fd_, next, count);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        // skip what went out, the rest is written again
+        auto left = static_cast<std::size_t>(written);
+        while (count > 0 && left >= next->iov_len)
+        {
+            left -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count > 0)
+        {
+            next->iov_base = static_cast<char*>(next->iov_base) + left;
+            next->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <memory>
+
+namespace mylog {
+namespace details {
+
+// Same interface as file_helper, but writes to a raw fd opened with O_APPEND,
+// with a buffer of its own instead of stdio's: no stdio locking, and lines that
+// don't fit the buffer go out in a single writev() together with what is
+// buffered, without copying them first.
+//
+// Written data reaches the file only when the buffer fills, on flush() or on
+// close(). flush() hands it to the kernel, sync() also waits for the disk.
+class fd_file_helper
+{
+public:
+    static constexpr std::size_t default_buffer_size = 256 * 1024;
+
+    // buffer_size 0 writes every line as it comes
+    explicit fd_file_helper(std::size_t buffer_size = default_buffer_size);
+    ~fd_file_helper();
+
+    fd_file_helper(const fd_file_helper&) = delete;
+    fd_file_helper& operator=(const fd_file_helper&) = delete;
+
+    void open(filename_t filename, bool truncate = false);
+    void reopen(bool truncate = false);
+    void flush();
+    void sync();
+    void close();
+    void write(const memory_buf_t& buf);
+    // the file size, including the buffered data
+    std::size_t size() const;
+    const filename_t& filename() const;
+
+    // flushes the buffered data, then uses a buffer of buffer_size
+    void set_buffer_size(std::size_t buffer_size);
+    std::size_t buffer_size() const;
+
+private:
+    // write all of data1 then data2, retrying short writes; false on errors
+    bool write_all_(const char* data1, std::size_t size1, const char* data2, std::size_t size2);
+
+    const int open_tries_ = 5;
+    const unsigned int open_iterval_ = 10;
+    filename_t filename_;
+    int fd_{ -1 };
+    std::unique_ptr<char[]> buffer_;
+    std::size_t capacity_;
+    std::size_t used_{ 0 };
+};
+
+} // namespace details
+} // namespace mylog
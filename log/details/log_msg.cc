@@ -23,6 +23,14 @@ log_msg::log_msg(const string_view_t& logger_name_, level::level_enum level_, co
     : log_msg(log_clock::now(), source_loc{} , logger_name_, level_, payload_)
 {}
 
+log_msg::log_msg(msg_fields fields, source_loc loc_, const string_view_t& logger_name_, level::level_enum level_, const string_view_t& payload_)
+    : logger_name((fields & msg_field::logger_name) != 0 ? logger_name_ : string_view_t{})
+    , level(level_)
+    , thread_id((fields & msg_field::thread_id) != 0 ? os::thread_id() : 0)
+    , source((fields & msg_field::source) != 0 ? loc_ : source_loc{})
+    , payload(payload_)
+{}
+
 
 /* log_msg_buffer */
 log_msg_buffer::log_msg_buffer(const log_msg& msg)
@@ -75,6 +83,15 @@ log_msg_buffer& log_msg_buffer::operator=(log_msg_buffer&& other)
     return *this;
 }
 
+void log_msg_buffer::assign(const log_msg& msg)
+{
+    log_msg::operator=(msg);
+    buffer_.clear();
+    buffer_.append(logger_name.begin(), logger_name.end());
+    buffer_.append(payload.begin(), payload.end());
+    update_string_views();
+}
+
 void log_msg_buffer::update_string_views()
 {
     logger_name = string_view_t(buffer_.data(), logger_name.size());
@@ -82,23 +99,28 @@ void log_msg_buffer::update_string_views()
 }
 
 /* async_msg */
-async_msg::async_msg(async_logger_ptr&& worker, async_msg_type the_type, const details::log_msg& msg)
+async_msg::async_msg(logger_handle the_handle, async_msg_type the_type, const details::log_msg& msg)
     : log_msg_buffer(msg)
-    , worker_ptr(std::move(worker))
+    , handle(the_handle)
     , msg_type(the_type)
 {}
 
-async_msg::async_msg(async_logger_ptr&& worker, async_msg_type the_type)
+// control messages are stamped too, so queues merging by time keep them
+// after the messages posted before them.
+async_msg::async_msg(logger_handle the_handle, async_msg_type the_type)
     : log_msg_buffer()
-    , worker_ptr(std::move(worker))
+    , handle(the_handle)
     , msg_type(the_type)
-{}
+{
+    time = log_clock::now();
+}
 
 async_msg::async_msg(async_msg_type the_type)
     : log_msg_buffer()
-    , worker_ptr(nullptr)
     , msg_type(the_type)
-{}
+{
+    time = log_clock::now();
+}
 
 } // namespace details
 } // namespace mylog
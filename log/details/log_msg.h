@@ -2,7 +2,10 @@
 
 #include "log/common.h"
 #include "log/level.h"
+#include "log/details/deferred_format.h"
 
+#include <cstdint>
+#include <memory>
 
 
 namespace mylog {
@@ -15,9 +18,12 @@ struct log_msg
     log_msg(log_clock::time_point time_, source_loc loc_, const string_view_t& logger_name_, level::level_enum level_, const string_view_t& payload_);
     log_msg(source_loc loc_, const string_view_t& logger_name_, level::level_enum level_, const string_view_t& payload_);
     log_msg(const string_view_t& logger_name_, level::level_enum level_, const string_view_t& payload_);
+    // captures only the given fields and leaves the others empty. the time is left to the caller.
+    log_msg(msg_fields fields, source_loc loc_, const string_view_t& logger_name_, level::level_enum level_, const string_view_t& payload_);
 
     string_view_t logger_name;
     log_clock::time_point time;
+    std::uint64_t tsc_ticks{ 0 };   // if not 0, time is still to be converted from these, see tsc_clock
     level::level_enum level{ level::off };
     std::size_t thread_id{ 0 };
 
@@ -28,15 +34,61 @@ struct log_msg
     string_view_t payload;
 };
 
+// Non-owning view over a batch of log messages (see sink::log_batch).
+// Holds pointers, so messages of any type derived from log_msg can be batched.
+class log_msg_span
+{
+public:
+    class iterator
+    {
+    public:
+        explicit iterator(const log_msg* const* ptr)
+            : ptr_(ptr)
+        {}
+
+        const log_msg& operator*() const { return **ptr_; }
+        const log_msg* operator->() const { return *ptr_; }
+        iterator& operator++() { ++ptr_; return *this; }
+        bool operator==(const iterator& other) const { return ptr_ == other.ptr_; }
+        bool operator!=(const iterator& other) const { return ptr_ != other.ptr_; }
+
+    private:
+        const log_msg* const* ptr_;
+    };
+
+    log_msg_span(const log_msg* const* msgs, std::size_t count)
+        : msgs_(msgs)
+        , count_(count)
+    {}
+
+    std::size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    const log_msg& operator[](std::size_t i) const { return *msgs_[i]; }
+    iterator begin() const { return iterator(msgs_); }
+    iterator end() const { return iterator(msgs_ + count_); }
+
+private:
+    const log_msg* const* msgs_;
+    std::size_t count_;
+};
+
 
 // 异步日志类型
 enum class async_msg_type
 {
     log,
     flush,
-    terminate
+    terminate,
+    release,    // the logger is going away, see thread_pool::unregister_logger
+    fence       // wait for another lane to catch up, see thread_pool::move_route_
 };
 
+// Async loggers are referenced from queued messages by a small integer
+// resolved through the thread pool's logger table.
+using logger_handle = std::uint32_t;
+
+struct async_barrier;
+
 
 // Extend log_msg with internal buffer to store its payload.
 // This is needed since log_msg holds string_views that points to stack data.
@@ -52,6 +104,9 @@ public:
     log_msg_buffer(log_msg_buffer&& other);
     log_msg_buffer& operator=(log_msg_buffer&& other);
 
+    // replace the content with a copy of msg, reusing the buffer's storage
+    void assign(const log_msg& msg);
+
 private:
     void update_string_views();
     
@@ -66,8 +121,8 @@ struct async_msg : public log_msg_buffer
     async_msg() = default;
     
     /* 三个构造函数对应着三种异步日志的类型 */
-    async_msg(async_logger_ptr &&worker, async_msg_type the_type, const details::log_msg &msg);
-    async_msg(async_logger_ptr &&worker, async_msg_type the_type);
+    async_msg(logger_handle handle, async_msg_type the_type, const details::log_msg &msg);
+    async_msg(logger_handle handle, async_msg_type the_type);
     explicit async_msg(async_msg_type the_type);
     
     ~async_msg() = default;
@@ -79,8 +134,11 @@ struct async_msg : public log_msg_buffer
     async_msg(async_msg&&) = default;
     async_msg& operator=(async_msg&&) = default;
 
-    async_logger_ptr worker_ptr;
+    logger_handle handle{ 0 };
     async_msg_type msg_type{ async_msg_type::log };
+    std::shared_ptr<async_barrier> barrier;     // release messages, and flush messages waited for
+    deferred_format_fn format_fn{ nullptr };    // set if the payload still has to be formatted
+    std::uint64_t fence_seq{ 0 };               // fence messages only: position to wait for in lane `handle`
 };
 
     
@@ -1,9 +1,10 @@
 #pragma once 
 
 #include "log/details/circular_q.h"
+#include "log/details/queue_waiter.h"
 
+#include <atomic>
 #include <mutex>
-#include <condition_variable>
 
 namespace mylog {
 namespace details {
@@ -13,48 +14,130 @@ class mpmc_blocking_queue
 {
 public:
     using item_type = T;
-    explicit mpmc_blocking_queue(std::size_t max_size)
-        : q_(max_size)
+    // wait_strategy applies to consumers waiting for items.
+    // producers waiting for room always park.
+    explicit mpmc_blocking_queue(std::size_t max_size, async_wait_strategy wait_strategy = async_wait_strategy::park)
+        : push_waiter_(wait_strategy)
+        , q_(max_size)
     {}
 
     // try to enqueue and block if no room left
     void enqueue(T&& val)
     {
+        bool wake;
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
-            pop_cv_.wait(lock, [this] { return !this->q_.full(); });
+            pop_waiter_.wait(lock, [this] { return !this->q_.full(); });
             q_.push_back(std::move(val));
+            full_.store(q_.full(), std::memory_order_relaxed);
+            empty_.store(false, std::memory_order_relaxed);
+            wake = push_waiter_.has_parked();
+        }
+        if (wake)
+        {
+            push_waiter_.notify_one();
         }
-        push_cv_.notify_one();
     }
 
     // enqueue immediately. overrun oldest message in the queue if no room left.
     void enqueue_nowait(T&& val)
     {
+        bool wake;
         {
             std::lock_guard<std::mutex> lock(queue_mutex_);
             q_.push_back(std::move(val));
+            full_.store(q_.full(), std::memory_order_relaxed);
+            empty_.store(false, std::memory_order_relaxed);
+            wake = push_waiter_.has_parked();
+        }
+        if (wake)
+        {
+            push_waiter_.notify_one();
         }
-        push_cv_.notify_one();
+    }
+
+    // enqueue immediately. return false if no room left. a queue known to be
+    // full is detected without taking the lock.
+    bool try_enqueue(T&& val)
+    {
+        if (full_.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (q_.full())
+            {
+                return false;
+            }
+            q_.push_back(std::move(val));
+            full_.store(q_.full(), std::memory_order_relaxed);
+            empty_.store(false, std::memory_order_relaxed);
+            wake = push_waiter_.has_parked();
+        }
+        if (wake)
+        {
+            push_waiter_.notify_one();
+        }
+        return true;
     }
 
     // try to dequeue item. if no item found. wait up to timeout and try again
     // Return true, if succeeded dequeue item, false otherwise
     bool dequeue_for(T& popped_item, std::chrono::milliseconds wait_duration)
     {
+        bool wake;
         {
             std::unique_lock<std::mutex> lock(queue_mutex_);
-            if (!push_cv_.wait_for(lock, wait_duration, [this] {return !this->q_.empty();}))
+            if (!push_waiter_.wait_for(lock, wait_duration, [this] { return !this->empty_.load(std::memory_order_relaxed); },
+                    [this] { return !this->q_.empty(); }))
             {
                 return false;
             }
             popped_item = std::move(q_.front());
             q_.pop_front();
+            full_.store(false, std::memory_order_relaxed);
+            empty_.store(q_.empty(), std::memory_order_relaxed);
+            wake = pop_waiter_.has_parked();
+        }
+        if (wake)
+        {
+            pop_waiter_.notify_one();
         }
-        pop_cv_.notify_one();
         return true;
     }
 
+    // dequeue up to max_items items into items, waiting up to timeout for the first one.
+    // Return the number of items dequeued
+    std::size_t dequeue_bulk_for(T* items, std::size_t max_items, std::chrono::milliseconds wait_duration)
+    {
+        std::size_t count = 0;
+        bool wake;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            if (!push_waiter_.wait_for(lock, wait_duration, [this] { return !this->empty_.load(std::memory_order_relaxed); },
+                    [this] { return !this->q_.empty(); }))
+            {
+                return 0;
+            }
+            while (count < max_items && !q_.empty())
+            {
+                items[count++] = std::move(q_.front());
+                q_.pop_front();
+            }
+            full_.store(false, std::memory_order_relaxed);
+            empty_.store(q_.empty(), std::memory_order_relaxed);
+            wake = pop_waiter_.has_parked();
+        }
+        if (wake)
+        {
+            pop_waiter_.notify_all();
+        }
+        return count;
+    }
+
     std::size_t size()
     {
         std::lock_guard<std::mutex> lock(queue_mutex_);
@@ -67,10 +150,19 @@ public:
         return q_.overrun_counter();
     }
 
+    // without the lock, may be stale
+    bool full()
+    {
+        return full_.load(std::memory_order_relaxed);
+    }
+
 private:
     std::mutex queue_mutex_;
-    std::condition_variable pop_cv_, push_cv_;
+    queue_waiter pop_waiter_;   // producers waiting for room
+    queue_waiter push_waiter_;  // consumers waiting for items
     circular_q<T> q_;
+    std::atomic<bool> full_{ false };   // written under the lock, read by try_enqueue without it
+    std::atomic<bool> empty_{ true };   // written under the lock, polled by spinning consumers without it
 };
 
 } // namespace details
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "log/details/backoff.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace mylog {
+namespace details {
+
+// Bounded lock-free multi-producer/multi-consumer queue.
+// Every slot carries a sequence number telling whether it is ready to be
+// written (sequence == pos) or read (sequence == pos + 1), so producers and
+// consumers only contend on their own position counter (D. Vyukov's design).
+// Offers the same interface as mpmc_blocking_queue.
+template<typename T>
+class mpmc_lockfree_queue
+{
+public:
+    using item_type = T;
+
+    // wait_strategy applies to consumers waiting for items and to producers
+    // waiting for room. there is nothing to park on, so park and spin_park end
+    // up sleeping for short intervals.
+    // throw if max_size is 0: nothing could ever be enqueued
+    explicit mpmc_lockfree_queue(std::size_t max_size, async_wait_strategy wait_strategy = async_wait_strategy::spin_park)
+        : wait_strategy_(wait_strategy)
+        , capacity_(max_size)
+        , cells_(max_size > 0 ? new cell[max_size] : nullptr)
+    {
+        if (max_size == 0)
+        {
+            throw_mylog_ex("mylog::mpmc_lockfree_queue: max_size must be positive");
+        }
+        for (std::size_t i = 0; i < capacity_; ++i)
+        {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    mpmc_lockfree_queue(const mpmc_lockfree_queue&) = delete;
+    mpmc_lockfree_queue& operator=(const mpmc_lockfree_queue&) = delete;
+
+    // try to enqueue and block if no room left
+    void enqueue(T&& val)
+    {
+        backoff waiter(wait_strategy_);
+        while (!try_push_(val))
+        {
+            waiter.pause();
+        }
+    }
+
+    // enqueue immediately. overrun oldest message in the queue if no room left.
+    void enqueue_nowait(T&& val)
+    {
+        while (!try_push_(val))
+        {
+            T discarded;
+            if (try_pop_(discarded))
+            {
+                overrun_counter_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // enqueue immediately. return false if no room left.
+    bool try_enqueue(T&& val)
+    {
+        return try_push_(val);
+    }
+
+    // try to dequeue item. if no item found. wait up to timeout and try again
+    // Return true, if succeeded dequeue item, false otherwise
+    bool dequeue_for(T& popped_item, std::chrono::milliseconds wait_duration)
+    {
+        if (try_pop_(popped_item))
+        {
+            return true;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + wait_duration;
+        backoff waiter(wait_strategy_);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            waiter.pause();
+            if (try_pop_(popped_item))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // dequeue up to max_items items into items, waiting up to timeout for the first one.
+    // Return the number of items dequeued
+    std::size_t dequeue_bulk_for(T* items, std::size_t max_items, std::chrono::milliseconds wait_duration)
+    {
+        if (max_items == 0 || !dequeue_for(items[0], wait_duration))
+        {
+            return 0;
+        }
+
+        std::size_t count = 1;
+        while (count < max_items && try_pop_(items[count]))
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    std::size_t size()
+    {
+        auto tail = enqueue_pos_.load(std::memory_order_acquire);
+        auto head = dequeue_pos_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    std::size_t overrun_counter()
+    {
+        return overrun_counter_.load(std::memory_order_relaxed);
+    }
+
+    // the next cell is still taken, see try_push_(). may be stale
+    bool full()
+    {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        auto seq = cells_[pos % capacity_].sequence.load(std::memory_order_relaxed);
+        return static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos) < 0;
+    }
+
+private:
+    struct cell
+    {
+        std::atomic<std::size_t> sequence{ 0 };
+        T data;
+    };
+
+    // the item is moved from only when the push succeeds
+    bool try_push_(T& val)
+    {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;)
+        {
+            c = &cells_[pos % capacity_];
+            auto seq = c->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        c->data = std::move(val);
+        c->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop_(T& popped_item)
+    {
+        auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        cell* c;
+        for (;;)
+        {
+            c = &cells_[pos % capacity_];
+            auto seq = c->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // empty
+            }
+            else
+            {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        popped_item = std::move(c->data);
+        c->sequence.store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+private:
+    using pos_t = std::atomic<std::size_t>;
+
+    const async_wait_strategy wait_strategy_;
+    const std::size_t capacity_;
+    std::unique_ptr<cell[]> cells_;
+    char pad0_[cache_line_size];
+
+    // producers and consumers each own a cache line
+    pos_t enqueue_pos_{ 0 };
+    char pad1_[cache_line_size - sizeof(pos_t)];
+    pos_t dequeue_pos_{ 0 };
+    char pad2_[cache_line_size - sizeof(pos_t)];
+
+    std::atomic<std::size_t> overrun_counter_{ 0 };
+};
+
+} // namespace details
+} // namespace mylog
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "log/common.h"
+#include "log/details/time_zone.h"
 
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
 #include <sys/syscall.h>
 #include <unistd.h>
+#include <cerrno>
 #include <cstring>
+#include <string>
+#include <vector>
 #include <thread>
 #include <chrono>
 #include <sys/types.h>
@@ -15,12 +22,21 @@ namespace mylog {
 namespace details {
 namespace os {
 
+// local time from the built-in zone engine, see time_zone
 inline std::tm localtime(const std::time_t &time_tt) noexcept
 {
+    return time_zone::local().to_tm(time_tt);
+}
+
+// the inverse of localtime(), from the same engine
+inline std::time_t mktime(const std::tm &tm) noexcept
+{
+    return time_zone::local().to_time_t(tm);
+}
 
-    std::tm tm;
-    ::localtime_r(&time_tt, &tm);
-    return tm;
+inline std::tm gmtime(const std::time_t &time_tt) noexcept
+{
+    return time_zone::utc_tm(time_tt);
 }
 
 inline std::tm localtime() noexcept
@@ -131,6 +147,57 @@ inline int remove_if_exists(const filename_t& filename)
         return 0;
 }
 
+// the following apply to the calling thread and throw on failure
+
+// linux keeps at most 15 characters
+inline void set_thread_name(const std::string& name)
+{
+    auto truncated = name.substr(0, 15);
+    int rc = ::pthread_setname_np(::pthread_self(), truncated.c_str());
+    if (rc != 0)
+    {
+        throw_mylog_ex("Failed setting thread name " + truncated, rc);
+    }
+}
+
+inline void set_thread_affinity(const std::vector<int>& cpus)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus)
+    {
+        if (cpu < 0 || cpu >= CPU_SETSIZE)
+        {
+            throw_mylog_ex(fmt::format("Failed setting thread affinity: invalid cpu {}", cpu));
+        }
+        CPU_SET(static_cast<std::size_t>(cpu), &set);
+    }
+    int rc = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set);
+    if (rc != 0)
+    {
+        throw_mylog_ex("Failed setting thread affinity", rc);
+    }
+}
+
+inline void set_thread_scheduling(thread_sched_policy policy, int nice)
+{
+    if (policy != thread_sched_policy::normal)
+    {
+        sched_param param{};
+        int rc = ::pthread_setschedparam(::pthread_self(), policy == thread_sched_policy::idle ? SCHED_IDLE : SCHED_BATCH, &param);
+        if (rc != 0)
+        {
+            throw_mylog_ex("Failed setting thread scheduling policy", rc);
+        }
+    }
+
+    // on linux the nice value belongs to the thread
+    if (nice != 0 && ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), nice) != 0)
+    {
+        throw_mylog_ex(fmt::format("Failed setting thread nice value {}", nice), errno);
+    }
+}
+
 } // namespace os
 } // namespace details
 } // namespace mylog
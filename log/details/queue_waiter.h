@@ -0,0 +1,102 @@
+#pragma once
+
+#include "log/details/backoff.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace mylog {
+namespace details {
+
+// Waiting side of a mutex-based queue, following an async_wait_strategy.
+// Counts the threads parked on the condition variable, so the notifying side
+// can skip the wakeup (a futex syscall) while no one sleeps.
+class queue_waiter
+{
+public:
+    explicit queue_waiter(async_wait_strategy strategy = async_wait_strategy::park)
+        : strategy_(strategy)
+    {}
+
+    // lock must be held. wait up to timeout for ready() to become true and
+    // return its last value. while spinning the lock is released and only
+    // maybe_ready(), read without the lock, is polled; the lock is taken again
+    // to check ready() once maybe_ready() says so, or to park.
+    template<typename Hint, typename Pred>
+    bool wait_for(std::unique_lock<std::mutex>& lock, std::chrono::milliseconds timeout, Hint maybe_ready, Pred ready)
+    {
+        if (ready())
+        {
+            return true;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        if (strategy_ != async_wait_strategy::park)
+        {
+            backoff waiter(strategy_);
+            lock.unlock();
+            while (strategy_ != async_wait_strategy::spin_park || !waiter.done_spinning())
+            {
+                if (std::chrono::steady_clock::now() >= deadline)
+                {
+                    lock.lock();
+                    return ready();
+                }
+                waiter.pause();
+                if (maybe_ready())
+                {
+                    lock.lock();
+                    if (ready())
+                    {
+                        return true;
+                    }
+                    lock.unlock();
+                }
+            }
+            lock.lock();
+        }
+
+        ++parked_;
+        auto result = cv_.wait_until(lock, deadline, ready);
+        --parked_;
+        return result;
+    }
+
+    // lock must be held. wait without timeout, always parking.
+    template<typename Pred>
+    void wait(std::unique_lock<std::mutex>& lock, Pred ready)
+    {
+        if (ready())
+        {
+            return;
+        }
+        ++parked_;
+        cv_.wait(lock, ready);
+        --parked_;
+    }
+
+    // lock must be held. whether a notify is needed
+    bool has_parked() const
+    {
+        return parked_ > 0;
+    }
+
+    void notify_one()
+    {
+        cv_.notify_one();
+    }
+
+    void notify_all()
+    {
+        cv_.notify_all();
+    }
+
+private:
+    async_wait_strategy strategy_;
+    std::condition_variable cv_;
+    std::size_t parked_{ 0 };
+};
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "log/common.h"
+#include "log/details/fmt_helper.h"
+
+#include <cstring>
+
+namespace mylog {
+namespace details {
+
+// Width spec of a pattern flag: %8l, %-8l, %=8l, with '!' to truncate (%8!l or %!8l).
+struct padding_info
+{
+    enum class pad_side
+    {
+        left,   // right aligned
+        right,  // left aligned
+        center
+    };
+
+    static constexpr std::size_t max_width = 64;
+
+    padding_info() = default;
+    padding_info(std::size_t width, pad_side side, bool truncate)
+        : width_(width < max_width ? width : std::size_t{ max_width })
+        , side_(side)
+        , truncate_(truncate)
+        , enabled_(true)
+    {}
+
+    bool enabled() const
+    {
+        return enabled_;
+    }
+
+    std::size_t width_{ 0 };
+    pad_side side_{ pad_side::left };
+    bool truncate_{ false };
+    bool enabled_{ false };
+};
+
+// Pads a field of a known size around the flag's own appends: the left
+// padding is written on construction, the right padding or the truncation
+// when it goes out of scope.
+class scoped_padder
+{
+public:
+    scoped_padder(std::size_t wrapped_size, const padding_info& padinfo, memory_buf_t& dest)
+        : padinfo_(padinfo)
+        , dest_(dest)
+    {
+        remaining_pad_ = static_cast<long>(padinfo.width_) - static_cast<long>(wrapped_size);
+        if (remaining_pad_ <= 0)
+        {
+            return;
+        }
+
+        if (padinfo_.side_ == padding_info::pad_side::left)
+        {
+            pad_it_(remaining_pad_);
+            remaining_pad_ = 0;
+        }
+        else if (padinfo_.side_ == padding_info::pad_side::center)
+        {
+            auto half_pad = remaining_pad_ / 2;
+            auto reminder = remaining_pad_ & 1;
+            pad_it_(half_pad);
+            remaining_pad_ = half_pad + reminder;
+        }
+    }
+
+    ~scoped_padder()
+    {
+        if (remaining_pad_ >= 0)
+        {
+            pad_it_(remaining_pad_);
+        }
+        else if (padinfo_.truncate_)
+        {
+            auto new_size = static_cast<long>(dest_.size()) + remaining_pad_;
+            dest_.resize(static_cast<std::size_t>(new_size));
+        }
+    }
+
+    scoped_padder(const scoped_padder&) = delete;
+    scoped_padder& operator=(const scoped_padder&) = delete;
+
+    template<typename T>
+    static unsigned int count_digits(T n)
+    {
+        return details::count_digits(n);
+    }
+
+    static std::size_t length(const char* str)
+    {
+        return std::strlen(str);
+    }
+
+private:
+    void pad_it_(long count)
+    {
+        static const char spaces[] = "                                                                ";
+        static_assert(sizeof(spaces) - 1 == padding_info::max_width, "one space per column");
+        dest_.append(spaces, spaces + count);
+    }
+
+    const padding_info& padinfo_;
+    memory_buf_t& dest_;
+    long remaining_pad_;
+};
+
+// for flags without a spec: compiles away, sizes are not even computed
+struct null_scoped_padder
+{
+    null_scoped_padder(std::size_t, const padding_info&, memory_buf_t&) {}
+
+    template<typename T>
+    static unsigned int count_digits(T)
+    {
+        return 0;
+    }
+
+    static std::size_t length(const char*)
+    {
+        return 0;
+    }
+};
+
+// pad or truncate what was appended to dest since start, for formatters that
+// don't know the size up front
+inline void pad_appended(memory_buf_t& dest, std::size_t start, const padding_info& padinfo)
+{
+    auto written = dest.size() - start;
+    if (written >= padinfo.width_)
+    {
+        if (padinfo.truncate_)
+        {
+            dest.resize(start + padinfo.width_);
+        }
+        return;
+    }
+
+    auto pad = padinfo.width_ - written;
+    auto before = padinfo.side_ == padding_info::pad_side::left ? pad : padinfo.side_ == padding_info::pad_side::center ? pad / 2 : 0;
+    dest.resize(dest.size() + pad);
+    if (before > 0)
+    {
+        std::memmove(dest.data() + start + before, dest.data() + start, written);
+        std::memset(dest.data() + start, ' ', before);
+    }
+    std::memset(dest.data() + start + before + written, ' ', pad - before);
+}
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "log/common.h"
+
+namespace mylog {
+namespace details {
+
+// A growable buffer per thread, reused by every log call of the thread: once it
+// has grown to fit a long message, later ones don't allocate. Tag tells apart
+// buffers in use at the same time, like the payload of a message and the line
+// a sink formats from it. A nested use of the same buffer (a formatted argument
+// or a sink that logs itself) gets a buffer of its own instead.
+template<typename Tag>
+class scratch_buffer
+{
+public:
+    // buffers grown past this are freed after use, one huge message
+    // shouldn't pin its memory for the life of the thread
+    static constexpr std::size_t max_retained = 64 * 1024;
+
+    scratch_buffer()
+    {
+        auto& s = slot_();
+        if (!s.in_use)
+        {
+            s.in_use = true;
+            s.buf.clear();
+            buf_ = &s.buf;
+        }
+    }
+
+    ~scratch_buffer()
+    {
+        if (buf_ == &own_)
+        {
+            return;
+        }
+
+        auto& s = slot_();
+        if (s.buf.capacity() > std::size_t{ max_retained })
+        {
+            s.buf = memory_buf_t();
+        }
+        s.in_use = false;
+    }
+
+    scratch_buffer(const scratch_buffer&) = delete;
+    scratch_buffer& operator=(const scratch_buffer&) = delete;
+
+    memory_buf_t& get()
+    {
+        return *buf_;
+    }
+
+private:
+    struct slot
+    {
+        memory_buf_t buf;
+        bool in_use{ false };
+    };
+
+    static slot& slot_()
+    {
+        static thread_local slot s;
+        return s;
+    }
+
+    memory_buf_t own_;
+    memory_buf_t* buf_{ &own_ };
+};
+
+// the payload formatted by loggers
+struct payload_buffer_tag
+{};
+
+// the line formatted by sinks
+struct line_buffer_tag
+{};
+
+// the lines of a batch formatted once for several sinks
+struct batch_buffer_tag
+{};
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,439 @@
+#pragma once
+
+#include "log/details/backoff.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace mylog {
+namespace details {
+
+// Bounded single-producer/single-consumer ring.
+// Producer and consumer each keep a cached copy of the other side's index,
+// so the shared indices are only read when the cached one says full/empty.
+template<typename T>
+class spsc_ring
+{
+public:
+    // throw if capacity is 0: nothing could ever be pushed
+    explicit spsc_ring(std::size_t capacity)
+        : capacity_(capacity)
+        , slots_(capacity > 0 ? new T[capacity] : nullptr)
+    {
+        if (capacity == 0)
+        {
+            throw_mylog_ex("mylog::spsc_ring: capacity must be positive");
+        }
+    }
+
+    spsc_ring(const spsc_ring&) = delete;
+    spsc_ring& operator=(const spsc_ring&) = delete;
+
+    // producer side. on success val is swapped with the slot, so it gets the
+    // slot's previous content: a consumer swapping items out too keeps their
+    // storage (like long message buffers) going round instead of reallocating it.
+    // val is left untouched when the ring is full.
+    bool try_push(T& val)
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ >= capacity_)
+        {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail - head_cache_ >= capacity_)
+            {
+                return false;
+            }
+        }
+        using std::swap;
+        swap(slots_[tail % capacity_], val);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // producer side. no room for another push
+    bool full()
+    {
+        auto tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_cache_ >= capacity_)
+        {
+            head_cache_ = head_.load(std::memory_order_acquire);
+        }
+        return tail - head_cache_ >= capacity_;
+    }
+
+    // consumer side. return nullptr if the ring is empty
+    T* front()
+    {
+        auto head = head_.load(std::memory_order_relaxed);
+        if (head == tail_cache_)
+        {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head == tail_cache_)
+            {
+                return nullptr;
+            }
+        }
+        return &slots_[head % capacity_];
+    }
+
+    // consumer side. must follow a successful front()
+    void pop()
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    std::size_t size() const
+    {
+        auto tail = tail_.load(std::memory_order_acquire);
+        auto head = head_.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    // set by the producer thread on exit, or by the owning queue on destruction
+    std::atomic<bool> closed{ false };
+    std::atomic<bool> detached{ false };
+
+private:
+    using index_t = std::atomic<std::size_t>;
+
+    const std::size_t capacity_;
+    std::unique_ptr<T[]> slots_;
+    char pad0_[cache_line_size];
+
+    // producer line
+    index_t tail_{ 0 };
+    std::size_t head_cache_{ 0 };
+    char pad1_[cache_line_size - sizeof(index_t) - sizeof(std::size_t)];
+
+    // consumer line
+    index_t head_{ 0 };
+    std::size_t tail_cache_{ 0 };
+    char pad2_[cache_line_size - sizeof(index_t) - sizeof(std::size_t)];
+};
+
+// Orders items by their time member, oldest first.
+template<typename T>
+struct earlier_time
+{
+    bool operator()(const T& a, const T& b) const
+    {
+        return a.time < b.time;
+    }
+};
+
+// Multi-producer queue built from one spsc_ring per producer thread.
+// A producer lazily gets its own ring on its first enqueue, so producers never
+// write to a shared cache line. The consumer drains all rings, always taking
+// the oldest head item (by Compare) among the rings' current heads.
+// Rings of exited threads are drained and then released by the consumer.
+//
+// Ordering guarantee: items of one producer come out in the order it enqueued
+// them. Across producers the order by time is best effort only: an item pushed
+// to a ring that was empty when the consumer started a batch is not seen before
+// the next batch, so it may come out after a newer item of another producer. Items that were all enqueued
+// before the consumer took any of them come out ordered by time.
+//
+// Note: a producer cannot drop the oldest item of its ring (it belongs to the
+// consumer), so enqueue_nowait discards the new item when the ring is full and
+// counts it as an overrun.
+template<typename T, typename Compare = earlier_time<T>>
+class spsc_merge_queue
+{
+public:
+    using item_type = T;
+
+    // max_size is the capacity of each producer's ring, throw if 0.
+    // wait_strategy applies to consumers waiting for items and to producers
+    // waiting for room, see mpmc_lockfree_queue.
+    explicit spsc_merge_queue(std::size_t max_size, async_wait_strategy wait_strategy = async_wait_strategy::spin_park)
+        : ring_size_(max_size)
+        , id_(next_queue_id_())
+        , wait_strategy_(wait_strategy)
+    {
+        if (max_size == 0)
+        {
+            throw_mylog_ex("mylog::spsc_merge_queue: max_size must be positive");
+        }
+    }
+
+    ~spsc_merge_queue()
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        for (auto& r : rings_)
+        {
+            r->detached.store(true, std::memory_order_release);
+        }
+        for (auto& r : new_rings_)
+        {
+            r->detached.store(true, std::memory_order_release);
+        }
+    }
+
+    spsc_merge_queue(const spsc_merge_queue&) = delete;
+    spsc_merge_queue& operator=(const spsc_merge_queue&) = delete;
+
+    // try to enqueue and block if no room left in this thread's ring
+    void enqueue(T&& val)
+    {
+        auto& ring = local_ring_();
+        backoff waiter(wait_strategy_);
+        while (!ring.try_push(val))
+        {
+            waiter.pause();
+        }
+    }
+
+    // enqueue immediately. discard the item if no room left in this thread's ring.
+    void enqueue_nowait(T&& val)
+    {
+        if (!local_ring_().try_push(val))
+        {
+            overrun_counter_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // enqueue immediately. return false if no room left in this thread's ring.
+    bool try_enqueue(T&& val)
+    {
+        return local_ring_().try_push(val);
+    }
+
+    // try to dequeue item. if no item found. wait up to timeout and try again
+    // Return true, if succeeded dequeue item, false otherwise
+    bool dequeue_for(T& popped_item, std::chrono::milliseconds wait_duration)
+    {
+        return dequeue_bulk_for(&popped_item, 1, wait_duration) == 1;
+    }
+
+    // dequeue up to max_items items into items, waiting up to timeout for the first one.
+    // Return the number of items dequeued
+    std::size_t dequeue_bulk_for(T* items, std::size_t max_items, std::chrono::milliseconds wait_duration)
+    {
+        if (max_items == 0)
+        {
+            return 0;
+        }
+
+        auto count = try_pop_bulk_(items, max_items);
+        if (count > 0)
+        {
+            return count;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + wait_duration;
+        backoff waiter(wait_strategy_);
+        while (std::chrono::steady_clock::now() < deadline)
+        {
+            waiter.pause();
+            count = try_pop_bulk_(items, max_items);
+            if (count > 0)
+            {
+                return count;
+            }
+        }
+        return 0;
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        std::size_t total = 0;
+        for (auto& r : rings_)
+        {
+            total += r->size();
+        }
+        for (auto& r : new_rings_)
+        {
+            total += r->size();
+        }
+        return total;
+    }
+
+    std::size_t overrun_counter()
+    {
+        return overrun_counter_.load(std::memory_order_relaxed);
+    }
+
+    // no room left in this thread's ring
+    bool full()
+    {
+        return local_ring_().full();
+    }
+
+    // number of producer rings currently owned by the queue
+    std::size_t rings_count()
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex_);
+        return rings_.size() + new_rings_.size();
+    }
+
+private:
+    using ring_t = spsc_ring<T>;
+    using ring_ptr = std::shared_ptr<ring_t>;
+
+    // rings owned by the current thread, one per queue it has written to.
+    // on thread exit the rings are closed and left to the consumers to drain.
+    struct thread_rings
+    {
+        std::vector<std::pair<std::uint64_t, ring_ptr>> rings;
+        std::uint64_t last_id{ 0 };
+        ring_t* last_ring{ nullptr };
+
+        ~thread_rings()
+        {
+            for (auto& r : rings)
+            {
+                r.second->closed.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    static std::uint64_t next_queue_id_()
+    {
+        static std::atomic<std::uint64_t> counter{ 0 };
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    static thread_rings& thread_rings_()
+    {
+        static thread_local thread_rings rings;
+        return rings;
+    }
+
+    ring_t& local_ring_()
+    {
+        auto& local = thread_rings_();
+        if (local.last_id == id_)
+        {
+            return *local.last_ring;
+        }
+
+        ring_t* found = nullptr;
+        auto& rings = local.rings;
+        for (auto it = rings.begin(); it != rings.end();)
+        {
+            if (it->first == id_)
+            {
+                found = it->second.get();
+                ++it;
+            }
+            else if (it->second->detached.load(std::memory_order_acquire))
+            {
+                // its queue is gone
+                it = rings.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        if (found == nullptr)
+        {
+            auto ring = std::make_shared<ring_t>(ring_size_);
+            found = ring.get();
+            rings.emplace_back(id_, ring);
+            std::lock_guard<std::mutex> lock(rings_mutex_);
+            new_rings_.push_back(std::move(ring));
+            has_new_rings_.store(true, std::memory_order_release);
+        }
+
+        local.last_id = id_;
+        local.last_ring = found;
+        return *found;
+    }
+
+    // merge up to max_items items from the rings, under one lock for the whole
+    // batch. the front of each ring is read once, and again only after popping
+    // from that ring, so items arriving in a ring seen empty wait for the next batch.
+    std::size_t try_pop_bulk_(T* items, std::size_t max_items)
+    {
+        std::lock_guard<std::mutex> lock(consumer_mutex_);
+        if (has_new_rings_.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> rings_lock(rings_mutex_);
+            rings_.insert(rings_.end(), new_rings_.begin(), new_rings_.end());
+            new_rings_.clear();
+            has_new_rings_.store(false, std::memory_order_relaxed);
+        }
+
+        fronts_.resize(rings_.size());
+        for (std::size_t i = 0; i < rings_.size(); ++i)
+        {
+            fronts_[i] = rings_[i]->front();
+        }
+
+        std::size_t count = 0;
+        while (count < max_items)
+        {
+            std::size_t oldest = rings_.size();
+            for (std::size_t i = 0; i < rings_.size(); ++i)
+            {
+                if (fronts_[i] != nullptr && (oldest == rings_.size() || compare_(*fronts_[i], *fronts_[oldest])))
+                {
+                    oldest = i;
+                }
+            }
+            if (oldest == rings_.size())
+            {
+                break;
+            }
+
+            items[count++] = std::move(*fronts_[oldest]);
+            rings_[oldest]->pop();
+            fronts_[oldest] = rings_[oldest]->front();
+        }
+
+        // however busy the other rings are, so dead rings don't pile up and
+        // slow down the merge. reclaim_closed_rings_() checks again, in order
+        for (std::size_t i = 0; i < rings_.size(); ++i)
+        {
+            if (fronts_[i] == nullptr && rings_[i]->closed.load(std::memory_order_relaxed))
+            {
+                reclaim_closed_rings_();
+                break;
+            }
+        }
+        return count;
+    }
+
+    // release the rings of exited threads once they are fully drained
+    void reclaim_closed_rings_()
+    {
+        std::lock_guard<std::mutex> rings_lock(rings_mutex_);
+        for (auto it = rings_.begin(); it != rings_.end();)
+        {
+            // closed must be observed before emptiness, so no item is left behind
+            if ((*it)->closed.load(std::memory_order_acquire) && (*it)->front() == nullptr)
+            {
+                it = rings_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+private:
+    const std::size_t ring_size_;
+    const std::uint64_t id_;
+    const async_wait_strategy wait_strategy_;
+    Compare compare_;
+
+    std::mutex consumer_mutex_;             // serializes consumers
+    std::vector<ring_ptr> rings_;           // used by consumers only
+    std::vector<T*> fronts_;                // front item of each ring, see try_pop_bulk_()
+    std::mutex rings_mutex_;                // guards new_rings_ (and rings_ changes)
+    std::vector<ring_ptr> new_rings_;       // registered, not yet adopted by a consumer
+    std::atomic<bool> has_new_rings_{ false };
+    std::atomic<std::size_t> overrun_counter_{ 0 };
+};
+
+} // namespace details
+} // namespace mylog
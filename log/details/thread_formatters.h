@@ -0,0 +1,93 @@
+#pragma once
+
+#include "log/formatter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace mylog {
+namespace details {
+
+// Copies of sink formatters owned by the current thread, so sinks can format
+// without their lock: formatters like pattern_formatter keep per-message state.
+// Copies are found by sink::formatter_id(), a replaced formatter is cloned
+// again. A thread keeps a copy for as many sinks as opted in, at least
+// min_entries, so a thread logging to all of them never clones in a cycle.
+// Past that, the least recently used copy goes first.
+class thread_formatters
+{
+public:
+    static constexpr std::size_t min_entries = 8;
+
+    // the thread's copy of formatter id, nullptr if it has none
+    static formatter* find(std::uint64_t id)
+    {
+        auto& t = table_();
+        for (auto& e : t.entries)
+        {
+            if (e.id == id)
+            {
+                e.last_use = ++t.uses;
+                return e.copy.get();
+            }
+        }
+        return nullptr;
+    }
+
+    static formatter* add(std::uint64_t id, std::unique_ptr<formatter> copy)
+    {
+        auto& t = table_();
+        auto capacity = std::max(std::size_t{ min_entries }, opted_in_().load(std::memory_order_relaxed));
+        while (t.entries.size() >= capacity)
+        {
+            auto lru = std::min_element(t.entries.begin(), t.entries.end(),
+                [](const entry& a, const entry& b) { return a.last_use < b.last_use; });
+            t.entries.erase(lru);
+        }
+        t.entries.push_back(entry{ id, std::move(copy), ++t.uses });
+        return t.entries.back().copy.get();
+    }
+
+    // count of sinks formatting with the copies, see base_sink::set_format_outside_lock()
+    static void opt_in()
+    {
+        opted_in_().fetch_add(1, std::memory_order_relaxed);
+    }
+
+    static void opt_out()
+    {
+        opted_in_().fetch_sub(1, std::memory_order_relaxed);
+    }
+
+private:
+    struct entry
+    {
+        std::uint64_t id;
+        std::unique_ptr<formatter> copy;
+        std::uint64_t last_use;
+    };
+
+    struct table
+    {
+        std::vector<entry> entries;
+        std::uint64_t uses{ 0 };
+    };
+
+    static table& table_()
+    {
+        static thread_local table t;
+        return t;
+    }
+
+    static std::atomic<std::size_t>& opted_in_()
+    {
+        static std::atomic<std::size_t> count{ 0 };
+        return count;
+    }
+};
+
+} // namespace details
+} // namespace mylog
@@ -1,122 +1,1101 @@
 #include "log/details/thread_pool.h"
+#include "log/details/mpmc_blocking_queue.h"
+#include "log/details/mpmc_lockfree_queue.h"
+#include "log/details/spsc_merge_queue.h"
+#include "log/details/byte_ring_queue.h"
+#include "log/details/os.h"
+#include "log/details/tsc_clock.h"
 #include "log/common.h"
 
+#include <algorithm>
 #include <cassert>
+#include <condition_variable>
+#include <system_error>
 
 namespace mylog {
 namespace details {
+
+constexpr std::size_t thread_pool::default_batch_size;
+constexpr std::size_t thread_pool::lane_batches;
+constexpr std::uint64_t thread_pool::rebalance_interval;
+constexpr std::chrono::steady_clock::rep thread_pool::no_deadline;
+
+struct thread_pool::lane
+{
+    explicit lane(std::size_t capacity)
+        : ring(capacity)
+    {}
+
+    spsc_ring<async_msg> ring;              // the dispatcher produces, the lane worker consumes
+    std::uint64_t forwarded{ 0 };           // dispatcher only
+    char pad_[cache_line_size];
+    std::atomic<std::uint64_t> done{ 0 };   // messages the lane worker is done with
+
+    // an idle lane worker parks on park_cv, async_wait_strategy permitting.
+    // the dispatcher checks parked after each message and only then notifies.
+    std::atomic<bool> parked{ false };
+    std::mutex park_mutex;
+    std::condition_variable park_cv;
+};
     
-thread_pool::thread_pool(std::size_t q_max_size, std::size_t thread_nums)
-    : q_(q_max_size)
+static thread_pool_options positional_options(async_queue_type queue_type, std::size_t batch_size, async_wait_strategy wait_strategy,
+    async_lane_policy lane_policy)
+{
+    thread_pool_options options;
+    options.queue_type = queue_type;
+    options.batch_size = batch_size;
+    options.wait_strategy = wait_strategy;
+    options.lane_policy = lane_policy;
+    return options;
+}
+
+thread_pool::thread_pool(std::size_t q_max_size, std::size_t thread_nums, async_queue_type queue_type, std::size_t batch_size,
+    async_wait_strategy wait_strategy, async_lane_policy lane_policy)
+    : thread_pool(q_max_size, thread_nums, positional_options(queue_type, batch_size, wait_strategy, lane_policy))
+{}
+
+thread_pool::thread_pool(std::size_t q_max_size, std::size_t thread_nums, const thread_pool_options& options)
+    : q_(make_queue_(options.queue_type, q_max_size, options.wait_strategy))
+    , batch_size_(options.batch_size)
+    , wait_strategy_(options.wait_strategy)
+    , clock_source_(options.clock_source)
+    , converts_tsc_(options.queue_type != async_queue_type::per_thread)
+    , lane_policy_(options.lane_policy)
 {
     if (thread_nums == 0 || thread_nums > 1000)
     {
         throw_mylog_ex("mylog::thread_pool(): invalid threads_n param (valid range is 1-1000)");
     }
 
-    for (std::size_t i = 0; i < thread_nums; ++i)
+    if (batch_size_ == 0)
+    {
+        throw_mylog_ex("mylog::thread_pool(): batch_size must be positive");
+    }
+
+    if (clock_source_ == log_clock_source::tsc && !converts_tsc_)
+    {
+        throw_mylog_ex("mylog::thread_pool(): async_queue_type::per_thread merges messages by time and can't use log_clock_source::tsc");
+    }
+
+    if (clock_source_ == log_clock_source::tsc && tsc_clock::available())
     {
-        threads_.emplace_back([this]() {
-            this->worker_loop_();
+        tsc_clock::calibrate();
+    }
+
+    if (options.queue_type == async_queue_type::byte_ring)
+    {
+        byte_ring_ = static_cast<byte_ring_queue*>(q_.get());
+    }
+
+    std::vector<std::function<void()>> loops;
+    if (lane_policy_ != async_lane_policy::shared && thread_nums > 1)
+    {
+        for (std::size_t i = 0; i < thread_nums; ++i)
+        {
+            lanes_.push_back(std::make_unique<lane>(batch_size_ * lane_batches));
+        }
+        lane_loads_.resize(thread_nums);
+
+        loops.emplace_back([this]() {
+            this->dispatch_loop_();
         });
+        for (std::size_t i = 0; i < thread_nums; ++i)
+        {
+            loops.emplace_back([this, i]() {
+                this->lane_loop_(i);
+            });
+        }
+    }
+    else
+    {
+        for (std::size_t i = 0; i < thread_nums; ++i)
+        {
+            loops.emplace_back([this, i]() {
+                this->worker_loop_(i);
+            });
+        }
     }
-}
 
-thread_pool::~thread_pool()
-{
+    // threads only start on messages once all of them are set up
+    std::promise<bool> go;
+    auto go_future = go.get_future().share();
     try
     {
-        for (std::size_t i = 0; i < threads_.size(); ++i)
+        std::vector<std::future<void>> ready;
+        for (auto& loop : loops)
         {
-            post_async_msg_(async_msg(async_msg_type::terminate), async_overflow_policy::block);
+            std::promise<void> started;
+            ready.push_back(started.get_future());
+            start_thread_(options, std::move(loop), std::move(started), go_future);
         }
-
+        for (auto& started : ready)
+        {
+            started.get();
+        }
+    }
+    catch (...)
+    {
+        go.set_value(false);
         for (auto& t : threads_)
         {
             t.join();
         }
+        throw;
+    }
+    go.set_value(true);
+}
+
+thread_pool::~thread_pool()
+{
+    try
+    {
+        std::lock_guard<std::mutex> lock(shutdown_mutex_);
+        if (!stopped_)
+        {
+            stop_();
+        }
     }
     catch(const std::exception& e)
     {}   
 }
 
+void thread_pool::release(std::shared_ptr<thread_pool> tp)
+{
+    if (!tp || !tp->on_worker_thread_())
+    {
+        return;
+    }
+
+    try
+    {
+        std::thread([tp = std::move(tp)]() mutable { tp.reset(); }).detach();
+    }
+    catch (const std::system_error&)
+    {
+        // no thread to hand it to: better leave the pool running than
+        // destroy it under the worker
+        new std::shared_ptr<thread_pool>(std::move(tp));
+    }
+}
+
+logger_handle thread_pool::register_logger(async_logger* logger)
+{
+    std::lock_guard<std::mutex> lock(handles_mutex_);
+    std::size_t handle;
+    if (!free_handles_.empty())
+    {
+        handle = free_handles_.back();
+        free_handles_.pop_back();
+    }
+    else
+    {
+        if (next_handle_ == handles_per_chunk * max_handle_chunks)
+        {
+            throw_mylog_ex("mylog::thread_pool: too many async loggers");
+        }
+        handle = next_handle_++;
+        auto& chunk = handle_chunks_[handle / handles_per_chunk];
+        if (!chunk)
+        {
+            chunk.reset(new std::atomic<async_logger*>[handles_per_chunk]());
+        }
+    }
+    slot_(static_cast<logger_handle>(handle)).store(logger, std::memory_order_release);
+    return static_cast<logger_handle>(handle);
+}
+
+void thread_pool::unregister_logger(logger_handle handle)
+{
+    if (on_worker_thread_())
+    {
+        // cannot wait for ourselves. skip what is still queued for the logger
+        // and never reuse its handle.
+        std::lock_guard<std::mutex> lock(handles_mutex_);
+        slot_(handle).store(nullptr, std::memory_order_release);
+        return;
+    }
+
+    // every worker must see a release message, so none of them still holds
+    // an earlier message of this logger
+    std::shared_ptr<async_barrier> barrier;
+    auto done = post_barrier_(handle, async_msg_type::release, barrier);
+    wait_barrier_(handle, async_msg_type::release, barrier, done, std::chrono::steady_clock::time_point::max());
+}
+
+bool thread_pool::post_log(logger_handle handle, const log_msg& msg, async_overflow_policy overflow_policy,
+    deferred_format_fn format_fn)
+{
+    if (!accepting_.load(std::memory_order_relaxed))
+    {
+        rejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    if (byte_ring_ != nullptr)
+    {
+        return byte_ring_->enqueue_log(handle, msg, format_fn, overflow_policy);
+    }
+
+    // fail fast, before the payload is copied
+    if (overflow_policy == async_overflow_policy::discard_new && q_->full())
+    {
+        return false;
+    }
+
+    async_msg post_msg(handle, async_msg_type::log, msg);
+    post_msg.format_fn = format_fn;
+    return post_async_msg_(std::move(post_msg), overflow_policy);
+}
+
+void thread_pool::post_flush(logger_handle handle, async_overflow_policy overflow_policy)
+{
+    if (!accepting_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+    post_async_msg_(async_msg(handle, async_msg_type::flush), overflow_policy);
+}
+
+std::future<void> thread_pool::post_flush_barrier(logger_handle handle)
+{
+    std::shared_ptr<async_barrier> barrier;
+    return post_barrier_(handle, async_msg_type::flush, barrier);
+}
+
+bool thread_pool::flush_for(logger_handle handle, std::chrono::milliseconds timeout)
+{
+    if (on_worker_thread_())
+    {
+        // cannot wait for ourselves, nor for room in the queue
+        post_flush(handle, async_overflow_policy::discard_new);
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::shared_ptr<async_barrier> barrier;
+    auto done = post_barrier_(handle, async_msg_type::flush, barrier);
+    return wait_barrier_(handle, async_msg_type::flush, barrier, done, deadline);
+}
+
+thread_pool::shutdown_stats thread_pool::shutdown(std::chrono::milliseconds timeout)
+{
+    std::lock_guard<std::mutex> lock(shutdown_mutex_);
+    if (stopped_)
+    {
+        stats_.rejected = rejected_.load();
+        return stats_;
+    }
+
+    deadline_.store((std::chrono::steady_clock::now() + timeout).time_since_epoch().count(), std::memory_order_relaxed);
+    stop_();
+
+    // the threads are gone, and the lock keeps registered loggers alive
+    {
+        std::lock_guard<std::mutex> handles_lock(handles_mutex_);
+        for (std::size_t handle = 0; handle < next_handle_; ++handle)
+        {
+            if (auto* logger = resolve_(static_cast<logger_handle>(handle)))
+            {
+                logger->backend_flush_();
+            }
+        }
+    }
+
+    stats_.dropped = shutdown_dropped_.load();
+    stats_.rejected = rejected_.load();
+    stats_.drained = stats_.dropped == 0;
+    return stats_;
+}
 
-void thread_pool::post_log(async_logger_ptr&& worker_ptr, const log_msg& msg, async_overflow_policy overflow_policy)
+log_clock_source thread_pool::clock_source() const
 {
-    async_msg post_msg(std::move(worker_ptr), async_msg_type::log, msg);
-    post_async_msg_(std::move(post_msg), overflow_policy);
+    return clock_source_;
 }
 
-void thread_pool::post_flush(async_logger_ptr&& worker_ptr, async_overflow_policy overflow_policy)
+bool thread_pool::converts_tsc() const
 {
-    post_async_msg_(async_msg(std::move(worker_ptr), async_msg_type::flush), overflow_policy);
+    return converts_tsc_;
 }
 
 std::size_t thread_pool::overrun_counter()
 {
-    return q_.overrun_counter();
+    return q_->overrun_counter();
 }
 
 std::size_t thread_pool::queue_size()
 {
-    return q_.size();
+    return q_->size();
 }
 
-void thread_pool::post_async_msg_(async_msg&& msg, async_overflow_policy overflow_policy)
+bool thread_pool::queue_full()
 {
-    if (overflow_policy == async_overflow_policy::block)
+    return q_->full();
+}
+
+std::size_t thread_pool::queue_bytes()
+{
+    return byte_ring_ != nullptr ? byte_ring_->bytes_used() : 0;
+}
+
+std::size_t thread_pool::peak_queue_bytes()
+{
+    return byte_ring_ != nullptr ? byte_ring_->peak_bytes_used() : 0;
+}
+
+std::size_t thread_pool::queue_capacity_bytes()
+{
+    return byte_ring_ != nullptr ? byte_ring_->capacity() : 0;
+}
+
+std::future<void> thread_pool::post_barrier_(logger_handle handle, async_msg_type msg_type, std::shared_ptr<async_barrier>& barrier)
+{
+    barrier = std::make_shared<async_barrier>(barrier_arrivals_());
+    auto done = barrier->done.get_future();
+    if (stopped_)
     {
-        q_.enqueue(std::move(msg));
+        complete_barrier_(handle, msg_type, *barrier);
+        return done;
     }
-    else
+
+    for (std::size_t i = 0; i < barrier_arrivals_(); ++i)
+    {
+        async_msg msg(handle, msg_type);
+        msg.barrier = barrier;
+        post_async_msg_(std::move(msg), async_overflow_policy::block);
+    }
+    return done;
+}
+
+bool thread_pool::wait_barrier_(logger_handle handle, async_msg_type msg_type, const std::shared_ptr<async_barrier>& barrier,
+    std::future<void>& done, std::chrono::steady_clock::time_point deadline)
+{
+    // a barrier message may be overrun by a non-blocking producer, so post
+    // a spare one now and then. spares are ignored once the barrier is done.
+    const auto spare_interval = std::chrono::milliseconds(100);
+    for (;;)
+    {
+        if (stopped_)
+        {
+            complete_barrier_(handle, msg_type, *barrier);
+            return true;
+        }
+
+        auto now = std::chrono::steady_clock::now();
+        auto wake = deadline - now > spare_interval ? now + spare_interval : deadline;
+        if (done.wait_until(wake) == std::future_status::ready)
+        {
+            return true;
+        }
+        if (wake == deadline)
+        {
+            return false;
+        }
+
+        async_msg msg(handle, msg_type);
+        msg.barrier = barrier;
+        post_async_msg_(std::move(msg), async_overflow_policy::block);
+    }
+}
+
+std::unique_ptr<async_queue<async_msg>> thread_pool::make_queue_(async_queue_type queue_type, std::size_t q_max_size,
+    async_wait_strategy wait_strategy)
+{
+    switch (queue_type)
+    {
+    case async_queue_type::lockfree:
+        return std::make_unique<async_queue_adapter<mpmc_lockfree_queue<async_msg>>>(q_max_size, wait_strategy);
+
+    case async_queue_type::per_thread:
+        return std::make_unique<async_queue_adapter<spsc_merge_queue<async_msg>>>(q_max_size, wait_strategy);
+
+    case async_queue_type::byte_ring:
+        return std::make_unique<byte_ring_queue>(q_max_size, wait_strategy);
+
+    case async_queue_type::blocking:
+    default:
+        return std::make_unique<async_queue_adapter<mpmc_blocking_queue<async_msg>>>(q_max_size, wait_strategy);
+    }
+}
+
+bool thread_pool::post_async_msg_(async_msg&& msg, async_overflow_policy overflow_policy)
+{
+    switch (overflow_policy)
     {
-        q_.enqueue_nowait(std::move(msg));
+    case async_overflow_policy::block:
+        q_->enqueue(std::move(msg));
+        return true;
+
+    case async_overflow_policy::discard_new:
+        return q_->try_enqueue(std::move(msg));
+
+    case async_overflow_policy::overrun_oldest:
+    default:
+        q_->enqueue_nowait(std::move(msg));
+        return true;
     }
 }
 
-void thread_pool::worker_loop_()
+void thread_pool::start_thread_(const thread_pool_options& options, std::function<void()> loop, std::promise<void> ready,
+    std::shared_future<bool> go)
+{
+    auto index = threads_.size();
+    // options are only used until ready is set, the constructor waits for that
+    threads_.emplace_back([&options, index, loop = std::move(loop), ready = std::move(ready), go, on_stop = options.on_thread_stop]() mutable {
+        try
+        {
+            if (!options.thread_cpus.empty())
+            {
+                os::set_thread_affinity(options.thread_cpus[index % options.thread_cpus.size()]);
+            }
+            if (!options.thread_name.empty())
+            {
+                os::set_thread_name(options.thread_name + "-" + std::to_string(index));
+            }
+            os::set_thread_scheduling(options.sched_policy, options.nice);
+            if (options.on_thread_start)
+            {
+                options.on_thread_start();
+            }
+        }
+        catch (...)
+        {
+            ready.set_exception(std::current_exception());
+            return;
+        }
+        ready.set_value();
+
+        // on_thread_start ran, so on_thread_stop is due even if another
+        // thread failed its setup and the loop never starts
+        if (go.get())
+        {
+            loop();
+        }
+        if (on_stop)
+        {
+            on_stop();
+        }
+    });
+}
+
+void thread_pool::worker_loop_(std::size_t worker_index)
 {
-    while (process_next_msg_()) {}
+    // reused across wakeups, so message buffers keep their capacity
+    std::vector<async_msg> batch(batch_size_);
+    std::vector<memory_buf_t> formatted(batch_size_);   // payloads of deferred messages
+    std::vector<const log_msg*> run;
+    run.reserve(batch_size_);
+    std::vector<async_msg> pending;     // for the other workers, while the queue is full
+    bool active = true;
+    for (;;)
+    {
+        repost_pending_(pending);
+        if (!active && pending.empty())
+        {
+            break;
+        }
+
+        // keep draining while messages are pending, they go back as soon as there is room
+        auto wait = pending.empty() ? std::chrono::milliseconds(std::chrono::seconds(10)) : std::chrono::milliseconds(1);
+        auto count = q_->dequeue_bulk_for(batch.data(), batch.size(), wait);
+        active = process_batch_(worker_index, nullptr, batch, count, formatted, run, pending, active);
+    }
 }
 
-// process next message in the queue
+void thread_pool::repost_pending_(std::vector<async_msg>& pending)
+{
+    if (pending.empty())
+    {
+        return;
+    }
+
+    auto it = pending.begin();
+    while (it != pending.end() && q_->try_enqueue(std::move(*it)))
+    {
+        ++it;
+    }
+    pending.erase(pending.begin(), it);
+}
+
+// process count messages of batch, taken from the queue or from own_lane.
 // return true if this thread should still be active (while no terminate msg
 // was received)
-bool thread_pool::process_next_msg_()
+bool thread_pool::process_batch_(std::size_t worker_index, lane* own_lane, std::vector<async_msg>& batch, std::size_t count,
+    std::vector<memory_buf_t>& formatted, std::vector<const log_msg*>& run, std::vector<async_msg>& pending, bool active)
 {
-    async_msg msg;
-    bool dequeued = q_.dequeue_for(msg, std::chrono::seconds(10));
-    if (!dequeued)
+    auto done_base = own_lane != nullptr ? own_lane->done.load(std::memory_order_relaxed) : 0;
+    auto deadline = deadline_.load(std::memory_order_relaxed);
+    std::size_t discarded = 0;
+    bool in_run = false;
+    logger_handle run_handle = 0;
+    for (std::size_t i = 0; i < count; ++i)
     {
-        return true;
+        auto& msg = batch[i];
+        if (msg.msg_type == async_msg_type::log && deadline != no_deadline &&
+            std::chrono::steady_clock::now().time_since_epoch().count() > deadline)
+        {
+            // shutting down, out of time
+            ++discarded;
+            continue;
+        }
+
+        if (msg.msg_type == async_msg_type::log && msg.format_fn != nullptr && !format_deferred_(msg, formatted[i]))
+        {
+            continue;
+        }
+
+        if (msg.tsc_ticks != 0)
+        {
+            msg.time = tsc_clock::to_time_point(msg.tsc_ticks);
+            msg.tsc_ticks = 0;
+        }
+
+        if (in_run && msg.msg_type == async_msg_type::log && msg.handle == run_handle)
+        {
+            run.push_back(&msg);
+            continue;
+        }
+
+        if (in_run)
+        {
+            sink_run_(resolve_(run_handle), run);
+            in_run = false;
+        }
+
+        switch (msg.msg_type)
+        {
+        case async_msg_type::log:
+        {
+            in_run = true;
+            run_handle = msg.handle;
+            run.push_back(&msg);
+            break;
+        }
+
+        case async_msg_type::flush:
+        {
+            if (msg.barrier)
+            {
+                arrive_barrier_(worker_index, msg, pending);
+            }
+            else if (auto* logger = resolve_(msg.handle))
+            {
+                logger->backend_flush_();
+            }
+            break;
+        }
+
+        case async_msg_type::release:
+        {
+            arrive_barrier_(worker_index, msg, pending);
+            break;
+        }
+
+        case async_msg_type::fence:
+        {
+            // only the dispatcher forwards fences, to lanes
+            if (own_lane != nullptr)
+            {
+                wait_fence_(*own_lane, done_base + i, msg);
+            }
+            break;
+        }
+
+        case async_msg_type::terminate:
+        {
+            // one terminate per worker: pass any extra one on to the other workers
+            if (!active)
+            {
+                pending.emplace_back(async_msg_type::terminate);
+            }
+            active = false;
+            break;
+        }
+
+        default: {
+            assert(false);
+        }
+        }
+    }
+    if (in_run)
+    {
+        sink_run_(resolve_(run_handle), run);
+    }
+    if (own_lane != nullptr)
+    {
+        own_lane->done.store(done_base + count, std::memory_order_release);
     }
+    if (discarded > 0)
+    {
+        shutdown_dropped_.fetch_add(discarded, std::memory_order_relaxed);
+    }
+    return active;
+}
 
-    switch (msg.msg_type)
+void thread_pool::dispatch_loop_()
+{
+    std::vector<async_msg> batch(batch_size_);
+    for (;;)
     {
-    case async_msg_type::log:
+        auto count = q_->dequeue_bulk_for(batch.data(), batch.size(), std::chrono::seconds(10));
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (batch[i].msg_type == async_msg_type::terminate)
+            {
+                for (std::size_t lane_index = 0; lane_index < lanes_.size(); ++lane_index)
+                {
+                    forward_(lane_index, async_msg(async_msg_type::terminate));
+                }
+                return;
+            }
+            dispatch_(std::move(batch[i]));
+        }
+    }
+}
+
+void thread_pool::lane_loop_(std::size_t lane_index)
+{
+    auto& own_lane = *lanes_[lane_index];
+    std::vector<async_msg> batch(batch_size_);
+    std::vector<memory_buf_t> formatted(batch_size_);
+    std::vector<const log_msg*> run;
+    run.reserve(batch_size_);
+    std::vector<async_msg> pending;     // stays empty: a lane gets one terminate and one message per barrier
+    backoff idle(wait_strategy_);
+    for (;;)
     {
-        msg.worker_ptr->backend_sink_it_(msg);
-        return true;
+        std::size_t count = 0;
+        while (count < batch_size_)
+        {
+            auto* item = own_lane.ring.front();
+            if (item == nullptr)
+            {
+                break;
+            }
+            // swapped, so the ring slot keeps a buffer for the dispatcher, see spsc_ring::try_push
+            std::swap(batch[count++], *item);
+            own_lane.ring.pop();
+        }
+
+        if (count == 0)
+        {
+            if (wait_strategy_ == async_wait_strategy::park ||
+                (wait_strategy_ == async_wait_strategy::spin_park && idle.done_spinning()))
+            {
+                park_lane_(own_lane);
+            }
+            else
+            {
+                idle.pause();
+            }
+            continue;
+        }
+        idle.reset();
+
+        // a barrier message reaches a single lane, see barrier_arrivals_()
+        if (!process_batch_(0, &own_lane, batch, count, formatted, run, pending))
+        {
+            break;
+        }
     }
-        
-    case async_msg_type::flush:
+}
+
+void thread_pool::dispatch_(async_msg&& msg)
+{
+    auto handle = msg.handle;
+    auto* logger = resolve_(handle);
+    const void* key = logger;
+    if (lane_policy_ == async_lane_policy::per_sink && logger != nullptr)
     {
-        msg.worker_ptr->backend_flush_();
-        return true;
+        key = sink_group_key_(handle, logger);
     }
 
-    case async_msg_type::terminate:
+    // routes of released loggers stay until rebalance_() finds them idle:
+    // a spare release message must still reach the lane of the first one
+    auto& r = route_for_(key);
+    auto is_log = msg.msg_type == async_msg_type::log;
+    if (msg.msg_type == async_msg_type::release && handle < sink_groups_.size())
     {
-        return false;
+        // the handle may go to another logger next
+        sink_groups_[handle].logger = nullptr;
     }
-    
-    default: {
-        assert(false);
+    forward_(r.lane, std::move(msg));
+    r.last_seq = lanes_[r.lane]->forwarded;
+    if (is_log)
+    {
+        ++r.load;
+        if (++dispatched_ % rebalance_interval == 0)
+        {
+            rebalance_();
+        }
+    }
+}
+
+const void* thread_pool::sink_group_key_(logger_handle handle, const async_logger* logger)
+{
+    if (handle >= sink_groups_.size())
+    {
+        sink_groups_.resize(handle + 1u);
+    }
+    auto& group = sink_groups_[handle];
+    auto* current_sinks = logger->current_sinks_();
+    if (group.logger == logger && group.sinks == current_sinks && group.epoch == sink_groups_epoch_)
+    {
+        return group.key;
+    }
+
+    // a sink added since joins the group, a removed one stays in it
+    const void* key = logger;
+    auto& sinks = *current_sinks;
+    if (!sinks.empty())
+    {
+        key = find_sink_root_(sinks.front());
+        for (std::size_t i = 1; i < sinks.size(); ++i)
+        {
+            auto other = find_sink_root_(sinks[i]);
+            if (other != key)
+            {
+                merge_sink_groups_(key, other);
+            }
+        }
+    }
+    group.logger = logger;
+    group.sinks = current_sinks;
+    group.epoch = sink_groups_epoch_;
+    group.key = key;
+    return key;
+}
+
+const void* thread_pool::find_sink_root_(const void* sink)
+{
+    auto it = sink_parents_.find(sink);
+    if (it == sink_parents_.end())
+    {
+        sink_parents_.emplace(sink, sink);
+        return sink;
+    }
+
+    auto root = it->second;
+    for (auto parent = sink_parents_[root]; parent != root; parent = sink_parents_[root])
+    {
+        root = parent;
+    }
+    // point the whole path at the root
+    while (sink != root)
+    {
+        auto& parent = sink_parents_[sink];
+        sink = parent;
+        parent = root;
+    }
+    return root;
+}
+
+void thread_pool::merge_sink_groups_(const void* a, const void* b)
+{
+    sink_parents_[b] = a;
+    ++sink_groups_epoch_;
+
+    auto it = routes_.find(b);
+    if (it == routes_.end())
+    {
+        return;
+    }
+    auto moved = it->second;
+    routes_.erase(it);
+    auto existing = routes_.find(a);
+    if (existing == routes_.end())
+    {
+        routes_.emplace(a, moved);
+        return;
+    }
+
+    // b's messages may still be in its lane: like a moved route, behind a fence
+    auto& r = existing->second;
+    move_route_(moved, r.lane);
+    r.load += moved.load;
+    r.last_seq = std::max(r.last_seq, moved.last_seq);
+}
+
+void thread_pool::forward_(std::size_t lane_index, async_msg&& msg)
+{
+    auto& target = *lanes_[lane_index];
+    backoff full(wait_strategy_);
+    while (!target.ring.try_push(msg))
+    {
+        full.pause();
+    }
+    ++target.forwarded;
+
+    // pairs with the fence in park_lane_(): either the worker sees the
+    // message, or we see it parked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (target.parked.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(target.park_mutex);
+        target.park_cv.notify_one();
+    }
+}
+
+void thread_pool::park_lane_(lane& own_lane)
+{
+    std::unique_lock<std::mutex> lock(own_lane.park_mutex);
+    own_lane.parked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    own_lane.park_cv.wait(lock, [&own_lane] { return own_lane.ring.front() != nullptr; });
+    own_lane.parked.store(false, std::memory_order_relaxed);
+}
+
+thread_pool::route& thread_pool::route_for_(const void* key)
+{
+    auto it = routes_.find(key);
+    if (it != routes_.end())
+    {
+        return it->second;
+    }
+
+    // a new key goes to the lane with the fewest keys
+    std::vector<std::size_t> keys(lanes_.size(), 0);
+    for (auto& entry : routes_)
+    {
+        ++keys[entry.second.lane];
+    }
+    auto lane_index = static_cast<std::size_t>(std::min_element(keys.begin(), keys.end()) - keys.begin());
+    return routes_.emplace(key, route{lane_index, 0, 0}).first->second;
+}
+
+void thread_pool::rebalance_()
+{
+    std::fill(lane_loads_.begin(), lane_loads_.end(), 0);
+    for (auto& entry : routes_)
+    {
+        lane_loads_[entry.second.lane] += entry.second.load;
+    }
+    auto hot = static_cast<std::size_t>(std::max_element(lane_loads_.begin(), lane_loads_.end()) - lane_loads_.begin());
+    auto cold = static_cast<std::size_t>(std::min_element(lane_loads_.begin(), lane_loads_.end()) - lane_loads_.begin());
+
+    // ignore small differences, so keys don't bounce between lanes
+    auto gap = lane_loads_[hot] - lane_loads_[cold];
+    if (gap > rebalance_interval / 8)
+    {
+        // moving a key carrying at most half the gap never makes things worse
+        route* best = nullptr;
+        for (auto& entry : routes_)
+        {
+            auto& r = entry.second;
+            if (r.lane == hot && r.load > 0 && r.load <= gap / 2 && (best == nullptr || r.load > best->load))
+            {
+                best = &r;
+            }
+        }
+        if (best != nullptr)
+        {
+            move_route_(*best, cold);
+        }
+    }
+
+    // start a new window, and forget keys that were idle during this one
+    // once their lane is done with them
+    for (auto it = routes_.begin(); it != routes_.end();)
+    {
+        auto& r = it->second;
+        if (r.load == 0 && lanes_[r.lane]->done.load(std::memory_order_acquire) >= r.last_seq)
+        {
+            it = routes_.erase(it);
+        }
+        else
+        {
+            r.load = 0;
+            ++it;
+        }
+    }
+}
+
+void thread_pool::move_route_(route& r, std::size_t to)
+{
+    auto from = r.lane;
+    r.lane = to;
+    if (lanes_[from]->done.load(std::memory_order_acquire) >= r.last_seq)
+    {
+        // the old lane is already done with the key
+        return;
+    }
+
+    async_msg fence(static_cast<logger_handle>(from), async_msg_type::fence);
+    fence.fence_seq = r.last_seq;
+    forward_(to, std::move(fence));
+    r.last_seq = lanes_[to]->forwarded;
+}
+
+void thread_pool::wait_fence_(lane& own_lane, std::uint64_t processed, const async_msg& fence)
+{
+    // publish our own progress first: the other lane may be waiting on a fence
+    // of its own that refers to messages before this one
+    own_lane.done.store(processed, std::memory_order_release);
+
+    auto& other = *lanes_[fence.handle];
+    backoff wait(wait_strategy_);
+    while (other.done.load(std::memory_order_acquire) < fence.fence_seq)
+    {
+        wait.pause();
+    }
+}
+
+std::size_t thread_pool::barrier_arrivals_() const
+{
+    // with lanes, the logger's messages are all in its own lane, behind
+    // any fence needed after a move
+    return lanes_.empty() ? threads_.size() : 1;
+}
+
+void thread_pool::arrive_barrier_(std::size_t worker_index, async_msg& msg, std::vector<async_msg>& pending)
+{
+    auto& barrier = *msg.barrier;
+    if (barrier.remaining.load(std::memory_order_acquire) == 0)
+    {
+        // a spare message, the barrier is already done
+    }
+    else if (barrier.arrived[worker_index].exchange(true, std::memory_order_acq_rel))
+    {
+        // this worker already arrived: pass the message on to the others
+        pending.emplace_back(msg.handle, msg.msg_type);
+        pending.back().barrier = msg.barrier;
+    }
+    else if (barrier.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        barrier_done_(msg.handle, msg.msg_type, barrier);
+    }
+    msg.barrier.reset();
+}
+
+void thread_pool::barrier_done_(logger_handle handle, async_msg_type msg_type, async_barrier& barrier)
+{
+    if (msg_type == async_msg_type::release)
+    {
+        free_handle_(handle);
+    }
+    else if (auto* logger = resolve_(handle))
+    {
+        logger->backend_flush_();
+    }
+    barrier.done.set_value();
+}
+
+void thread_pool::complete_barrier_(logger_handle handle, async_msg_type msg_type, async_barrier& barrier)
+{
+    // the waiter and discard_queued_() may both get here
+    if (barrier.remaining.exchange(0, std::memory_order_acq_rel) != 0)
+    {
+        barrier_done_(handle, msg_type, barrier);
     }
+}
+
+void thread_pool::stop_()
+{
+    accepting_.store(false);
+
+    // the dispatcher passes its terminate message on to every lane
+    auto terminates = lanes_.empty() ? threads_.size() : 1;
+    for (std::size_t i = 0; i < terminates; ++i)
+    {
+        post_async_msg_(async_msg(async_msg_type::terminate), async_overflow_policy::block);
+    }
+
+    for (auto& t : threads_)
+    {
+        t.join();
+    }
+    stopped_.store(true);
+    discard_queued_();
+}
+
+void thread_pool::discard_queued_()
+{
+    // posted concurrently with the terminate messages, behind them.
+    // this also frees room for producers still blocked on a full queue.
+    std::vector<async_msg> batch(batch_size_);
+    std::size_t count;
+    while ((count = q_->dequeue_bulk_for(batch.data(), batch.size(), std::chrono::milliseconds::zero())) > 0)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            auto& msg = batch[i];
+            if (msg.barrier)
+            {
+                complete_barrier_(msg.handle, msg.msg_type, *msg.barrier);
+            }
+            else if (msg.msg_type == async_msg_type::log)
+            {
+                shutdown_dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
     }
+}
 
+bool thread_pool::format_deferred_(async_msg& msg, memory_buf_t& dest)
+{
+    auto* logger = resolve_(msg.handle);
+    if (logger == nullptr)
+    {
+        return false;
+    }
+
+    dest.clear();
+    if (!logger->backend_format_(msg, msg.format_fn, dest))
+    {
+        return false;
+    }
+    msg.payload = string_view_t(dest.data(), dest.size());
     return true;
 }
+
+std::atomic<async_logger*>& thread_pool::slot_(logger_handle handle) const
+{
+    return handle_chunks_[handle / handles_per_chunk][handle % handles_per_chunk];
+}
+
+async_logger* thread_pool::resolve_(logger_handle handle) const
+{
+    return slot_(handle).load(std::memory_order_acquire);
+}
+
+void thread_pool::free_handle_(logger_handle handle)
+{
+    std::lock_guard<std::mutex> lock(handles_mutex_);
+    slot_(handle).store(nullptr, std::memory_order_release);
+    free_handles_.push_back(handle);
+}
+
+bool thread_pool::on_worker_thread_() const
+{
+    auto id = std::this_thread::get_id();
+    for (auto& t : threads_)
+    {
+        if (t.get_id() == id)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void thread_pool::sink_run_(async_logger* logger, std::vector<const log_msg*>& run)
+{
+    if (logger == nullptr)
+    {
+        // released from one of our own threads, see unregister_logger()
+        run.clear();
+        return;
+    }
+
+    if (run.size() == 1)
+    {
+        logger->backend_sink_it_(*run.front());
+    }
+    else
+    {
+        logger->backend_sink_batch_(log_msg_span(run.data(), run.size()));
+    }
+    run.clear();
+}
     
 } // namespace details
 } // namespace mylog
\ No newline at end of file
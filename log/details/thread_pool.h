@@ -1,21 +1,67 @@
 #pragma once
 
-#include "log/details/mpmc_blocking_queue.h"
+#include "log/details/async_queue.h"
 #include "log/details/log_msg.h"
 #include "log/async_logger.h"
 
+#include <atomic>
+#include <functional>
+#include <future>
+#include <limits>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace mylog {
 namespace details {
 
+// Shared by the release or flush messages posted for one logger, one per
+// worker. Each worker arrives once; the last one to arrive fulfils done.
+struct async_barrier
+{
+    explicit async_barrier(std::size_t workers)
+        : arrived(new std::atomic<bool>[workers])
+        , remaining(workers)
+    {
+        for (std::size_t i = 0; i < workers; ++i)
+        {
+            arrived[i].store(false, std::memory_order_relaxed);
+        }
+    }
+
+    std::unique_ptr<std::atomic<bool>[]> arrived;
+    std::atomic<std::size_t> remaining;
+    std::promise<void> done;
+};
+
+class byte_ring_queue;
+struct thread_pool_options;
+
 class thread_pool
 {
 public:
     using item_type = async_msg;
+
+    // max number of messages a worker takes from the queue per wakeup
+    static constexpr std::size_t default_batch_size = 64;
     
-    thread_pool(std::size_t q_max_size, std::size_t thread_nums);
+    // max number of messages waiting in each lane, in batches
+    static constexpr std::size_t lane_batches = 8;
+
+    // a lane rebalance is considered after this many dispatched messages
+    static constexpr std::uint64_t rebalance_interval = 4096;
+
+    // with async_queue_type::per_thread, q_max_size is the size of each producer thread's queue.
+    // with async_queue_type::byte_ring, q_max_size is in bytes.
+    // with a lane policy other than shared and more than one thread, thread_nums
+    // workers each own a lane, and one more thread dispatches the queue to them.
+    thread_pool(std::size_t q_max_size, std::size_t thread_nums, async_queue_type queue_type = async_queue_type::blocking,
+        std::size_t batch_size = default_batch_size, async_wait_strategy wait_strategy = async_wait_strategy::park,
+        async_lane_policy lane_policy = async_lane_policy::shared);
+
+    // throw if a thread could not be set up as asked. no thread is left running then.
+    thread_pool(std::size_t q_max_size, std::size_t thread_nums, const thread_pool_options& options);
     ~thread_pool();
 
     thread_pool(const thread_pool&) = delete;
@@ -24,26 +70,227 @@ public:
     thread_pool(thread_pool&&) = delete;
     thread_pool& operator=(thread_pool&&) = delete;
 
-    void post_log(async_logger_ptr &&worker_ptr, const log_msg& msg, async_overflow_policy overflow_policy);
-    void post_flush(async_logger_ptr &&worker_ptr, async_overflow_policy overflow_policy);
+    // async loggers register themselves on construction. queued messages refer
+    // to the logger by the returned handle instead of holding a reference to it.
+    logger_handle register_logger(async_logger* logger);
+
+    // wait until the workers are done with all messages posted so far for the
+    // logger, then recycle its handle. called by the async logger's destructor.
+    // on a worker thread, skip the logger's queued messages and retire the
+    // handle instead of waiting.
+    void unregister_logger(logger_handle handle);
+
+    // drop the reference tp. a pool thread can't join itself, so on one of the
+    // pool's own threads the reference is dropped by a new detached thread, in
+    // case it is the last one. called by the async logger's destructor.
+    static void release(std::shared_ptr<thread_pool> tp);
+
+    // with format_fn, msg.payload holds deferred arguments formatted by the worker.
+    // return false if the message was discarded (async_overflow_policy::discard_new).
+    bool post_log(logger_handle handle, const log_msg& msg, async_overflow_policy overflow_policy,
+        deferred_format_fn format_fn = nullptr);
+    void post_flush(logger_handle handle, async_overflow_policy overflow_policy);
+
+    // like post_flush(), but the future is ready once the workers processed every
+    // message posted before for the logger and then flushed its sinks.
+    // the flush messages are posted with the block policy, whatever the logger's.
+    // if a non-blocking producer overruns one of them the future never gets ready.
+    std::future<void> post_flush_barrier(logger_handle handle);
+
+    // post_flush_barrier() and wait at most timeout, recovering overrun flush messages.
+    // return false on timeout.
+    bool flush_for(logger_handle handle, std::chrono::milliseconds timeout);
+
+    // what shutdown() did
+    struct shutdown_stats
+    {
+        bool drained{ true };           // every accepted message was written before the deadline
+        std::size_t dropped{ 0 };       // accepted messages discarded by the shutdown
+        std::size_t rejected{ 0 };      // log messages refused once the shutdown began
+    };
+
+    // stop accepting messages, keep writing the queued ones until the timeout
+    // and discard the rest, stop the threads, then flush the sinks of every logger.
+    // a sink stuck in a write still delays it. later calls return the same stats,
+    // with rejected brought up to date.
+    shutdown_stats shutdown(std::chrono::milliseconds timeout);
+
+    // default clock source of the async loggers created for this pool
+    log_clock_source clock_source() const;
+    // whether the workers convert tsc ticks of queued messages. not with
+    // async_queue_type::per_thread, which merges messages by their time.
+    bool converts_tsc() const;
 
     std::size_t overrun_counter();
     std::size_t queue_size();
+    // a lock-free and possibly stale check, see async_queue::full()
+    bool queue_full();
+
+    // byte usage of a byte-budgeted queue (async_queue_type::byte_ring).
+    // other queue types preallocate their slots and report 0.
+    std::size_t queue_bytes();
+    std::size_t peak_queue_bytes();
+    std::size_t queue_capacity_bytes();
 
 private:
-    void post_async_msg_(async_msg&&, async_overflow_policy);
-    void worker_loop_();
-    
-    // process next message in the queue
+    static std::unique_ptr<async_queue<async_msg>> make_queue_(async_queue_type queue_type, std::size_t q_max_size,
+        async_wait_strategy wait_strategy);
+    bool post_async_msg_(async_msg&&, async_overflow_policy);
+
+    // start a thread applying the options, then running loop once every
+    // thread started. the constructor reports a failed setup through ready.
+    void start_thread_(const thread_pool_options& options, std::function<void()> loop, std::promise<void> ready,
+        std::shared_future<bool> go);
+    void worker_loop_(std::size_t worker_index);
+
+    // process count messages of batch, taken from the queue or from own_lane.
+    // messages meant for the other workers are added to pending, see repost_pending_().
     // return true if this thread should still be active (while no terminate msg
-    // was received)
-    bool process_next_msg_();
+    // was received, active tells if one was received before)
+    struct lane;
+    bool process_batch_(std::size_t worker_index, lane* own_lane, std::vector<async_msg>& batch, std::size_t count,
+        std::vector<memory_buf_t>& formatted, std::vector<const log_msg*>& run, std::vector<async_msg>& pending,
+        bool active = true);
+    // pass pending messages back to the queue, as many as it has room for.
+    // workers never block on the queue: it may be full with only them to drain it.
+    void repost_pending_(std::vector<async_msg>& pending);
+
+    // ordered lanes: the dispatcher takes the queue in order and forwards each
+    // message to the lane of its logger (or sink), each lane worker drains its own.
+    struct route
+    {
+        std::size_t lane;
+        std::uint64_t load;         // messages routed in the current rebalance window
+        std::uint64_t last_seq;     // lane position right after the last message routed
+    };
+    void dispatch_loop_();
+    void lane_loop_(std::size_t lane_index);
+    void dispatch_(async_msg&& msg);
+    void forward_(std::size_t lane_index, async_msg&& msg);
+    // wait for the dispatcher to forward a message to the lane
+    void park_lane_(lane& own_lane);
+    // async_lane_policy::per_sink: the loggers sharing sinks, directly or through
+    // other loggers, are one key, the root of a union-find over their sinks
+    struct sink_group
+    {
+        const async_logger* logger{ nullptr };
+        const std::vector<const void*>* sinks{ nullptr };   // the logger's sinks when key was found
+        std::uint64_t epoch{ 0 };   // sink_groups_epoch_ when key was found
+        const void* key{ nullptr };
+    };
+    const void* sink_group_key_(logger_handle handle, const async_logger* logger);
+    const void* find_sink_root_(const void* sink);
+    // the group of root b joins that of root a, and so does b's route
+    void merge_sink_groups_(const void* a, const void* b);
+    route& route_for_(const void* key);
+    // move the busiest key that evens out the hottest and the coldest lanes
+    void rebalance_();
+    // later messages of the key may be processed only after the old lane
+    // caught up with its earlier ones, so a fence is queued in the new lane
+    void move_route_(route& r, std::size_t to);
+    // a lane worker reached a fence. processed: position of the fence in the lane
+    void wait_fence_(lane& own_lane, std::uint64_t processed, const async_msg& fence);
+    std::size_t barrier_arrivals_() const;
+
+    // format a deferred message into dest and point its payload there.
+    // return false if the message has to be dropped
+    bool format_deferred_(async_msg& msg, memory_buf_t& dest);
+
+    // post one release or flush message per worker, sharing a new barrier
+    std::future<void> post_barrier_(logger_handle handle, async_msg_type msg_type, std::shared_ptr<async_barrier>& barrier);
+    // return false if the deadline passed first
+    bool wait_barrier_(logger_handle handle, async_msg_type msg_type, const std::shared_ptr<async_barrier>& barrier,
+        std::future<void>& done, std::chrono::steady_clock::time_point deadline);
+
+    // a worker reached a release or flush message with a barrier
+    void arrive_barrier_(std::size_t worker_index, async_msg& msg, std::vector<async_msg>& pending);
+    // every earlier message of the logger is done: release it or flush its sinks
+    void barrier_done_(logger_handle handle, async_msg_type msg_type, async_barrier& barrier);
+    // complete a barrier the stopped threads will never reach
+    void complete_barrier_(logger_handle handle, async_msg_type msg_type, async_barrier& barrier);
+
+    // post the terminate messages, join the threads and discard what is left
+    void stop_();
+    void discard_queued_();
+
+    std::atomic<async_logger*>& slot_(logger_handle handle) const;
+    async_logger* resolve_(logger_handle handle) const;
+    void free_handle_(logger_handle handle);
+    bool on_worker_thread_() const;
+
+    // hand a run of consecutive log messages of one logger to its sinks
+    void sink_run_(async_logger* logger, std::vector<const log_msg*>& run);
     
 private:
-    mpmc_blocking_queue<async_msg> q_;
+    std::unique_ptr<async_queue<async_msg>> q_;
+    byte_ring_queue* byte_ring_{ nullptr };     // q_, if log messages can be copied into it directly
+    std::size_t batch_size_;
+    async_wait_strategy wait_strategy_;
+    log_clock_source clock_source_;
+    bool converts_tsc_;
     std::vector<std::thread> threads_;
+
+    // ordered lanes, empty with async_lane_policy::shared.
+    // the rest is only touched by the dispatcher thread.
+    std::vector<std::unique_ptr<lane>> lanes_;
+    async_lane_policy lane_policy_;
+    std::unordered_map<const void*, route> routes_;     // by logger or sink group
+    std::vector<std::uint64_t> lane_loads_;
+    std::uint64_t dispatched_{ 0 };
+    std::unordered_map<const void*, const void*> sink_parents_;
+    std::vector<sink_group> sink_groups_;               // by handle
+    std::uint64_t sink_groups_epoch_{ 0 };              // changes with every merge
+
+    // shutdown
+    static constexpr std::chrono::steady_clock::rep no_deadline = std::numeric_limits<std::chrono::steady_clock::rep>::max();
+    std::atomic<bool> accepting_{ true };
+    std::atomic<bool> stopped_{ false };                                // the threads are joined
+    std::atomic<std::chrono::steady_clock::rep> deadline_{ no_deadline }; // log messages are discarded after it
+    std::atomic<std::size_t> shutdown_dropped_{ 0 };
+    std::atomic<std::size_t> rejected_{ 0 };
+    std::mutex shutdown_mutex_;
+    shutdown_stats stats_;
+
+    // logger table indexed by handle. chunks never move once allocated, and the
+    // slots are atomic, so the workers read them without locking: a spare message
+    // may still carry a handle that was freed, or already reused by another logger.
+    static constexpr std::size_t handles_per_chunk = 256;
+    static constexpr std::size_t max_handle_chunks = 1024;
+    std::unique_ptr<std::atomic<async_logger*>[]> handle_chunks_[max_handle_chunks];
+    std::mutex handles_mutex_;                  // guards the writers of the table
+    std::vector<logger_handle> free_handles_;
+    std::size_t next_handle_{ 0 };
+};
+
+
+// Optional settings of a thread pool. defaults match the positional constructor.
+// Threads are numbered in start order: the workers, or with lanes the
+// dispatcher first and then one thread per lane.
+struct thread_pool_options
+{
+    async_queue_type queue_type = async_queue_type::blocking;
+    std::size_t batch_size = thread_pool::default_batch_size;
+    async_wait_strategy wait_strategy = async_wait_strategy::park;
+    async_lane_policy lane_policy = async_lane_policy::shared;
+
+    // taken by the async loggers created for the pool, see async_logger::set_clock_source.
+    // with log_clock_source::tsc the pool constructor calibrates the tsc, and
+    // throws with async_queue_type::per_thread, see converts_tsc().
+    log_clock_source clock_source = log_clock_source::system;
+
+    // thread i may only run on thread_cpus[i % thread_cpus.size()]. empty: no pinning
+    std::vector<std::vector<int>> thread_cpus;
+
+    // threads are named "<thread_name>-<i>", cut to 15 characters. empty: unnamed
+    std::string thread_name;
+
+    thread_sched_policy sched_policy = thread_sched_policy::normal;
+    int nice = 0;   // 0: inherited
+
+    // called on each thread before and after it processes messages
+    std::function<void()> on_thread_start;
+    std::function<void()> on_thread_stop;
 };
 
-    
 } // namespace details
 } // namespace mylog
\ No newline at end of file
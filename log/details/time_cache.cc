@@ -0,0 +1,119 @@
+#include "log/details/time_cache.h"
+#include "log/details/os.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+namespace mylog {
+namespace details {
+
+namespace {
+
+static_assert(std::is_trivially_copyable<cached_time>::value, "cached_time is copied as words");
+
+void render(std::chrono::seconds secs, cached_time& out, pattern_time_type time_type)
+{
+    auto time = static_cast<std::time_t>(secs.count());
+    out.secs = secs;
+    out.tm_time = time_type == pattern_time_type::utc ? os::gmtime(time) : os::localtime(time);
+    auto& tm = out.tm_time;
+    auto result = fmt::format_to_n(out.date_time, sizeof(out.date_time), "{}-{:02}-{:02} {:02}-{:02}-{:02}", tm.tm_year + 1900,
+        tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+    out.date_time_size = result.size < sizeof(out.date_time) ? result.size : sizeof(out.date_time);
+}
+
+// the latest second, stored as atomic words and published with a sequence
+// lock: readers retry while seq is odd or changed under them
+class latest_second
+{
+public:
+    latest_second()
+    {
+        cached_time empty;
+        std::memset(&empty.tm_time, 0, sizeof(empty.tm_time));
+        std::memset(empty.date_time, 0, sizeof(empty.date_time));
+        store_(empty);
+    }
+
+    void get(std::chrono::seconds secs, cached_time& out, pattern_time_type time_type)
+    {
+        if (load_(out) && out.secs == secs)
+        {
+            return;
+        }
+
+        render(secs, out, time_type);
+        std::unique_lock<std::mutex> lock(publish_mutex_, std::try_to_lock);
+        // only move forward. someone else publishing has the same or a newer second
+        if (lock.owns_lock() && secs > latest_secs_)
+        {
+            latest_secs_ = secs;
+            auto seq = seq_.load(std::memory_order_relaxed);
+            seq_.store(seq + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            store_(out);
+            seq_.store(seq + 2, std::memory_order_release);
+        }
+    }
+
+private:
+    static constexpr std::size_t word_count = (sizeof(cached_time) + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t);
+
+    void store_(const cached_time& time)
+    {
+        std::uint64_t words[word_count] = {};
+        std::memcpy(words, &time, sizeof(time));
+        for (std::size_t i = 0; i < word_count; i++)
+        {
+            words_[i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    // false if a writer got in the way, out is then unusable
+    bool load_(cached_time& out)
+    {
+        std::uint64_t words[word_count];
+        for (int attempt = 0; attempt < 4; attempt++)
+        {
+            auto seq = seq_.load(std::memory_order_acquire);
+            for (std::size_t i = 0; i < word_count; i++)
+            {
+                words[i] = words_[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if ((seq & 1) == 0 && seq == seq_.load(std::memory_order_relaxed))
+            {
+                std::memcpy(&out, words, sizeof(out));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::atomic<std::uint32_t> seq_{ 0 };
+    std::atomic<std::uint64_t> words_[word_count];
+
+    std::mutex publish_mutex_;      // guards the writers and latest_secs_
+    std::chrono::seconds latest_secs_{ std::chrono::seconds::min() };
+};
+
+// one per pattern_time_type
+latest_second& latest(pattern_time_type time_type)
+{
+    static latest_second local;
+    static latest_second utc;
+    return time_type == pattern_time_type::utc ? utc : local;
+}
+
+} // namespace
+
+void time_cache::get(std::chrono::seconds secs, cached_time& out, pattern_time_type time_type)
+{
+    latest(time_type).get(secs, out, time_type);
+}
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <chrono>
+#include <ctime>
+
+namespace mylog {
+namespace details {
+
+// The local time of one second, rendered once for the whole process.
+struct cached_time
+{
+    std::chrono::seconds secs{ std::chrono::seconds::min() };   // since epoch
+    std::tm tm_time;
+    char date_time[40];             // "YYYY-MM-DD HH-MM-SS", as printed by %+
+    std::size_t date_time_size{ 0 };
+
+    string_view_t date_time_view() const
+    {
+        return string_view_t(date_time, date_time_size);
+    }
+};
+
+// Process-wide cache of the latest second, shared by all formatters so that
+// the time zone conversion runs once per second instead of once per second
+// per formatter.
+// Readers copy it under a sequence lock without blocking. Older seconds (queued
+// messages) are computed by the caller and not cached.
+class time_cache
+{
+public:
+    // the local or UTC time of secs
+    static void get(std::chrono::seconds secs, cached_time& out, pattern_time_type time_type = pattern_time_type::local);
+};
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,586 @@
+#include "log/details/time_zone.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace mylog {
+namespace details {
+
+namespace {
+
+constexpr std::int64_t seconds_per_day = 86400;
+
+std::int64_t floor_div(std::int64_t a, std::int64_t b)
+{
+    return a / b - ((a % b != 0 && (a < 0) != (b < 0)) ? 1 : 0);
+}
+
+// days since 1970-01-01 of a proleptic Gregorian date, month 1-12
+std::int64_t days_from_civil(std::int64_t y, int m, int d)
+{
+    y -= m <= 2 ? 1 : 0;
+    auto era = floor_div(y, 400);
+    auto yoe = y - era * 400;
+    auto doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    auto doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+bool is_leap(std::int64_t y)
+{
+    return y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+}
+
+int days_in_month(std::int64_t y, int m)
+{
+    static const int days[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    return m == 2 && is_leap(y) ? 29 : days[m - 1];
+}
+
+// 0 = Sunday. 1970-01-01 was a Thursday
+int weekday(std::int64_t days)
+{
+    auto day = (days + 4) % 7;
+    return static_cast<int>(day < 0 ? day + 7 : day);
+}
+
+std::int64_t year_of(std::int64_t time)
+{
+    auto days = floor_div(time, seconds_per_day);
+    // civil_from_days, only the year
+    auto z = days + 719468;
+    auto era = floor_div(z, 146097);
+    auto doe = z - era * 146097;
+    auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    auto mp = (5 * doy + 2) / 153;
+    return yoe + era * 400 + (mp >= 10 ? 1 : 0);
+}
+
+std::string zoneinfo_dir()
+{
+    const char* dir = std::getenv("TZDIR");
+    return dir != nullptr && *dir != '\0' ? dir : "/usr/share/zoneinfo";
+}
+
+bool read_file(const std::string& path, std::string& data)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        return false;
+    }
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    return !in.bad();
+}
+
+// big-endian reads with bounds checks, for TZif files
+class tzif_reader
+{
+public:
+    explicit tzif_reader(const std::string& data)
+        : data_(data)
+    {}
+
+    bool has(std::size_t n) const
+    {
+        return pos_ <= data_.size() && n <= data_.size() - pos_;
+    }
+
+    std::int64_t read_int(std::size_t size)
+    {
+        std::uint64_t value = 0;
+        for (std::size_t i = 0; i < size; i++)
+        {
+            value = (value << 8) | static_cast<unsigned char>(data_[pos_ + i]);
+        }
+        pos_ += size;
+        // sign extend
+        auto shift = 64 - 8 * size;
+        return static_cast<std::int64_t>(value << shift) >> shift;
+    }
+
+    unsigned char read_byte()
+    {
+        return static_cast<unsigned char>(data_[pos_++]);
+    }
+
+    void skip(std::size_t n)
+    {
+        pos_ += n;
+    }
+
+    std::size_t pos() const
+    {
+        return pos_;
+    }
+
+private:
+    const std::string& data_;
+    std::size_t pos_{ 0 };
+};
+
+struct tzif_counts
+{
+    std::size_t isut, isstd, leap, time, type, chars;
+};
+
+bool read_header(tzif_reader& in, const std::string& data, char& version, tzif_counts& counts)
+{
+    if (!in.has(44) || data.compare(in.pos(), 4, "TZif") != 0)
+    {
+        return false;
+    }
+    in.skip(4);
+    version = static_cast<char>(in.read_byte());
+    in.skip(15);
+    counts.isut = static_cast<std::size_t>(in.read_int(4));
+    counts.isstd = static_cast<std::size_t>(in.read_int(4));
+    counts.leap = static_cast<std::size_t>(in.read_int(4));
+    counts.time = static_cast<std::size_t>(in.read_int(4));
+    counts.type = static_cast<std::size_t>(in.read_int(4));
+    counts.chars = static_cast<std::size_t>(in.read_int(4));
+    return true;
+}
+
+// POSIX TZ string pieces
+bool parse_abbr(const char*& p, std::string& abbr)
+{
+    const char* begin = p;
+    if (*p == '<')
+    {
+        begin = ++p;
+        while (*p != '\0' && *p != '>')
+        {
+            ++p;
+        }
+        if (*p != '>')
+        {
+            return false;
+        }
+        abbr.assign(begin, p++);
+    }
+    else
+    {
+        while ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))
+        {
+            ++p;
+        }
+        abbr.assign(begin, p);
+    }
+    return abbr.size() >= 3;
+}
+
+bool parse_number(const char*& p, int max, int& value)
+{
+    if (*p < '0' || *p > '9')
+    {
+        return false;
+    }
+    value = 0;
+    while (*p >= '0' && *p <= '9')
+    {
+        value = value * 10 + (*p++ - '0');
+        if (value > max)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// [+-]hh[:mm[:ss]] in seconds. rule times may go up to 167 hours
+bool parse_hms(const char*& p, int max_hours, std::int32_t& seconds)
+{
+    int sign = 1;
+    if (*p == '+' || *p == '-')
+    {
+        sign = *p++ == '-' ? -1 : 1;
+    }
+    int hours, minutes = 0, secs = 0;
+    if (!parse_number(p, max_hours, hours))
+    {
+        return false;
+    }
+    if (*p == ':')
+    {
+        if (!parse_number(++p, 59, minutes))
+        {
+            return false;
+        }
+        if (*p == ':' && !parse_number(++p, 60, secs))
+        {
+            return false;
+        }
+    }
+    seconds = sign * (hours * 3600 + minutes * 60 + secs);
+    return true;
+}
+
+} // namespace
+
+const time_zone& time_zone::local()
+{
+    static const std::unique_ptr<time_zone> zone = [] {
+        const char* tz = std::getenv("TZ");
+        std::unique_ptr<time_zone> loaded;
+        if (tz == nullptr)
+        {
+            loaded = load("/etc/localtime");
+        }
+        else
+        {
+            std::string name = *tz == ':' ? tz + 1 : tz;
+            // glibc treats an empty TZ as UTC
+            loaded = load(name.empty() ? "UTC" : name);
+            if (!loaded)
+            {
+                // TZ may hold a rule itself, like "EST5EDT"
+                loaded.reset(new time_zone());
+                if (!loaded->parse_rule_(name))
+                {
+                    loaded.reset();
+                }
+            }
+        }
+        if (!loaded)
+        {
+            loaded.reset(new time_zone());
+            loaded->use_libc_ = true;
+        }
+        return loaded;
+    }();
+    return *zone;
+}
+
+std::unique_ptr<time_zone> time_zone::load(const std::string& name)
+{
+    if (name.empty() || name.find("..") != std::string::npos)
+    {
+        return nullptr;
+    }
+    std::string data;
+    if (!read_file(name[0] == '/' ? name : zoneinfo_dir() + '/' + name, data))
+    {
+        return nullptr;
+    }
+    std::unique_ptr<time_zone> zone(new time_zone());
+    if (!zone->parse_tzif_(data))
+    {
+        return nullptr;
+    }
+    return zone;
+}
+
+std::tm time_zone::to_tm(std::time_t time) const
+{
+    if (use_libc_)
+    {
+        std::tm tm;
+        ::localtime_r(&time, &tm);
+        return tm;
+    }
+
+    auto t = static_cast<std::int64_t>(time);
+    auto& type = type_at_(t);
+    auto tm = utc_tm(static_cast<std::time_t>(t + type.utc_offset));
+    tm.tm_isdst = type.is_dst ? 1 : 0;
+    tm.tm_gmtoff = type.utc_offset;
+    tm.tm_zone = abbrs_.c_str() + type.abbr_index;
+    return tm;
+}
+
+std::time_t time_zone::to_time_t(const std::tm& tm) const
+{
+    if (use_libc_)
+    {
+        auto copy = tm;
+        return std::mktime(&copy);
+    }
+
+    auto year = tm.tm_year + 1900 + floor_div(tm.tm_mon, 12);
+    auto month = static_cast<int>(tm.tm_mon - floor_div(tm.tm_mon, 12) * 12) + 1;
+    auto local = (days_from_civil(year, month, 1) + tm.tm_mday - 1) * seconds_per_day + tm.tm_hour * 3600 + tm.tm_min * 60 +
+                 tm.tm_sec;
+
+    // changes are far more than a day apart: the local time has the offset in
+    // effect a day before or the one a day after, or falls between them
+    auto& before = type_at_(local - seconds_per_day);
+    auto& after = type_at_(local + seconds_per_day);
+    auto at_before = local - before.utc_offset;
+    auto at_after = local - after.utc_offset;
+    bool before_fits = type_at_(at_before).utc_offset == before.utc_offset;
+    bool after_fits = type_at_(at_after).utc_offset == after.utc_offset;
+    if (before_fits && after_fits && tm.tm_isdst >= 0)
+    {
+        // repeated: pick by tm_isdst
+        return static_cast<std::time_t>(after.is_dst == (tm.tm_isdst > 0) ? at_after : at_before);
+    }
+    if (!before_fits && after_fits)
+    {
+        return static_cast<std::time_t>(at_after);
+    }
+    // skipped: at_before is as far past the change as the time was into the gap
+    return static_cast<std::time_t>(at_before);
+}
+
+std::tm time_zone::utc_tm(std::time_t time)
+{
+    auto t = static_cast<std::int64_t>(time);
+    auto days = floor_div(t, seconds_per_day);
+    auto secs = t - days * seconds_per_day;
+
+    // civil_from_days
+    auto z = days + 719468;
+    auto era = floor_div(z, 146097);
+    auto doe = z - era * 146097;
+    auto yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    auto doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    auto mp = (5 * doy + 2) / 153;
+    auto day = doy - (153 * mp + 2) / 5 + 1;
+    auto month = mp < 10 ? mp + 3 : mp - 9;
+    auto year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+    std::tm tm{};
+    tm.tm_year = static_cast<int>(year - 1900);
+    tm.tm_mon = static_cast<int>(month - 1);
+    tm.tm_mday = static_cast<int>(day);
+    tm.tm_hour = static_cast<int>(secs / 3600);
+    tm.tm_min = static_cast<int>(secs / 60 % 60);
+    tm.tm_sec = static_cast<int>(secs % 60);
+    tm.tm_wday = weekday(days);
+    tm.tm_yday = static_cast<int>(days - days_from_civil(year, 1, 1));
+    tm.tm_isdst = 0;
+    tm.tm_gmtoff = 0;
+    tm.tm_zone = "UTC";
+    return tm;
+}
+
+// RFC 8536. version 1 files have 32-bit times, later ones repeat the data
+// with 64-bit times and end with a POSIX TZ rule
+bool time_zone::parse_tzif_(const std::string& data)
+{
+    tzif_reader in(data);
+    char version;
+    tzif_counts counts;
+    if (!read_header(in, data, version, counts))
+    {
+        return false;
+    }
+
+    std::size_t time_size = 4;
+    if (version >= '2')
+    {
+        in.skip(counts.time * 5 + counts.type * 6 + counts.chars + counts.leap * 8 + counts.isstd + counts.isut);
+        if (!read_header(in, data, version, counts))
+        {
+            return false;
+        }
+        time_size = 8;
+    }
+
+    // leap second corrections are not applied, localtime_r does that
+    if (counts.leap != 0 || counts.type == 0 || counts.type > 256 ||
+        !in.has(counts.time * (time_size + 1) + counts.type * 6 + counts.chars))
+    {
+        return false;
+    }
+
+    transitions_.resize(counts.time);
+    for (auto& transition : transitions_)
+    {
+        transition = in.read_int(time_size);
+    }
+    transition_types_.resize(counts.time);
+    for (auto& type : transition_types_)
+    {
+        type = in.read_byte();
+        if (type >= counts.type)
+        {
+            return false;
+        }
+    }
+    types_.resize(counts.type);
+    for (auto& type : types_)
+    {
+        type.utc_offset = static_cast<std::int32_t>(in.read_int(4));
+        type.is_dst = in.read_byte() != 0;
+        type.abbr_index = in.read_byte();
+        if (type.abbr_index >= counts.chars)
+        {
+            return false;
+        }
+    }
+    abbrs_.assign(data, in.pos(), counts.chars);
+    abbrs_.push_back('\0');
+    in.skip(counts.chars + counts.leap * (time_size + 4) + counts.isstd + counts.isut);
+
+    if (time_size == 8 && in.has(2) && in.read_byte() == '\n')
+    {
+        auto begin = in.pos();
+        auto end = data.find('\n', begin);
+        if (end != std::string::npos && end > begin && !parse_rule_(data.substr(begin, end - begin)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// std offset [dst [offset] [,start[/time],end[/time]]]
+bool time_zone::parse_rule_(const std::string& text)
+{
+    const char* p = text.c_str();
+    posix_rule rule{};
+    std::string std_abbr, dst_abbr;
+    std::int32_t offset;
+    if (!parse_abbr(p, std_abbr) || !parse_hms(p, 24, offset))
+    {
+        return false;
+    }
+    // POSIX offsets are west of UTC
+    rule.std_type.utc_offset = -offset;
+    rule.has_dst = *p != '\0';
+
+    if (rule.has_dst)
+    {
+        if (!parse_abbr(p, dst_abbr))
+        {
+            return false;
+        }
+        rule.dst_type.utc_offset = rule.std_type.utc_offset + 3600;
+        if (*p != ',' && *p != '\0')
+        {
+            if (!parse_hms(p, 24, offset))
+            {
+                return false;
+            }
+            rule.dst_type.utc_offset = -offset;
+        }
+        rule.dst_type.is_dst = true;
+
+        // US rules without dates
+        rule.start = {'M', 0, 2, 3, 7200};
+        rule.end = {'M', 0, 1, 11, 7200};
+        for (auto* date : {&rule.start, &rule.end})
+        {
+            if (*p == '\0' && date == &rule.start)
+            {
+                break;
+            }
+            if (*p++ != ',')
+            {
+                return false;
+            }
+            if (*p == 'M')
+            {
+                date->kind = 'M';
+                if (!parse_number(++p, 12, date->month) || date->month < 1 || *p++ != '.' || !parse_number(p, 5, date->week) ||
+                    date->week < 1 || *p++ != '.' || !parse_number(p, 6, date->day))
+                {
+                    return false;
+                }
+            }
+            else if (*p == 'J')
+            {
+                date->kind = 'J';
+                if (!parse_number(++p, 365, date->day) || date->day < 1)
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                date->kind = 'N';
+                if (!parse_number(p, 365, date->day))
+                {
+                    return false;
+                }
+            }
+            date->time = 7200;
+            if (*p == '/' && !parse_hms(++p, 167, date->time))
+            {
+                return false;
+            }
+        }
+    }
+    if (*p != '\0')
+    {
+        return false;
+    }
+
+    rule.std_type.abbr_index = abbrs_.size();
+    abbrs_.append(std_abbr).push_back('\0');
+    rule.dst_type.abbr_index = abbrs_.size();
+    abbrs_.append(dst_abbr).push_back('\0');
+    if (types_.empty())
+    {
+        types_.push_back(rule.std_type);
+    }
+    rule_ = rule;
+    has_rule_ = true;
+    return true;
+}
+
+const time_zone::local_type& time_zone::type_at_(std::int64_t time) const
+{
+    if (has_rule_ && (transitions_.empty() || time >= transitions_.back()))
+    {
+        return rule_type_(time);
+    }
+    if (transitions_.empty() || time < transitions_.front())
+    {
+        return types_[0];
+    }
+    auto it = std::upper_bound(transitions_.begin(), transitions_.end(), time);
+    return types_[transition_types_[static_cast<std::size_t>(it - transitions_.begin()) - 1]];
+}
+
+const time_zone::local_type& time_zone::rule_type_(std::int64_t time) const
+{
+    if (!rule_.has_dst)
+    {
+        return rule_.std_type;
+    }
+    // the changes of the year around time, in UTC
+    auto year = year_of(time + rule_.std_type.utc_offset);
+    auto start = rule_change_(rule_.start, year, rule_.std_type.utc_offset);
+    auto end = rule_change_(rule_.end, year, rule_.dst_type.utc_offset);
+    bool dst = start < end ? start <= time && time < end : !(end <= time && time < start);
+    return dst ? rule_.dst_type : rule_.std_type;
+}
+
+// UTC time of a change given in local time with utc_offset
+std::int64_t time_zone::rule_change_(const rule_date& date, std::int64_t year, std::int32_t utc_offset) const
+{
+    std::int64_t days;
+    switch (date.kind)
+    {
+    case 'J':   // Feb 29 is never counted
+        days = days_from_civil(year, 1, 1) + date.day - 1 + (is_leap(year) && date.day >= 60 ? 1 : 0);
+        break;
+
+    case 'N':
+        days = days_from_civil(year, 1, 1) + date.day;
+        break;
+
+    default:    // day of the week-th week, week 5 being the last
+    {
+        auto first = days_from_civil(year, date.month, 1);
+        auto day = (date.day - weekday(first) + 7) % 7 + (date.week - 1) * 7;
+        while (day >= days_in_month(year, date.month))
+        {
+            day -= 7;
+        }
+        days = first + day;
+        break;
+    }
+    }
+    return days * seconds_per_day + date.time - utc_offset;
+}
+
+} // namespace details
+} // namespace mylog
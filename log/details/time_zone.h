@@ -0,0 +1,87 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mylog {
+namespace details {
+
+// Epoch seconds to broken-down local time from the zone's TZif file in
+// /usr/share/zoneinfo (or $TZDIR), loaded once. Unlike localtime_r there is
+// no lock and no TZ check per call. Times past the last transition of the
+// file follow its POSIX TZ footer, e.g. "CET-1CEST,M3.5.0,M10.5.0/3".
+class time_zone
+{
+public:
+    // the zone of $TZ, or /etc/localtime without it. Read on first use, later
+    // changes of TZ are not seen. Zones that can't be loaded, and zones with
+    // leap seconds ("right/..."), are left to localtime_r.
+    static const time_zone& local();
+
+    // name relative to the zoneinfo directory ("Europe/Berlin") or an absolute path.
+    // nullptr if there is no such zone.
+    static std::unique_ptr<time_zone> load(const std::string& name);
+
+    std::tm to_tm(std::time_t time) const;
+
+    // the inverse of to_tm, like mktime: fields out of range are normalized. a
+    // local time repeated by a change is taken in DST if tm_isdst > 0, else in
+    // standard time (the earlier one if tm_isdst < 0); a skipped one is moved
+    // past the change.
+    std::time_t to_time_t(const std::tm& tm) const;
+
+    // broken-down UTC time, plain arithmetic
+    static std::tm utc_tm(std::time_t time);
+
+private:
+    struct local_type
+    {
+        std::int32_t utc_offset;    // seconds east of UTC
+        bool is_dst;
+        std::size_t abbr_index;     // into abbrs_
+    };
+
+    // day of a POSIX TZ rule: Jn (1-365, no Feb 29), n (0-365) or Mm.w.d
+    struct rule_date
+    {
+        char kind;          // 'J', 'N' or 'M'
+        int day;            // Jn, n, or the weekday of Mm.w.d (0 = Sunday)
+        int week;
+        int month;
+        std::int32_t time;  // local time of the change, seconds
+    };
+
+    struct posix_rule
+    {
+        local_type std_type;
+        local_type dst_type;
+        bool has_dst;
+        rule_date start;
+        rule_date end;
+    };
+
+    time_zone() = default;
+
+    bool parse_tzif_(const std::string& data);
+    bool parse_rule_(const std::string& text);
+    const local_type& type_at_(std::int64_t time) const;
+    const local_type& rule_type_(std::int64_t time) const;
+    std::int64_t rule_change_(const rule_date& date, std::int64_t year, std::int32_t utc_offset) const;
+
+private:
+    std::vector<std::int64_t> transitions_;         // sorted epoch seconds
+    std::vector<std::uint8_t> transition_types_;    // index into types_ from each transition
+    std::vector<local_type> types_;
+    std::string abbrs_;                             // NUL separated abbreviations
+    bool has_rule_{ false };
+    posix_rule rule_{};
+    bool use_libc_{ false };
+};
+
+} // namespace details
+} // namespace mylog
@@ -0,0 +1,151 @@
+#include "log/details/tsc_clock.h"
+
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+namespace mylog {
+namespace details {
+
+constexpr std::chrono::milliseconds tsc_clock::recalibrate_interval;
+
+namespace {
+
+struct tsc_sample
+{
+    std::uint64_t ticks;
+    std::int64_t ns;    // log_clock time since epoch
+};
+
+// log_clock time and the tsc read around it
+tsc_sample take_sample()
+{
+    auto before = tsc_clock::ticks();
+    auto now = log_clock::now();
+    auto after = tsc_clock::ticks();
+    return {before + (after - before) / 2, std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count()};
+}
+
+// ticks -> ns mapping, published with a sequence lock: readers retry while
+// seq is odd or changed under them
+class tsc_mapping
+{
+public:
+    tsc_mapping()
+    {
+        // the first rate is measured over a short wait
+        auto first = take_sample();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        publish_(first, take_sample());
+    }
+
+    std::int64_t to_ns(std::uint64_t ticks)
+    {
+        if (ticks >= next_calibration_.load(std::memory_order_relaxed))
+        {
+            recalibrate_();
+        }
+
+        std::uint32_t seq;
+        std::uint64_t base_ticks;
+        std::int64_t base_ns;
+        double ns_per_tick;
+        do
+        {
+            seq = seq_.load(std::memory_order_acquire);
+            base_ticks = base_ticks_.load(std::memory_order_relaxed);
+            base_ns = base_ns_.load(std::memory_order_relaxed);
+            ns_per_tick = ns_per_tick_.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) != 0 || seq != seq_.load(std::memory_order_relaxed));
+
+        // ticks may be older than the base, for messages queued before a recalibration
+        auto delta = static_cast<double>(static_cast<std::int64_t>(ticks - base_ticks));
+        return base_ns + std::llround(delta * ns_per_tick);
+    }
+
+private:
+    void recalibrate_()
+    {
+        std::unique_lock<std::mutex> lock(calibrate_mutex_, std::try_to_lock);
+        if (!lock.owns_lock())
+        {
+            // someone else is at it, the current mapping is still good
+            return;
+        }
+        auto sample = take_sample();
+        if (sample.ticks < next_calibration_.load(std::memory_order_relaxed))
+        {
+            return;
+        }
+        publish_(last_, sample);
+    }
+
+    // the rate is measured between two samples, the newer one becomes the base
+    void publish_(tsc_sample from, tsc_sample to)
+    {
+        auto ns_per_tick = static_cast<double>(to.ns - from.ns) / static_cast<double>(to.ticks - from.ticks);
+        auto seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        base_ticks_.store(to.ticks, std::memory_order_relaxed);
+        base_ns_.store(to.ns, std::memory_order_relaxed);
+        ns_per_tick_.store(ns_per_tick, std::memory_order_relaxed);
+        seq_.store(seq + 2, std::memory_order_release);
+
+        auto interval_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tsc_clock::recalibrate_interval).count();
+        next_calibration_.store(to.ticks + static_cast<std::uint64_t>(static_cast<double>(interval_ns) / ns_per_tick),
+            std::memory_order_relaxed);
+        last_ = to;
+    }
+
+    std::atomic<std::uint32_t> seq_{ 0 };
+    std::atomic<std::uint64_t> base_ticks_{ 0 };
+    std::atomic<std::int64_t> base_ns_{ 0 };
+    std::atomic<double> ns_per_tick_{ 0 };
+    std::atomic<std::uint64_t> next_calibration_{ 0 };
+
+    std::mutex calibrate_mutex_;    // guards the writers and last_
+    tsc_sample last_{};
+};
+
+tsc_mapping& mapping()
+{
+    static tsc_mapping instance;
+    return instance;
+}
+
+} // namespace
+
+bool tsc_clock::available()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static const bool invariant = [] {
+        unsigned eax, ebx, ecx, edx;
+        // advanced power management leaf, edx bit 8: invariant tsc
+        return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) != 0 && (edx & (1u << 8)) != 0;
+    }();
+    return invariant;
+#else
+    return false;
+#endif
+}
+
+void tsc_clock::calibrate()
+{
+    mapping();
+}
+
+log_clock::time_point tsc_clock::to_time_point(std::uint64_t ticks)
+{
+    std::chrono::nanoseconds ns(mapping().to_ns(ticks));
+    return log_clock::time_point(std::chrono::duration_cast<log_clock::duration>(ns));
+}
+
+} // namespace details
+} // namespace mylog
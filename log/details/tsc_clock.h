@@ -0,0 +1,47 @@
+#pragma once
+
+#include "log/common.h"
+
+#include <cstdint>
+
+namespace mylog {
+namespace details {
+
+// Timestamps from the cpu's time stamp counter. Reading it costs a few cycles,
+// converting ticks to wall-clock time is left to whoever needs the time (the
+// async backend). The mapping is measured against log_clock and measured again
+// once it is older than recalibrate_interval, so it follows clock adjustments;
+// times may step by a few microseconds when that happens.
+// The first measurement waits 10ms. calibrate() does it up front; thread pools
+// and loggers set to log_clock_source::tsc call it, so no log call pays for it.
+class tsc_clock
+{
+public:
+    static constexpr std::chrono::milliseconds recalibrate_interval{ 1000 };
+
+    // true on x86 with an invariant tsc: constant rate, in sync across cores
+    static bool available();
+
+    static std::uint64_t ticks() noexcept
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        return 0;
+#endif
+    }
+
+    // measure the first mapping now, if not done yet. blocks for about 10ms once
+    static void calibrate();
+
+    // ticks read on this machine to wall-clock time
+    static log_clock::time_point to_time_point(std::uint64_t ticks);
+
+    static log_clock::time_point now()
+    {
+        return to_time_point(ticks());
+    }
+};
+
+} // namespace details
+} // namespace mylog
@@ -4,12 +4,42 @@
 
 namespace mylog {
 
+// Finest unit of the message time a formatter prints.
+enum class time_precision
+{
+    none,
+    seconds,
+    milliseconds,
+    microseconds,
+    nanoseconds
+};
+
 class formatter
 {
 public:
     virtual ~formatter() = default;
     virtual void format(const details::log_msg& msg, memory_buf_t& dest) = 0;
     virtual std::unique_ptr<formatter> clone() const = 0;
+
+    // lets loggers pick a cheaper clock, see log_clock_source::automatic
+    virtual time_precision precision() const
+    {
+        return time_precision::nanoseconds;
+    }
+
+    // fields of log_msg the formatter prints. the others may be left empty
+    virtual msg_fields fields() const
+    {
+        return msg_field::all;
+    }
+
+    // true if other formats every message exactly like this one, so loggers
+    // can format once for sinks using either
+    virtual bool equivalent(const formatter& other) const
+    {
+        (void)other;
+        return false;
+    }
 };
 
     
@@ -1,7 +1,10 @@
 #include "log/logger.h"
 #include "log/details/log_msg.h"
+#include "log/details/os.h"
 #include "log/pattern_formatter.h"
 
+#include <algorithm>
+#include <limits>
 #include <mutex>
 
 namespace mylog {
@@ -11,7 +14,13 @@ logger::logger(const logger& other)
     , level_(other.level_.load(std::memory_order_relaxed))
     , flush_level_(other.flush_level_.load(std::memory_order_relaxed))
     , custom_err_handler_(other.custom_err_handler_)
-{}
+    , defer_formatting_(other.defer_formatting_.load(std::memory_order_relaxed))
+    , clock_source_(other.clock_source_.load(std::memory_order_relaxed))
+    , requested_clock_source_(other.requested_clock_source_.load(std::memory_order_relaxed))
+    , base_fields_(other.base_fields_)
+{
+    update_from_sinks_();
+}
 
 logger::logger(logger&& other)
     : name_(std::move(other.name_))
@@ -19,7 +28,14 @@ logger::logger(logger&& other)
     , level_(other.level_.load(std::memory_order_relaxed))
     , flush_level_(other.flush_level_.load(std::memory_order_relaxed))
     , custom_err_handler_(std::move(custom_err_handler_))
-{}
+    , defer_formatting_(other.defer_formatting_.load(std::memory_order_relaxed))
+    , clock_source_(other.clock_source_.load(std::memory_order_relaxed))
+    , requested_clock_source_(other.requested_clock_source_.load(std::memory_order_relaxed))
+    , base_fields_(other.base_fields_)
+{
+    update_from_sinks_();
+    other.update_from_sinks_();
+}
 
 logger& logger::operator=(logger other)
 {
@@ -43,6 +59,19 @@ void logger::swap(logger& other)
     other.flush_level_.store(my_level);
 
     custom_err_handler_.swap(other.custom_err_handler_);
+
+    auto other_defer = other.defer_formatting_.load();
+    other.defer_formatting_.store(defer_formatting_.exchange(other_defer));
+
+    auto other_clock = other.clock_source_.load();
+    other.clock_source_.store(clock_source_.exchange(other_clock));
+
+    other_clock = other.requested_clock_source_.load();
+    other.requested_clock_source_.store(requested_clock_source_.exchange(other_clock));
+
+    std::swap(base_fields_, other.base_fields_);
+    update_from_sinks_();
+    other.update_from_sinks_();
 }
 
 bool logger::should_log(level::level_enum lvl) const
@@ -65,11 +94,16 @@ void logger::set_formatter(std::unique_ptr<formatter> f)
             (*it)->set_formatter(f->clone());
         }
     }
+
+    if (requested_clock_source_.load(std::memory_order_relaxed) == log_clock_source::automatic)
+    {
+        resolve_clock_source_();
+    }
 }
 
-void logger::set_pattern(std::string pattern)
+void logger::set_pattern(std::string pattern, pattern_time_type time_type)
 {
-    auto new_formatter = std::make_unique<pattern_formatter>(std::move(pattern));
+    auto new_formatter = std::make_unique<pattern_formatter>(std::move(pattern), time_type);
     set_formatter(std::move(new_formatter));
 }
 
@@ -85,6 +119,8 @@ const std::vector<sink_ptr>& logger::sinks() const
 
 std::vector<sink_ptr>& logger::sinks()
 {
+    // never a formatters_version(): the fields are asked for again before the next message
+    fields_version_.store(std::numeric_limits<std::uint64_t>::max(), std::memory_order_relaxed);
     return sinks_;
 }
 
@@ -118,6 +154,174 @@ void logger::set_error_handler(err_handler handler)
     custom_err_handler_ = std::move(handler);
 }
 
+void logger::set_clock_source(log_clock_source source)
+{
+    requested_clock_source_.store(source);
+    resolve_clock_source_();
+}
+
+log_clock_source logger::clock_source() const
+{
+    return clock_source_.load(std::memory_order_relaxed);
+}
+
+void logger::resolve_clock_source_()
+{
+    auto source = requested_clock_source_.load(std::memory_order_relaxed);
+    if (source == log_clock_source::tsc)
+    {
+        // converting the ticks on the calling thread costs more than log_clock::now()
+        if (!backend_converts_tsc_ || !details::tsc_clock::available())
+        {
+            source = log_clock_source::system;
+        }
+        else
+        {
+            details::tsc_clock::calibrate();
+        }
+    }
+    else if (source == log_clock_source::automatic)
+    {
+        // the coarse clock lags by up to one kernel tick
+        auto precision = time_precision::none;
+        for (auto& sink : sinks_)
+        {
+            precision = std::max(precision, sink->precision());
+        }
+        bool coarse_ok = precision <= time_precision::seconds ||
+            (precision == time_precision::milliseconds && details::coarse_clock::resolution() <= std::chrono::milliseconds(1));
+        source = coarse_ok ? log_clock_source::coarse : log_clock_source::system;
+    }
+    clock_source_.store(source);
+}
+
+void logger::update_from_sinks_()
+{
+    // version, then ids: a formatter replaced meanwhile is seen by the next message
+    auto version = sinks::sink::formatters_version();
+    std::vector<std::uint64_t> formatter_ids;
+    formatter_ids.reserve(sinks_.size());
+    for (auto& sink : sinks_)
+    {
+        formatter_ids.push_back(sink->formatter_id());
+    }
+
+    auto fields = base_fields_;
+    std::unique_ptr<format_plan> plan(new format_plan);
+    std::vector<std::unique_ptr<formatter>> group_formatters;   // nullptr: a sink formatting by itself
+    for (std::size_t i = 0; i < sinks_.size(); i++)
+    {
+        fields |= sinks_[i]->fields();
+        plan->sinks.push_back(sinks_[i].get());
+
+        auto sink_formatter = sinks_[i]->clone_formatter();
+        auto group = group_formatters.size();
+        if (sink_formatter)
+        {
+            for (std::size_t g = 0; g < group_formatters.size(); g++)
+            {
+                if (group_formatters[g] && group_formatters[g]->equivalent(*sink_formatter))
+                {
+                    group = g;
+                    break;
+                }
+            }
+        }
+
+        if (group == group_formatters.size())
+        {
+            group_formatters.push_back(std::move(sink_formatter));
+            plan->groups.emplace_back();
+        }
+        plan->groups[group].push_back(i);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(format_plans_mutex_);
+        auto* current = format_plan_ptr_.load(std::memory_order_relaxed);
+        if (current == nullptr || !(*current == *plan))
+        {
+            // a plan used before is used again: their count stays bounded by
+            // the configurations the logger went through
+            auto it = std::find_if(format_plans_.begin(), format_plans_.end(),
+                [&](const std::unique_ptr<const format_plan>& p) { return *p == *plan; });
+            if (it == format_plans_.end())
+            {
+                format_plans_.push_back(std::move(plan));
+                it = format_plans_.end() - 1;
+            }
+            format_plan_ptr_.store(it->get(), std::memory_order_release);
+        }
+        sink_formatter_ids_ = std::move(formatter_ids);
+    }
+    fields_.store(fields, std::memory_order_relaxed);
+    fields_version_.store(version, std::memory_order_relaxed);
+}
+
+void logger::refresh_from_sinks_()
+{
+    auto version = sinks::sink::formatters_version();
+    {
+        std::lock_guard<std::mutex> lock(format_plans_mutex_);
+        bool unchanged = sink_formatter_ids_.size() == sinks_.size();
+        for (std::size_t i = 0; unchanged && i < sinks_.size(); i++)
+        {
+            unchanged = sink_formatter_ids_[i] == sinks_[i]->formatter_id();
+        }
+        if (unchanged)
+        {
+            // the formatter of some other logger's sink
+            fields_version_.store(version, std::memory_order_relaxed);
+            return;
+        }
+    }
+    update_from_sinks_();
+}
+
+void logger::log_to_sinks_(const details::log_msg& msg)
+{
+    for (auto& group : format_plan_().groups)
+    {
+        if (group.size() == 1)
+        {
+            auto& s = sinks_[group.front()];
+            if (s->should_log(msg.level))
+            {
+                try
+                {
+                    s->log(msg);
+                }
+                MYLOG_LOGGER_CATCH(msg.source)
+            }
+            continue;
+        }
+
+        // formatted by the first sink logging the level, written by all of them
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& line = scratch.get();
+        bool formatted = false;
+        for (auto i : group)
+        {
+            auto& s = sinks_[i];
+            if (!s->should_log(msg.level))
+            {
+                continue;
+            }
+
+            try
+            {
+                if (!formatted)
+                {
+                    s->format(msg, line);
+                    formatted = true;
+                }
+                s->log_formatted(msg, line);
+            }
+            MYLOG_LOGGER_CATCH(msg.source)
+        }
+    }
+}
+
 std::shared_ptr<logger> logger::clone(std::string logger_name)
 {
     auto cloned = std::make_shared<logger>(*this);
@@ -145,9 +349,7 @@ void logger::err_handler_(const std::string& msg)
             return;
         }
         last_report_time = now;
-        std::tm tm_time;
-        time_t ttime = system_clock::to_time_t(now);
-        localtime_r(&ttime, &tm_time);
+        auto tm_time = details::os::localtime(system_clock::to_time_t(now));
         char date_buf[64];
         std::strftime(date_buf, sizeof(date_buf), "%Y-%m-%d %H:%M:%S", &tm_time);
         std::fprintf(stderr, "[*** LOG ERROR #%04zu ***] [%s] [%s] {%s}\n", err_counter, date_buf, name().c_str(), msg.c_str());
@@ -162,17 +364,7 @@ bool logger::should_flush_(const details::log_msg& msg)
 
 void logger::sink_it_(const details::log_msg& msg)
 {
-    for (auto& s : sinks_)
-    {
-        if (s->should_log(msg.level))
-        {
-            try
-            {
-                s->log(msg);
-            }
-            MYLOG_LOGGER_CATCH(msg.source)
-        }
-    }
+    log_to_sinks_(msg);
 
     if (should_flush_(msg))
     {
@@ -180,6 +372,15 @@ void logger::sink_it_(const details::log_msg& msg)
     }
 }
 
+void logger::sink_deferred_(const details::log_msg& msg, details::deferred_format_fn format_fn)
+{
+    memory_buf_t buf;
+    format_fn(msg.payload, buf);
+    details::log_msg formatted(msg);
+    formatted.payload = string_view_t(buf.data(), buf.size());
+    sink_it_(formatted);
+}
+
 void logger::flush_()
 {
     for (auto& s : sinks_)
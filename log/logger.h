@@ -2,8 +2,14 @@
 
 #include "log/common.h"
 #include "log/level.h"
+#include "log/details/deferred_format.h"
+#include "log/details/coarse_clock.h"
+#include "log/details/scratch_buffer.h"
+#include "log/details/tsc_clock.h"
 #include "log/sinks/sink.h"
 
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
 
@@ -33,14 +39,18 @@ public:
     explicit logger(std::string name)
         : name_(std::move(name))
         , sinks_()
-    {}
+    {
+        update_from_sinks_();
+    }
 
     // Logger with range on sinks
     template<typename It>
     logger(std::string name, It begin, It end)
         : name_(std::move(name))
         , sinks_(begin, end)
-    {}
+    {
+        update_from_sinks_();
+    }
 
     // Logger with sinks init list
     logger(std::string name, sinks_init_list sinks)
@@ -90,7 +100,8 @@ public:
 
         try
         {
-            details::log_msg logmsg(log_time, loc, name_, lvl, msg);
+            details::log_msg logmsg(capture_fields_(), loc, name_, lvl, msg);
+            logmsg.time = log_time;
             sink_it_(logmsg);
         }
         MYLOG_LOGGER_CATCH(loc)
@@ -105,7 +116,9 @@ public:
 
         try
         {
-            details::log_msg logmsg(loc, name_, lvl, msg);
+            auto fields = capture_fields_();
+            details::log_msg logmsg(fields, loc, name_, lvl, msg);
+            stamp_(logmsg, fields);
             sink_it_(logmsg);
         }
         MYLOG_LOGGER_CATCH(loc)
@@ -163,12 +176,13 @@ public:
     bool should_log(level::level_enum lvl) const;
 
     void set_formatter(std::unique_ptr<formatter> f);
-    void set_pattern(std::string pattern);
+    void set_pattern(std::string pattern, pattern_time_type time_type = pattern_time_type::local);
 
     // name
     const std::string& name() const;
 
-    // sinks
+    // sinks. the non-const access makes the logger ask the sinks which
+    // fields they print again before the next message
     const std::vector<sink_ptr> &sinks() const;
     std::vector<sink_ptr> &sinks();
 
@@ -184,6 +198,12 @@ public:
     // error handler
     void set_error_handler(err_handler);
 
+    // clock source of the message times. log_clock_source::tsc is ignored
+    // without an invariant tsc.
+    void set_clock_source(log_clock_source source);
+    // the source in use, log_clock_source::automatic resolved
+    log_clock_source clock_source() const;
+
     // create new logger with same sinks and configuration.
     virtual std::shared_ptr<logger> clone(std::string logger_name);
 
@@ -198,26 +218,140 @@ protected:
 
         try
         {
-            memory_buf_t buf;
-            fmt::detail::vformat_to(buf, fmt, fmt::make_format_args(std::forward<Args>(args)...));
-            details::log_msg msg(loc, name_, lvl, string_view_t(buf.data(), buf.size()));
-            sink_it_(msg);
+            details::scratch_buffer<details::payload_buffer_tag> scratch;
+            auto& buf = scratch.get();
+            auto format_fn = format_or_defer_(buf, fmt, std::forward<Args>(args)...);
+            auto fields = capture_fields_();
+            details::log_msg msg(fields, loc, name_, lvl, string_view_t(buf.data(), buf.size()));
+            stamp_(msg, fields);
+            if (format_fn != nullptr)
+            {
+                sink_deferred_(msg, format_fn);
+            }
+            else
+            {
+                sink_it_(msg);
+            }
         }
         MYLOG_LOGGER_CATCH(loc)
     }
 
+    // format the message into buf. if formatting is deferred, encode the
+    // arguments instead and return the function formatting them later.
+    template<typename... Args>
+    details::deferred_format_fn format_or_defer_(memory_buf_t& buf, string_view_t fmt, Args&&... args)
+    {
+        if (defer_formatting_.load(std::memory_order_relaxed))
+        {
+            auto format_fn = details::deferred_codec<typename std::decay<Args>::type...>::encode(buf, fmt, args...);
+            if (format_fn != nullptr)
+            {
+                return format_fn;
+            }
+        }
+        fmt::detail::vformat_to(buf, fmt, fmt::make_format_args(std::forward<Args>(args)...));
+        return nullptr;
+    }
+
+    // The sinks in groups of equivalent formatters, in the order of their
+    // first sink. Groups of more than one sink are formatted once for all.
+    struct format_plan
+    {
+        std::vector<std::vector<std::size_t>> groups;   // indices into sinks_
+        std::vector<const void*> sinks;                 // sinks_ when the plan was made
+
+        bool operator==(const format_plan& other) const
+        {
+            return groups == other.groups && sinks == other.sinks;
+        }
+    };
+
+    // fields of log_msg captured in new messages: those some sink prints.
+    // asked again once a sink replaced its formatter.
+    msg_fields capture_fields_()
+    {
+        if (fields_version_.load(std::memory_order_relaxed) != sinks::sink::formatters_version())
+        {
+            refresh_from_sinks_();
+        }
+        return fields_.load(std::memory_order_relaxed);
+    }
+
+    // the current format plan. plans are kept until the logger is destroyed,
+    // so a log call may go on with one replaced meanwhile.
+    const format_plan& format_plan_()
+    {
+        if (fields_version_.load(std::memory_order_relaxed) != sinks::sink::formatters_version())
+        {
+            refresh_from_sinks_();
+        }
+        return *format_plan_ptr_.load(std::memory_order_acquire);
+    }
+
+    // ask the sinks again which fields they print and which formatters they share
+    void update_from_sinks_();
+    // update_from_sinks_() if a formatter of the logger's own sinks was replaced
+    void refresh_from_sinks_();
+
+    // log msg to every sink that should log it, following the format plan
+    void log_to_sinks_(const details::log_msg& msg);
+
+    // set the time of a new message from the clock source, if it is captured
+    void stamp_(details::log_msg& msg, msg_fields fields) const
+    {
+        if ((fields & msg_field::time) == 0)
+        {
+            return;
+        }
+
+        switch (clock_source_.load(std::memory_order_relaxed))
+        {
+        case log_clock_source::tsc:
+            // only resolved for loggers whose backend converts the ticks
+            msg.tsc_ticks = details::tsc_clock::ticks();
+            break;
+
+        case log_clock_source::coarse:
+            msg.time = details::coarse_clock::now();
+            break;
+
+        default:
+            msg.time = log_clock::now();
+            break;
+        }
+    }
+
+    // pick the clock for the requested source, see log_clock_source::automatic
+    void resolve_clock_source_();
+
     void err_handler_(const std::string& msg);
     bool should_flush_(const details::log_msg& msg);
     
     virtual void sink_it_(const details::log_msg& msg);
     virtual void flush_();
 
+    // msg.payload holds arguments encoded by details::deferred_codec.
+    // formats them right away, loggers with a backend may do it later.
+    virtual void sink_deferred_(const details::log_msg& msg, details::deferred_format_fn format_fn);
+
 protected:
     std::string name_;
     std::vector<sink_ptr> sinks_;
     level_t level_{ level::info };
     level_t flush_level_{ level::fatal };
     err_handler custom_err_handler_{nullptr};
+    std::atomic<bool> defer_formatting_{ false };   // see async_logger::set_deferred_formatting
+    std::atomic<log_clock_source> clock_source_{ log_clock_source::system };
+    std::atomic<log_clock_source> requested_clock_source_{ log_clock_source::system };
+    bool backend_converts_tsc_{ false };            // log_clock_source::tsc is only used when set
+    msg_fields base_fields_{ msg_field::none };     // captured whatever the sinks print
+    std::atomic<msg_fields> fields_{ msg_field::all };
+    std::atomic<std::uint64_t> fields_version_{ 0 };    // sinks::sink::formatters_version() of fields_
+    std::atomic<const format_plan*> format_plan_ptr_{ nullptr };   // one of format_plans_
+    // guarded by format_plans_mutex_. plans only change with the sinks or their formatters.
+    std::vector<std::unique_ptr<const format_plan>> format_plans_;      // each distinct plan used so far
+    std::vector<std::uint64_t> sink_formatter_ids_;                    // sink::formatter_id() of the sinks when planned
+    std::mutex format_plans_mutex_;
 };
 
 inline void swap(logger& a, logger& b)
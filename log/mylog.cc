@@ -53,9 +53,9 @@ void set_formatter(std::unique_ptr<formatter> new_formatter)
     details::registry::instance().set_formatter(std::move(new_formatter));
 }
 
-void set_pattern(std::string pattern)
+void set_pattern(std::string pattern, pattern_time_type time_type)
 {
-    set_formatter(std::make_unique<pattern_formatter>(std::move(pattern)));
+    set_formatter(std::make_unique<pattern_formatter>(std::move(pattern), time_type));
 }
 
 void set_flush_level(level::level_enum log_level)
@@ -76,7 +76,7 @@ void set_formatter(std::unique_ptr<formatter> new_formatter);
 
 // Set global format string.
 // example: mylog::set_pattern("%Y-%m-%d %H:%M:%S.%e %l : %v");
-void set_pattern(std::string pattern);
+void set_pattern(std::string pattern, pattern_time_type time_type = pattern_time_type::local);
 
 // Set global flush level
 void set_flush_level(level::level_enum log_level);
@@ -4,12 +4,19 @@
 #include "log/details/os.h"
 #include "log/level.h"
 
+#include <cctype>
+#include <typeinfo>
+
 namespace mylog {
 
 // 全格式  [年-月-日 时-分-秒.毫秒] [日志器名称] [日志级别] [线程id] [文件:行号 函数] 日志消息
 class full_formatter : public flag_formatter
 {
 public:
+    explicit full_formatter(pattern_time_type time_type)
+        : time_type_(time_type)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
         using std::chrono::seconds;
@@ -18,24 +25,12 @@ public:
         auto sec = duration_cast<seconds>(msg.time.time_since_epoch());
         if (sec_ != sec || cached_buf_.size() == 0)
         {
+            // rendered once per second for the whole process
+            details::cached_time time;
+            details::time_cache::get(sec, time, time_type_);
             cached_buf_.clear();
             cached_buf_.push_back('[');
-            details::append_int(tm_time.tm_year + 1900, cached_buf_);
-            cached_buf_.push_back('-');
-
-            details::pad2(tm_time.tm_mon + 1, cached_buf_);
-            cached_buf_.push_back('-');
-
-            details::pad2(tm_time.tm_mday, cached_buf_);
-            cached_buf_.push_back(' ');
-
-            details::pad2(tm_time.tm_hour, cached_buf_);
-            cached_buf_.push_back('-');
-
-            details::pad2(tm_time.tm_min, cached_buf_);
-            cached_buf_.push_back('-');
-
-            details::pad2(tm_time.tm_sec, cached_buf_);
+            details::append_string_view(time.date_time_view(), cached_buf_);
             cached_buf_.push_back('.');
 
             sec_ = sec;
@@ -88,177 +83,294 @@ public:
     }
 
 private:
+    pattern_time_type time_type_;
     std::chrono::seconds sec_{ 0 };
     memory_buf_t cached_buf_;
 };
 
 
+template<typename ScopedPadder>
 class year_formatter : public flag_formatter
 {
 public:
+    explicit year_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const size_t field_size = 4;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::append_int(tm_time.tm_year + 1900, dest);
     }
 };
 
+template<typename ScopedPadder>
 class month_formatter : public flag_formatter
 {
 public:
+    explicit month_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const size_t field_size = 2;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::pad2(tm_time.tm_mon + 1, dest);
     }
 };
 
+template<typename ScopedPadder>
 class day_formatter : public flag_formatter
 {
 public:
+    explicit day_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const size_t field_size = 2;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::pad2(tm_time.tm_mday, dest);
     }
 };
 
+template<typename ScopedPadder>
 class hour_formatter : public flag_formatter
 {
 public:
+    explicit hour_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const size_t field_size = 2;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::pad2(tm_time.tm_hour, dest);
     }
 };
 
+template<typename ScopedPadder>
 class minute_formatter : public flag_formatter
 {
 public:
+    explicit minute_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const size_t field_size = 2;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::pad2(tm_time.tm_min, dest);
     }
 };
 
+template<typename ScopedPadder>
 class second_formatter : public flag_formatter
 {
 public:
+    explicit second_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const size_t field_size = 2;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::pad2(tm_time.tm_sec, dest);
     }
 };
 
+template<typename ScopedPadder>
 class millisecond_formatter : public flag_formatter
 {
 public:
+    explicit millisecond_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
         auto millis = details::time_fraction<std::chrono::milliseconds>(msg.time);
+        const size_t field_size = 3;
+        ScopedPadder p(field_size, padinfo_, dest);
         details::pad3(static_cast<uint32_t>(millis.count()), dest);
     }
 };
 
+template<typename ScopedPadder>
 class microsecond_formatter : public flag_formatter
 {
 public:
+    explicit microsecond_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
-        auto us = details::time_fraction<std::chrono::microseconds>(msg.time);
-        details::pad3(static_cast<size_t>(us.count()), dest);
+        auto us = static_cast<size_t>(details::time_fraction<std::chrono::microseconds>(msg.time).count());
+        // pad3 prints larger values in full
+        const size_t field_size = us < 1000 ? 3 : ScopedPadder::count_digits(us);
+        ScopedPadder p(field_size, padinfo_, dest);
+        details::pad3(us, dest);
     }
 };
 
+template<typename ScopedPadder>
 class nanosecond_formatter : public flag_formatter
 {
 public:
+    explicit nanosecond_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
-        auto ns = details::time_fraction<std::chrono::nanoseconds>(msg.time);
-        details::pad3(static_cast<size_t>(ns.count()), dest);
+        auto ns = static_cast<size_t>(details::time_fraction<std::chrono::nanoseconds>(msg.time).count());
+        // pad3 prints larger values in full
+        const size_t field_size = ns < 1000 ? 3 : ScopedPadder::count_digits(ns);
+        ScopedPadder p(field_size, padinfo_, dest);
+        details::pad3(ns, dest);
     }
 };
 
 // 日志器名称 %n
+template<typename ScopedPadder>
 class logger_name_formatter : public flag_formatter
 {
 public:
+    explicit logger_name_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        ScopedPadder p(msg.logger_name.size(), padinfo_, dest);
         details::append_string_view(msg.logger_name, dest);
     }
 };
 
 // 日志等级 %l
+template<typename ScopedPadder>
 class level_formatter : public flag_formatter
 {
 public:
+    explicit level_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
-        details::append_string_view(level::to_string_view(msg.level), dest);
+        auto level_name = level::to_string_view(msg.level);
+        ScopedPadder p(level_name.size(), padinfo_, dest);
+        details::append_string_view(level_name, dest);
     }
 };
 
 // 线程id %t
+template<typename ScopedPadder>
 class thread_formatter : public flag_formatter
 {
 public:
+    explicit thread_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        const auto field_size = ScopedPadder::count_digits(msg.thread_id);
+        ScopedPadder p(field_size, padinfo_, dest);
         details::append_int(msg.thread_id, dest);
     }
 };
 
 // 文件全名 %g
+template<typename ScopedPadder>
 class source_filename_formatter : public flag_formatter
 {
 public:
+    explicit source_filename_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
         if (msg.source.empty())
         {
+            // keep the column even without a source location
+            ScopedPadder p(0, padinfo_, dest);
             return;
         }
+        ScopedPadder p(ScopedPadder::length(msg.source.filename), padinfo_, dest);
         details::append_string_view(msg.source.filename, dest);
     }
 };
 
 // 仅文件名 %s
+template<typename ScopedPadder>
 class short_filename_formatter : public flag_formatter
 {
 public:
+    explicit short_filename_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
         if (msg.source.empty())
         {
+            ScopedPadder p(0, padinfo_, dest);
             return;
         }
-        details::append_string_view(details::os::basename(msg.source.filename), dest);
+        auto filename = details::os::basename(msg.source.filename);
+        ScopedPadder p(ScopedPadder::length(filename), padinfo_, dest);
+        details::append_string_view(filename, dest);
     }
 };
 
 // 行号 %L
+template<typename ScopedPadder>
 class source_linenum_formatter : public flag_formatter
 {
 public:
+    explicit source_linenum_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
         if (msg.source.empty())
         {
+            ScopedPadder p(0, padinfo_, dest);
             return;
         }
+        const auto field_size = ScopedPadder::count_digits(msg.source.line);
+        ScopedPadder p(field_size, padinfo_, dest);
         details::append_int(msg.source.line, dest);
     }
 };
 
 // 函数名 %@
+template<typename ScopedPadder>
 class source_funcname_formatter : public flag_formatter
 {
 public:
+    explicit source_funcname_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
         if (msg.source.empty())
         {
+            ScopedPadder p(0, padinfo_, dest);
             return;
         }
+        ScopedPadder p(ScopedPadder::length(msg.source.funname), padinfo_, dest);
         details::append_string_view(msg.source.funname, dest);
     }
 };
@@ -284,11 +396,17 @@ public:
 };
 
 // 日志消息 %v
+template<typename ScopedPadder>
 class message_formatter : public flag_formatter
 {
 public:
+    explicit message_formatter(details::padding_info padinfo)
+        : flag_formatter(padinfo)
+    {}
+
     void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
     {
+        ScopedPadder p(msg.payload.size(), padinfo_, dest);
         details::append_string_view(msg.payload, dest);
     }
 };
@@ -330,17 +448,49 @@ private:
     std::string str_;
 };
 
+// 连续的秒级时间标志和用户字符，每秒只格式化一次，例如 "[%Y-%m-%d %H:%M:%S."
+class seconds_segment_formatter : public flag_formatter
+{
+public:
+    explicit seconds_segment_formatter(std::vector<std::unique_ptr<flag_formatter>> formatters)
+        : formatters_(std::move(formatters))
+    {}
+
+    void format(const details::log_msg& msg, const std::tm& tm_time, memory_buf_t& dest) override
+    {
+        auto sec = std::chrono::duration_cast<std::chrono::seconds>(msg.time.time_since_epoch());
+        if (sec != sec_ || cached_buf_.size() == 0)
+        {
+            cached_buf_.clear();
+            for (auto& f : formatters_)
+            {
+                f->format(msg, tm_time, cached_buf_);
+            }
+            sec_ = sec;
+        }
+        dest.append(cached_buf_.begin(), cached_buf_.end());
+    }
+
+private:
+    std::vector<std::unique_ptr<flag_formatter>> formatters_;
+    std::chrono::seconds sec_{ 0 };
+    memory_buf_t cached_buf_;
+};
+
 pattern_formatter::pattern_formatter()
     : pattern_("%+")
+    , precision_(time_precision::milliseconds)
+    , fields_(msg_field::all)
 {
-    std::memset(&cached_tm_, 0, sizeof(cached_tm_));
-    formatters_.emplace_back(std::make_unique<full_formatter>());
+    std::memset(&cached_time_.tm_time, 0, sizeof(cached_time_.tm_time));
+    formatters_.emplace_back(std::make_unique<full_formatter>(time_type_));
 }
 
-pattern_formatter::pattern_formatter(std::string pattern)
+pattern_formatter::pattern_formatter(std::string pattern, pattern_time_type time_type)
     : pattern_(std::move(pattern))
+    , time_type_(time_type)
 {
-    std::memset(&cached_tm_, 0, sizeof(cached_tm_));
+    std::memset(&cached_time_.tm_time, 0, sizeof(cached_time_.tm_time));
     compile_pattern_();
 }
 
@@ -348,20 +498,19 @@ pattern_formatter::pattern_formatter(std::string pattern)
 void pattern_formatter::format(const details::log_msg& msg, memory_buf_t& dest)
 {
     // 由于要用到tm格式的时间信息，所以为了减少调用localtime_t的次数，缓存当前的秒和tm
-    // 只有当秒不同时才调用
+    // 只有当秒不同时才从进程共享的time_cache取
     using std::chrono::seconds;
     using std::chrono::duration_cast;
 
     auto sec = duration_cast<seconds>(msg.time.time_since_epoch());
-    if (sec != last_secs_)
+    if (sec != cached_time_.secs)
     {
-        cached_tm_ = details::os::localtime(log_clock::to_time_t(msg.time));
-        last_secs_ = sec;
+        details::time_cache::get(sec, cached_time_, time_type_);
     }
 
     for (auto& f : formatters_)
     {
-        f->format(msg, cached_tm_, dest);
+        f->format(msg, cached_time_.tm_time, dest);
     }
 
     dest.push_back('\n');
@@ -369,7 +518,28 @@ void pattern_formatter::format(const details::log_msg& msg, memory_buf_t& dest)
 
 std::unique_ptr<formatter> pattern_formatter::clone() const
 {
-    return std::make_unique<pattern_formatter>(pattern_);
+    return std::make_unique<pattern_formatter>(pattern_, time_type_);
+}
+
+time_precision pattern_formatter::precision() const
+{
+    return precision_;
+}
+
+msg_fields pattern_formatter::fields() const
+{
+    return fields_;
+}
+
+bool pattern_formatter::equivalent(const formatter& other) const
+{
+    // derived formatters may format differently
+    if (typeid(other) != typeid(*this))
+    {
+        return false;
+    }
+    auto& other_pattern = static_cast<const pattern_formatter&>(other);
+    return other_pattern.pattern_ == pattern_ && other_pattern.time_type_ == time_type_;
 }
 
 void pattern_formatter::set_pattern(std::string pattern)
@@ -378,76 +548,94 @@ void pattern_formatter::set_pattern(std::string pattern)
     compile_pattern_();
 }
 
-void pattern_formatter::handle_flag_(const char ch)
+template<typename Padder>
+void pattern_formatter::handle_flag_(const char ch, details::padding_info padding)
 {
     switch (ch)
     {
     case '+':   // default formatter
-        formatters_.emplace_back(std::make_unique<full_formatter>());
+        formatters_.emplace_back(std::make_unique<full_formatter>(time_type_));
+        needs_precision_(time_precision::milliseconds);
+        fields_ |= msg_field::all;
         break;
 
     case 'Y':   // year
-        formatters_.emplace_back(std::make_unique<year_formatter>());
+        formatters_.emplace_back(std::make_unique<year_formatter<Padder>>(padding));
+        needs_precision_(time_precision::seconds);
         break;
         
     case 'm':   // month 1-12
-        formatters_.emplace_back(std::make_unique<month_formatter>());
+        formatters_.emplace_back(std::make_unique<month_formatter<Padder>>(padding));
+        needs_precision_(time_precision::seconds);
         break;
         
     case 'd':   // day of month 1-31
-        formatters_.emplace_back(std::make_unique<day_formatter>());
+        formatters_.emplace_back(std::make_unique<day_formatter<Padder>>(padding));
+        needs_precision_(time_precision::seconds);
         break;
         
     case 'H':   // hour 24
-        formatters_.emplace_back(std::make_unique<hour_formatter>());
+        formatters_.emplace_back(std::make_unique<hour_formatter<Padder>>(padding));
+        needs_precision_(time_precision::seconds);
         break;
         
     case 'M':   // minute
-        formatters_.emplace_back(std::make_unique<minute_formatter>());
+        formatters_.emplace_back(std::make_unique<minute_formatter<Padder>>(padding));
+        needs_precision_(time_precision::seconds);
         break;
         
     case 'S':   // second
-        formatters_.emplace_back(std::make_unique<second_formatter>());
+        formatters_.emplace_back(std::make_unique<second_formatter<Padder>>(padding));
+        needs_precision_(time_precision::seconds);
         break;
         
     case 'e':   // millisecond
-        formatters_.emplace_back(std::make_unique<millisecond_formatter>());
+        formatters_.emplace_back(std::make_unique<millisecond_formatter<Padder>>(padding));
+        needs_precision_(time_precision::milliseconds);
         break;
         
     case 'f':   // microsecond
-        formatters_.emplace_back(std::make_unique<microsecond_formatter>());
+        formatters_.emplace_back(std::make_unique<microsecond_formatter<Padder>>(padding));
+        needs_precision_(time_precision::microseconds);
         break;
         
     case 'F':   // nanosecond
-        formatters_.emplace_back(std::make_unique<nanosecond_formatter>());
+        formatters_.emplace_back(std::make_unique<nanosecond_formatter<Padder>>(padding));
+        needs_precision_(time_precision::nanoseconds);
         break;
         
     case 'n':   // logger name
-        formatters_.emplace_back(std::make_unique<logger_name_formatter>());
+        formatters_.emplace_back(std::make_unique<logger_name_formatter<Padder>>(padding));
+        fields_ |= msg_field::logger_name;
         break;
         
     case 'l':   // level
-        formatters_.emplace_back(std::make_unique<level_formatter>());
+        formatters_.emplace_back(std::make_unique<level_formatter<Padder>>(padding));
         break;
 
     case 't':   // thread id
-        formatters_.emplace_back(std::make_unique<thread_formatter>());
+        formatters_.emplace_back(std::make_unique<thread_formatter<Padder>>(padding));
+        fields_ |= msg_field::thread_id;
         break;
         
     case 'g':   // full source filename
-        formatters_.emplace_back(std::make_unique<source_filename_formatter>());
+        formatters_.emplace_back(std::make_unique<source_filename_formatter<Padder>>(padding));
+        fields_ |= msg_field::source;
         break;
         
     case 's':   // short source filename - without directory name
-        formatters_.emplace_back(std::make_unique<short_filename_formatter>());
+        formatters_.emplace_back(std::make_unique<short_filename_formatter<Padder>>(padding));
+        fields_ |= msg_field::source;
         break;
 
     case 'L':   // source line number
-        formatters_.emplace_back(std::make_unique<source_linenum_formatter>());
+        formatters_.emplace_back(std::make_unique<source_linenum_formatter<Padder>>(padding));
+        fields_ |= msg_field::source;
         break;
 
     case '@':   // source funcname
-        formatters_.emplace_back(std::make_unique<source_funcname_formatter>());
+        formatters_.emplace_back(std::make_unique<source_funcname_formatter<Padder>>(padding));
+        fields_ |= msg_field::source;
         break;
 
     case '^':   // color range start
@@ -459,7 +647,7 @@ void pattern_formatter::handle_flag_(const char ch)
         break;
         
     case 'v':   // the message text
-        formatters_.emplace_back(std::make_unique<message_formatter>());
+        formatters_.emplace_back(std::make_unique<message_formatter<Padder>>(padding));
         break;
         
     case '%':
@@ -478,11 +666,72 @@ void pattern_formatter::handle_flag_(const char ch)
     }
 }
 
+// [!][-|=]width[!]: '-' 左对齐，'=' 居中，默认右对齐，'!' 超出宽度时截断
+details::padding_info pattern_formatter::handle_padspec_(std::string::const_iterator& it, std::string::const_iterator end)
+{
+    using details::padding_info;
+    bool truncate = false;
+    if (it != end && *it == '!')
+    {
+        truncate = true;
+        ++it;
+    }
+
+    auto side = padding_info::pad_side::left;
+    if (it != end && *it == '-')
+    {
+        side = padding_info::pad_side::right;
+        ++it;
+    }
+    else if (it != end && *it == '=')
+    {
+        side = padding_info::pad_side::center;
+        ++it;
+    }
+
+    if (it == end || !std::isdigit(static_cast<unsigned char>(*it)))
+    {
+        return padding_info{};
+    }
+
+    std::size_t width = 0;
+    while (it != end && std::isdigit(static_cast<unsigned char>(*it)))
+    {
+        // clamped to max_width anyway, just don't overflow
+        if (width <= padding_info::max_width)
+        {
+            width = width * 10 + static_cast<std::size_t>(*it - '0');
+        }
+        ++it;
+    }
+
+    if (it != end && *it == '!')
+    {
+        truncate = true;
+        ++it;
+    }
+    return padding_info{ width, side, truncate };
+}
+
+void pattern_formatter::needs_precision_(time_precision precision)
+{
+    fields_ |= msg_field::time;
+    if (precision > precision_)
+    {
+        precision_ = precision;
+    }
+}
+
 void pattern_formatter::compile_pattern_()
 {
     auto cend = pattern_.cend();
     std::unique_ptr<aggregate_formatter> user_chars;
     formatters_.clear();
+    precision_ = time_precision::none;
+    fields_ = msg_field::none;
+    
+    // what each formatter depends on, for merge_seconds_segments_()
+    std::vector<segment_kind> kinds;
     
     for (auto it = pattern_.cbegin(); it != cend; ++it)
     {
@@ -492,11 +741,21 @@ void pattern_formatter::compile_pattern_()
             if (user_chars)
             {
                 formatters_.emplace_back(std::move(user_chars));
+                kinds.push_back(segment_kind::text);
             }
             
-            if (++it != cend)
+            auto padding = handle_padspec_(++it, cend);
+            if (it != cend)
             {
-                handle_flag_(*it);
+                if (padding.enabled())
+                {
+                    handle_flag_<details::scoped_padder>(*it, padding);
+                }
+                else
+                {
+                    handle_flag_<details::null_scoped_padder>(*it, padding);
+                }
+                kinds.resize(formatters_.size(), flag_segment_kind_(*it));
             }
             else
             {
@@ -517,7 +776,84 @@ void pattern_formatter::compile_pattern_()
     if (user_chars)
     {
         formatters_.emplace_back(std::move(user_chars));
+        kinds.push_back(segment_kind::text);
+    }
+
+    merge_seconds_segments_(kinds);
+}
+
+pattern_formatter::segment_kind pattern_formatter::flag_segment_kind_(const char ch)
+{
+    switch (ch)
+    {
+    case 'Y':
+    case 'm':
+    case 'd':
+    case 'H':
+    case 'M':
+    case 'S':
+        return segment_kind::seconds;
+
+    case '+':   // caches its own date and time
+    case 'e':
+    case 'f':
+    case 'F':
+    case 'n':
+    case 'l':
+    case 't':
+    case 'g':
+    case 's':
+    case 'L':
+    case '@':
+    case '^':   // color ranges are positions in the final output
+    case '$':
+    case 'v':
+        return segment_kind::message;
+
+    default:    // '%' and unknown flags print fixed text
+        return segment_kind::text;
+    }
+}
+
+void pattern_formatter::merge_seconds_segments_(const std::vector<segment_kind>& kinds)
+{
+    std::vector<std::unique_ptr<flag_formatter>> merged;
+    std::size_t i = 0;
+    while (i < formatters_.size())
+    {
+        if (kinds[i] == segment_kind::message)
+        {
+            merged.emplace_back(std::move(formatters_[i++]));
+            continue;
+        }
+
+        // the longest run of text and second-granular flags from i
+        auto end = i;
+        std::size_t time_flags = 0;
+        while (end < formatters_.size() && kinds[end] != segment_kind::message)
+        {
+            time_flags += kinds[end] == segment_kind::seconds ? 1 : 0;
+            ++end;
+        }
+
+        if (time_flags > 0 && end - i > 1)
+        {
+            std::vector<std::unique_ptr<flag_formatter>> segment;
+            for (; i < end; ++i)
+            {
+                segment.emplace_back(std::move(formatters_[i]));
+            }
+            merged.emplace_back(std::make_unique<seconds_segment_formatter>(std::move(segment)));
+        }
+        else
+        {
+            for (; i < end; ++i)
+            {
+                merged.emplace_back(std::move(formatters_[i]));
+            }
+        }
     }
+    formatters_ = std::move(merged);
 }
 
 } // namespace mylog
@@ -2,6 +2,8 @@
 
 #include "log/formatter.h"
 #include "log/details/log_msg.h"
+#include "log/details/scoped_padder.h"
+#include "log/details/time_cache.h"
 
 #include <vector>
 
@@ -10,8 +12,15 @@ namespace mylog {
 class flag_formatter
 {
 public:
+    flag_formatter() = default;
+    explicit flag_formatter(details::padding_info padinfo)
+        : padinfo_(padinfo)
+    {}
     virtual ~flag_formatter() = default;
     virtual void format(const details::log_msg&msg, const std::tm& tm_time, memory_buf_t& dest) = 0;
+
+protected:
+    details::padding_info padinfo_;
 };
 
 
@@ -19,27 +28,47 @@ class pattern_formatter : public formatter
 {
 public:
     pattern_formatter();
-    explicit pattern_formatter(std::string pattern);
+    explicit pattern_formatter(std::string pattern, pattern_time_type time_type = pattern_time_type::local);
 
     pattern_formatter(const pattern_formatter &other) = delete;
     pattern_formatter &operator=(const pattern_formatter &other) = delete;
 
     void format(const details::log_msg& msg, memory_buf_t& dest) override;
     std::unique_ptr<formatter> clone() const override;
+    time_precision precision() const override;
+    msg_fields fields() const override;
+    bool equivalent(const formatter& other) const override;
 
     void set_pattern(std::string pattern);
 
 private:
     // 用于将pattern解析成对应的flag_formatter 
     void compile_pattern_();
-    void handle_flag_(const char ch);
+    template<typename Padder>
+    void handle_flag_(const char ch, details::padding_info padding);
+    // 解析%后的宽度说明，如 %-8l 中的 "-8"，it停在flag上
+    static details::padding_info handle_padspec_(std::string::const_iterator& it, std::string::const_iterator end);
+    void needs_precision_(time_precision precision);
+
+    // seconds: output changes once per second, text: never, message: per message
+    enum class segment_kind
+    {
+        text,
+        seconds,
+        message
+    };
+    static segment_kind flag_segment_kind_(const char ch);
+    // 将连续的秒级时间标志和用户字符合并为一个每秒缓存的formatter
+    void merge_seconds_segments_(const std::vector<segment_kind>& kinds);
 
 
 private:
     std::string pattern_;
+    pattern_time_type time_type_{ pattern_time_type::local };
     std::vector<std::unique_ptr<flag_formatter>> formatters_;
-    std::chrono::seconds last_secs_{ 0 };
-    std::tm cached_tm_;
+    time_precision precision_{ time_precision::none };     // finest time flag of the pattern
+    msg_fields fields_{ msg_field::none };                  // fields printed by the flags
+    details::cached_time cached_time_;     // of the last message, from details::time_cache
 };
 
 } // namespace mylog
@@ -3,7 +3,10 @@
 #include "log/sinks/sink.h"
 #include "log/formatter.h"
 #include "log/pattern_formatter.h"
+#include "log/details/scratch_buffer.h"
+#include "log/details/thread_formatters.h"
 
+#include <atomic>
 #include <mutex>
 
 namespace mylog {
@@ -15,7 +18,7 @@ class base_sink : public sink
 public:
     base_sink();
     explicit base_sink(std::unique_ptr<formatter>);
-    virtual ~base_sink() = default;
+    virtual ~base_sink();
 
     base_sink(const base_sink&) = delete;
     base_sink& operator=(const base_sink&) = delete;
@@ -24,19 +27,46 @@ public:
     base_sink &operator=(base_sink &&) = delete;
     
     void log(const details::log_msg& msg) final;
+    void log_batch(const details::log_msg_span& msgs) final;
+    std::unique_ptr<mylog::formatter> clone_formatter() const final;
+    void format(const details::log_msg& msg, memory_buf_t& dest) final;
+    void log_formatted(const details::log_msg& msg, const memory_buf_t& formatted) final;
+    void log_batch_formatted(const details::log_msg_span& msgs, const formatted_batch& formatted) final;
     void flush() final;
     void set_pattern(const std::string& patern) final;
     void set_formatter(std::unique_ptr<mylog::formatter> sink_formatter) final;
+    time_precision precision() const override;
+    msg_fields fields() const override;
+
+    // Format messages before taking the mutex, with a copy of the formatter
+    // per thread, and hold it only to write the line: threads logging to the
+    // sink format in parallel. For sinks writing the line they are given in
+    // sink_formatted_(), like the file sinks. Off by default.
+    void set_format_outside_lock(bool enabled);
+    bool format_outside_lock() const;
 
 protected:
     virtual void sink_it_(const details::log_msg& msg) = 0;
+    // called with the mutex held. default: sink_it_ for every message the sink should log
+    virtual void sink_batch_(const details::log_msg_span& msgs);
+    // called with the mutex held. default: sink_it_, formatting the message again
+    virtual void sink_formatted_(const details::log_msg& msg, const memory_buf_t& formatted);
+    // called with the mutex held. default: sink_formatted_ for every message the sink should log
+    virtual void sink_batch_formatted_(const details::log_msg_span& msgs, const formatted_batch& formatted);
+    // whether sink_formatted_ writes the line it is given. only then is the
+    // sink formatted for together with others, see sink::clone_formatter()
+    virtual bool writes_formatted_() const;
     virtual void flush_() = 0;
     virtual void set_pattern_(const std::string& pattern);
     virtual void set_formatter_(std::unique_ptr<mylog::formatter> sink_formatter);
     
+    // the calling thread's copy of formatter_
+    formatter* thread_formatter_();
+
 protected:
-    Mutex mutex_;
+    mutable Mutex mutex_;
     std::unique_ptr<formatter> formatter_;
+    std::atomic<bool> format_outside_lock_{ false };
 };
 
 
@@ -50,13 +80,75 @@ inline base_sink<Mutex>::base_sink(std::unique_ptr<formatter> new_formatter)
     : formatter_(std::move(new_formatter))
 {}
 
+template<typename Mutex>
+inline base_sink<Mutex>::~base_sink()
+{
+    set_format_outside_lock(false);
+}
+
 template<typename Mutex>
 inline void base_sink<Mutex>::log(const details::log_msg& msg)
 {
+    if (format_outside_lock_.load(std::memory_order_relaxed))
+    {
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& buf = scratch.get();
+        thread_formatter_()->format(msg, buf);
+        std::lock_guard<Mutex> lock(mutex_);
+        sink_formatted_(msg, buf);
+        return;
+    }
+
     std::lock_guard<Mutex> lock(mutex_);
     sink_it_(msg);
 }
 
+template<typename Mutex>
+inline void base_sink<Mutex>::log_batch(const details::log_msg_span& msgs)
+{
+    std::lock_guard<Mutex> lock(mutex_);
+    sink_batch_(msgs);
+}
+
+template<typename Mutex>
+inline std::unique_ptr<mylog::formatter> base_sink<Mutex>::clone_formatter() const
+{
+    if (!writes_formatted_())
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<Mutex> lock(mutex_);
+    return formatter_->clone();
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::format(const details::log_msg& msg, memory_buf_t& dest)
+{
+    if (format_outside_lock_.load(std::memory_order_relaxed))
+    {
+        thread_formatter_()->format(msg, dest);
+        return;
+    }
+
+    std::lock_guard<Mutex> lock(mutex_);
+    formatter_->format(msg, dest);
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::log_formatted(const details::log_msg& msg, const memory_buf_t& formatted)
+{
+    std::lock_guard<Mutex> lock(mutex_);
+    sink_formatted_(msg, formatted);
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::log_batch_formatted(const details::log_msg_span& msgs, const formatted_batch& formatted)
+{
+    std::lock_guard<Mutex> lock(mutex_);
+    sink_batch_formatted_(msgs, formatted);
+}
+
 template<typename Mutex>
 inline void base_sink<Mutex>::flush()
 {
@@ -69,6 +161,7 @@ inline void base_sink<Mutex>::set_pattern(const std::string& pattern)
 {
     std::lock_guard<Mutex> lock(mutex_);
     set_pattern_(pattern);
+    formatter_changed_();
 }
 
 template<typename Mutex>
@@ -76,6 +169,97 @@ inline void base_sink<Mutex>::set_formatter(std::unique_ptr<mylog::formatter> si
 {
     std::lock_guard<Mutex> lock(mutex_);
     set_formatter_(std::move(sink_formatter));
+    formatter_changed_();
+}
+
+template<typename Mutex>
+inline time_precision base_sink<Mutex>::precision() const
+{
+    std::lock_guard<Mutex> lock(mutex_);
+    return formatter_->precision();
+}
+
+template<typename Mutex>
+inline msg_fields base_sink<Mutex>::fields() const
+{
+    std::lock_guard<Mutex> lock(mutex_);
+    return formatter_->fields();
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::set_format_outside_lock(bool enabled)
+{
+    // threads keep a formatter copy for every sink opted in
+    if (format_outside_lock_.exchange(enabled, std::memory_order_relaxed) != enabled)
+    {
+        if (enabled)
+        {
+            details::thread_formatters::opt_in();
+        }
+        else
+        {
+            details::thread_formatters::opt_out();
+        }
+    }
+}
+
+template<typename Mutex>
+inline bool base_sink<Mutex>::format_outside_lock() const
+{
+    return format_outside_lock_.load(std::memory_order_relaxed);
+}
+
+template<typename Mutex>
+inline formatter* base_sink<Mutex>::thread_formatter_()
+{
+    if (auto* copy = details::thread_formatters::find(this->formatter_id()))
+    {
+        return copy;
+    }
+
+    std::lock_guard<Mutex> lock(mutex_);
+    return details::thread_formatters::add(this->formatter_id(), formatter_->clone());
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::sink_batch_(const details::log_msg_span& msgs)
+{
+    for (auto& msg : msgs)
+    {
+        if (this->should_log(msg.level))
+        {
+            sink_it_(msg);
+        }
+    }
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::sink_formatted_(const details::log_msg& msg, const memory_buf_t&)
+{
+    sink_it_(msg);
+}
+
+template<typename Mutex>
+inline void base_sink<Mutex>::sink_batch_formatted_(const details::log_msg_span& msgs, const formatted_batch& formatted)
+{
+    details::scratch_buffer<details::line_buffer_tag> scratch;
+    auto& buf = scratch.get();
+    for (std::size_t i = 0; i < msgs.size(); i++)
+    {
+        if (this->should_log(msgs[i].level))
+        {
+            auto line = formatted.line(i);
+            buf.clear();
+            buf.append(line.data(), line.data() + line.size());
+            sink_formatted_(msgs[i], buf);
+        }
+    }
+}
+
+template<typename Mutex>
+inline bool base_sink<Mutex>::writes_formatted_() const
+{
+    return false;
 }
 
 template<typename Mutex>
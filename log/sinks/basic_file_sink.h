@@ -2,6 +2,7 @@
 
 #include "log/sinks/base_sink.h"
 #include "log/details/file_helper.h"
+#include "log/details/fd_file_helper.h"
 #include "log/common.h"
 #include "log/details/console_global.h"
 #include "log/synchronous_factory.h"
@@ -9,7 +10,8 @@
 namespace mylog {
 namespace sinks {
 
-template<typename Mutex>    
+// FileHelper is details::file_helper (stdio) or details::fd_file_helper
+template<typename Mutex, typename FileHelper = details::file_helper>
 class basic_file_sink : public base_sink<Mutex>
 {
 public:
@@ -24,14 +26,73 @@ public:
     {
         return file_helper_.filename();
     }
+
+    // fd_file_helper only
+    void set_buffer_size(std::size_t buffer_size)
+    {
+        std::lock_guard<Mutex> lock(base_sink<Mutex>::mutex_);
+        file_helper_.set_buffer_size(buffer_size);
+    }
     
 protected:
     void sink_it_(const details::log_msg& msg) override
     {
-        memory_buf_t buf;
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& buf = scratch.get();
         base_sink<Mutex>::formatter_->format(msg, buf);
         file_helper_.write(buf);
     }
+
+    void sink_formatted_(const details::log_msg&, const memory_buf_t& formatted) override
+    {
+        file_helper_.write(formatted);
+    }
+
+    // format the whole batch into one buffer and write it at once
+    void sink_batch_(const details::log_msg_span& msgs) override
+    {
+        batch_buf_.clear();
+        for (auto& msg : msgs)
+        {
+            if (this->should_log(msg.level))
+            {
+                base_sink<Mutex>::formatter_->format(msg, batch_buf_);
+            }
+        }
+        file_helper_.write(batch_buf_);
+    }
+
+    // the lines of the messages to log, at once. written as they are when
+    // the sink logs every message
+    void sink_batch_formatted_(const details::log_msg_span& msgs, const formatted_batch& formatted) override
+    {
+        std::size_t first_skipped = 0;
+        while (first_skipped < msgs.size() && this->should_log(msgs[first_skipped].level))
+        {
+            first_skipped++;
+        }
+        if (first_skipped == msgs.size())
+        {
+            file_helper_.write(formatted.lines);
+            return;
+        }
+
+        batch_buf_.clear();
+        for (std::size_t i = 0; i < msgs.size(); i++)
+        {
+            if (this->should_log(msgs[i].level))
+            {
+                auto line = formatted.line(i);
+                batch_buf_.append(line.data(), line.data() + line.size());
+            }
+        }
+        file_helper_.write(batch_buf_);
+    }
+
+    bool writes_formatted_() const override
+    {
+        return true;
+    }
     
     void flush_() override
     {
@@ -39,11 +100,14 @@ protected:
     }
 
 private:
-    details::file_helper file_helper_;
+    FileHelper file_helper_;
+    memory_buf_t batch_buf_;
 };
 
 using basic_file_sink_mt = basic_file_sink<std::mutex>;
 using basic_file_sink_st = basic_file_sink<details::null_mutex>;
+using basic_fd_file_sink_mt = basic_file_sink<std::mutex, details::fd_file_helper>;
+using basic_fd_file_sink_st = basic_file_sink<details::null_mutex, details::fd_file_helper>;
 
 } // namespace sinks
 
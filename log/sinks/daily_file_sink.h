@@ -2,6 +2,7 @@
 
 #include "log/sinks/base_sink.h"
 #include "log/details/file_helper.h"
+#include "log/details/fd_file_helper.h"
 #include "log/common.h"
 #include "log/details/console_global.h"
 #include "log/synchronous_factory.h"
@@ -49,8 +50,9 @@ struct daily_filename_format_calculator
  * Rotating file sink based on date.
  * If truncate != false , the created file will be truncated.
  * If max_files > 0, retain only the last max_files and delete previous.
+ * FileHelper is details::file_helper (stdio) or details::fd_file_helper.
  */
-template<typename Mutex, typename FileNameCalc = daily_filename_calculator>
+template<typename Mutex, typename FileNameCalc = daily_filename_calculator, typename FileHelper = details::file_helper>
 class daily_file_sink : public base_sink<Mutex>
 {
 public:
@@ -85,8 +87,29 @@ public:
         return file_helper_.filename();
     }
 
+    // fd_file_helper only
+    void set_buffer_size(std::size_t buffer_size)
+    {
+        std::lock_guard<Mutex> lock(base_sink<Mutex>::mutex_);
+        file_helper_.set_buffer_size(buffer_size);
+    }
+
+    // files rotate by the message time, printed or not
+    msg_fields fields() const override
+    {
+        return base_sink<Mutex>::fields() | msg_field::time;
+    }
+
 protected:
     void sink_it_(const details::log_msg& msg) override
+    {
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& buf = scratch.get();
+        base_sink<Mutex>::formatter_->format(msg, buf);
+        sink_formatted_(msg, buf);
+    }
+
+    void sink_formatted_(const details::log_msg& msg, const memory_buf_t& formatted) override
     {
         auto time = msg.time;
         bool should_rotate = time >= rotation_tp_;
@@ -97,9 +120,7 @@ protected:
             rotation_tp_ = next_rotation_tp_();
         }
 
-        memory_buf_t buf;
-        base_sink<Mutex>::formatter_->format(msg, buf);
-        file_helper_.write(buf);
+        file_helper_.write(formatted);
 
         // Do the cleaning only at the end because it might throw on failure.
         if (should_rotate && max_files_ > 0)
@@ -108,12 +129,68 @@ protected:
         }
     }
     
+    // Same as sink_it_, but formatted messages are collected and written at once,
+    // up to the point where the file has to be rotated.
+    void sink_batch_(const details::log_msg_span& msgs) override
+    {
+        write_lines_(msgs, [&](std::size_t i) { base_sink<Mutex>::formatter_->format(msgs[i], batch_buf_); });
+    }
+
+    void sink_batch_formatted_(const details::log_msg_span& msgs, const formatted_batch& formatted) override
+    {
+        write_lines_(msgs, [&](std::size_t i) {
+            auto line = formatted.line(i);
+            batch_buf_.append(line.data(), line.data() + line.size());
+        });
+    }
+
+    bool writes_formatted_() const override
+    {
+        return true;
+    }
+    
     void flush_() override
     {
         file_helper_.flush();
     }
 
 private:
+    // write the lines of the messages to log at once, up to the point where the
+    // file has to be rotated. append_line(i) appends the line of message i to batch_buf_
+    template<typename AppendLine>
+    void write_lines_(const details::log_msg_span& msgs, AppendLine append_line)
+    {
+        bool rotated = false;
+        batch_buf_.clear();
+        for (std::size_t i = 0; i < msgs.size(); i++)
+        {
+            auto& msg = msgs[i];
+            if (!this->should_log(msg.level))
+            {
+                continue;
+            }
+
+            if (msg.time >= rotation_tp_)
+            {
+                file_helper_.write(batch_buf_);
+                batch_buf_.clear();
+
+                auto filename = FileNameCalc::calc_filename(base_filename_, now_tm_(msg.time));
+                file_helper_.open(filename, truncate_);
+                rotation_tp_ = next_rotation_tp_();
+                rotated = true;
+            }
+            append_line(i);
+        }
+        file_helper_.write(batch_buf_);
+
+        // Do the cleaning only at the end because it might throw on failure.
+        if (rotated && max_files_ > 0)
+        {
+            delete_old_();
+        }
+    }
+
     void init_filenames_q_()
     {
         using details::os::path_exists;
@@ -140,10 +217,7 @@ private:
 
     tm now_tm_(log_clock::time_point tp)
     {
-        time_t tnow = log_clock::to_time_t(tp);
-        std::tm tm;
-        ::localtime_r(&tnow, &tm);
-        return tm;
+        return details::os::localtime(log_clock::to_time_t(tp));
     }
 
     log_clock::time_point next_rotation_tp_()
@@ -153,7 +227,7 @@ private:
         date.tm_hour = rotation_h_;
         date.tm_min = rotation_m_;
         date.tm_sec = 0;
-        auto rotation_time = log_clock::from_time_t(std::mktime(&date));
+        auto rotation_time = log_clock::from_time_t(details::os::mktime(date));
         if (rotation_time > now)
         {
             return rotation_time;
@@ -188,10 +262,11 @@ private:
     int rotation_h_;
     int rotation_m_;
     log_clock::time_point rotation_tp_;
-    details::file_helper file_helper_;
+    FileHelper file_helper_;
     bool truncate_;
     uint16_t max_files_;
     details::circular_q<filename_t> filenames_q_;
+    memory_buf_t batch_buf_;
 };
 
 
@@ -199,6 +274,8 @@ using daily_file_sink_mt = daily_file_sink<std::mutex>;
 using daily_file_sink_st = daily_file_sink<details::null_mutex>;
 using daily_file_format_sink_mt = daily_file_sink<std::mutex, daily_filename_format_calculator>;
 using daily_file_format_sink_st = daily_file_sink<details::null_mutex, daily_filename_format_calculator>;
+using daily_fd_file_sink_mt = daily_file_sink<std::mutex, daily_filename_calculator, details::fd_file_helper>;
+using daily_fd_file_sink_st = daily_file_sink<details::null_mutex, daily_filename_calculator, details::fd_file_helper>;
 
 } // namespace sinks
 
@@ -2,6 +2,7 @@
 
 #include "log/sinks/base_sink.h"
 #include "log/details/file_helper.h"
+#include "log/details/fd_file_helper.h"
 #include "log/common.h"
 #include "log/details/console_global.h"
 #include "log/synchronous_factory.h"
@@ -11,7 +12,8 @@ namespace mylog {
 namespace sinks {
 
 // Rotating file sink based on size
-template<typename Mutex>    
+// FileHelper is details::file_helper (stdio) or details::fd_file_helper
+template<typename Mutex, typename FileHelper = details::file_helper>
 class rotating_file_sink : public base_sink<Mutex>
 {
 public:
@@ -20,9 +22,15 @@ public:
 
     static filename_t calc_filename(const filename_t& filename, std::size_t index);
     filename_t filename();
+    // fd_file_helper only
+    void set_buffer_size(std::size_t buffer_size);
     
 protected:
     void sink_it_(const details::log_msg& msg) override;
+    void sink_batch_(const details::log_msg_span& msgs) override;
+    void sink_formatted_(const details::log_msg& msg, const memory_buf_t& formatted) override;
+    void sink_batch_formatted_(const details::log_msg_span& msgs, const formatted_batch& formatted) override;
+    bool writes_formatted_() const override;
     void flush_() override;
 
 private:
@@ -33,6 +41,11 @@ private:
     // log.3.txt -> delete
     void rotate_();
 
+    // write the lines of the messages to log at once, up to the point where the
+    // file has to be rotated. line_of(i) returns the line of message i
+    template<typename LineOf>
+    void write_lines_(const details::log_msg_span& msgs, LineOf line_of);
+
     // delete the target if exists, and rename the src file  to target
     // return true on success, false otherwise.
     bool rename_file_(const filename_t& src_filename, const filename_t& target_filename);
@@ -42,12 +55,13 @@ private:
     std::size_t max_size_;
     std::size_t max_files_;
     std::size_t current_size_;
-    details::file_helper file_helper_;
+    FileHelper file_helper_;
+    memory_buf_t batch_buf_;
 };
 
 
-template<typename Mutex>
-inline rotating_file_sink<Mutex>::rotating_file_sink(filename_t filename, std::size_t max_size, std::size_t max_files, bool rotate_on_open)
+template<typename Mutex, typename FileHelper>
+inline rotating_file_sink<Mutex, FileHelper>::rotating_file_sink(filename_t filename, std::size_t max_size, std::size_t max_files, bool rotate_on_open)
     : base_filename_(filename)
     , max_size_(max_size)
     , max_files_(max_files)
@@ -72,8 +86,8 @@ inline rotating_file_sink<Mutex>::rotating_file_sink(filename_t filename, std::s
     }
 }
 
-template<typename Mutex> 
-inline filename_t rotating_file_sink<Mutex>::calc_filename(const filename_t& filename, std::size_t index)
+template<typename Mutex, typename FileHelper>
+inline filename_t rotating_file_sink<Mutex, FileHelper>::calc_filename(const filename_t& filename, std::size_t index)
 {
     if (index == 0u)
         return filename;
@@ -84,19 +98,33 @@ inline filename_t rotating_file_sink<Mutex>::calc_filename(const filename_t& fil
     return fmt::format("{}.{}{}", base_name, index, ext_name);
 }
 
-template<typename Mutex> 
-inline filename_t rotating_file_sink<Mutex>::filename()
+template<typename Mutex, typename FileHelper>
+inline filename_t rotating_file_sink<Mutex, FileHelper>::filename()
 {
     std::lock_guard<Mutex> lock(base_sink<Mutex>::mutex_);
     return file_helper_.filename();
 }
 
-template<typename Mutex> 
-inline void rotating_file_sink<Mutex>::sink_it_(const details::log_msg& msg)
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::set_buffer_size(std::size_t buffer_size)
+{
+    std::lock_guard<Mutex> lock(base_sink<Mutex>::mutex_);
+    file_helper_.set_buffer_size(buffer_size);
+}
+
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::sink_it_(const details::log_msg& msg)
 {
-    memory_buf_t buf;
+    details::scratch_buffer<details::line_buffer_tag> scratch;
+    auto& buf = scratch.get();
     base_sink<Mutex>::formatter_->format(msg, buf);
-    auto new_size = current_size_ + buf.size();
+    sink_formatted_(msg, buf);
+}
+
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::sink_formatted_(const details::log_msg&, const memory_buf_t& formatted)
+{
+    auto new_size = current_size_ + formatted.size();
 
     if (new_size > max_size_)
     {
@@ -104,22 +132,83 @@ inline void rotating_file_sink<Mutex>::sink_it_(const details::log_msg& msg)
         if (file_helper_.size() > 0)
         {
             rotate_();
-            new_size = buf.size();
+            new_size = formatted.size();
         }
     }
     
-    file_helper_.write(buf);
+    file_helper_.write(formatted);
     current_size_ = new_size;
 }
 
-template<typename Mutex> 
-inline void rotating_file_sink<Mutex>::flush_()
+// Same as sink_it_, but formatted messages are collected and written at once,
+// up to the point where the file has to be rotated.
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::sink_batch_(const details::log_msg_span& msgs)
+{
+    details::scratch_buffer<details::line_buffer_tag> scratch;
+    auto& buf = scratch.get();
+    write_lines_(msgs, [&](std::size_t i) {
+        buf.clear();
+        base_sink<Mutex>::formatter_->format(msgs[i], buf);
+        return string_view_t(buf.data(), buf.size());
+    });
+}
+
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::sink_batch_formatted_(const details::log_msg_span& msgs, const formatted_batch& formatted)
+{
+    write_lines_(msgs, [&](std::size_t i) { return formatted.line(i); });
+}
+
+template<typename Mutex, typename FileHelper>
+inline bool rotating_file_sink<Mutex, FileHelper>::writes_formatted_() const
+{
+    return true;
+}
+
+template<typename Mutex, typename FileHelper>
+template<typename LineOf>
+inline void rotating_file_sink<Mutex, FileHelper>::write_lines_(const details::log_msg_span& msgs, LineOf line_of)
+{
+    batch_buf_.clear();
+    for (std::size_t i = 0; i < msgs.size(); i++)
+    {
+        if (!this->should_log(msgs[i].level))
+        {
+            continue;
+        }
+
+        auto line = line_of(i);
+        auto new_size = current_size_ + batch_buf_.size() + line.size();
+
+        if (new_size > max_size_)
+        {
+            file_helper_.write(batch_buf_);
+            current_size_ += batch_buf_.size();
+            batch_buf_.clear();
+
+            file_helper_.flush();
+            if (file_helper_.size() > 0)
+            {
+                rotate_();
+                current_size_ = 0;
+            }
+        }
+        batch_buf_.append(line.data(), line.data() + line.size());
+    }
+
+    file_helper_.write(batch_buf_);
+    current_size_ += batch_buf_.size();
+}
+
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::flush_()
 {
     file_helper_.flush();
 }
 
-template<typename Mutex> 
-inline void rotating_file_sink<Mutex>::rotate_()
+template<typename Mutex, typename FileHelper>
+inline void rotating_file_sink<Mutex, FileHelper>::rotate_()
 {
     using details::os::filename_to_str;
     using details::os::path_exists;
@@ -149,8 +238,8 @@ inline void rotating_file_sink<Mutex>::rotate_()
     file_helper_.reopen(true);
 }
 
-template<typename Mutex> 
-inline bool rotating_file_sink<Mutex>::rename_file_(const filename_t& src_filename, const filename_t& target_filename)
+template<typename Mutex, typename FileHelper>
+inline bool rotating_file_sink<Mutex, FileHelper>::rename_file_(const filename_t& src_filename, const filename_t& target_filename)
 {
     // 文件不存在会返回-1
     (void)std::remove(target_filename.c_str());
@@ -160,6 +249,8 @@ inline bool rotating_file_sink<Mutex>::rename_file_(const filename_t& src_filena
 
 using rotating_file_sink_mt = rotating_file_sink<std::mutex>;
 using rotating_file_sink_st = rotating_file_sink<details::null_mutex>;
+using rotating_fd_file_sink_mt = rotating_file_sink<std::mutex, details::fd_file_helper>;
+using rotating_fd_file_sink_st = rotating_file_sink<details::null_mutex, details::fd_file_helper>;
 
 } // namespace sinks
 
@@ -4,21 +4,121 @@
 #include "log/level.h"
 #include "log/details/log_msg.h"
 #include "log/formatter.h"
+#include "log/details/scratch_buffer.h"
 
+#include <atomic>
+#include <cstdint>
 #include <memory>
 
 namespace mylog {
 namespace sinks {
 
+// The lines of a batch of messages, formatted one after the other into one
+// buffer. Line i ends at ends[i], where line i + 1 starts. Messages no sink
+// of the group logs get an empty line.
+struct formatted_batch
+{
+    const memory_buf_t& lines;
+    const std::size_t* ends;
+
+    string_view_t line(std::size_t i) const
+    {
+        auto begin = i == 0 ? 0 : ends[i - 1];
+        return string_view_t(lines.data() + begin, ends[i] - begin);
+    }
+};
+
 class sink
 {
 public:
     virtual ~sink() = default;
     virtual void log(const details::log_msg& msg) = 0;
+
+    // Log a batch of messages, skipping those below the sink's level.
+    // Sinks that can write a whole batch at once override it.
+    virtual void log_batch(const details::log_msg_span& msgs)
+    {
+        for (auto& msg : msgs)
+        {
+            if (should_log(msg.level))
+            {
+                log(msg);
+            }
+        }
+    }
+
     virtual void flush() = 0;
     virtual void set_pattern(const std::string& pattern) = 0;
     virtual void set_formatter(std::unique_ptr<mylog::formatter> sink_formatter) = 0;
 
+    // Formatting once for several sinks: loggers compare the clones of the
+    // sinks' formatters, format() a message with one sink of each group of
+    // equivalent formatters and pass the line to log_formatted() of the others.
+    // nullptr: the sink is left to format by itself.
+    virtual std::unique_ptr<mylog::formatter> clone_formatter() const
+    {
+        return nullptr;
+    }
+
+    // format msg as log() would, without writing it. only called on sinks
+    // whose clone_formatter() returned a formatter
+    virtual void format(const details::log_msg& msg, memory_buf_t& dest)
+    {
+        (void)msg;
+        (void)dest;
+    }
+
+    // log msg, given its line formatted by a formatter equivalent to the sink's
+    virtual void log_formatted(const details::log_msg& msg, const memory_buf_t& formatted)
+    {
+        (void)formatted;
+        log(msg);
+    }
+
+    // log_batch(), given the lines of msgs formatted by a formatter equivalent
+    // to the sink's. only called on sinks whose clone_formatter() returned a formatter
+    virtual void log_batch_formatted(const details::log_msg_span& msgs, const formatted_batch& formatted)
+    {
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& buf = scratch.get();
+        for (std::size_t i = 0; i < msgs.size(); i++)
+        {
+            if (should_log(msgs[i].level))
+            {
+                auto line = formatted.line(i);
+                buf.clear();
+                buf.append(line.data(), line.data() + line.size());
+                log_formatted(msgs[i], buf);
+            }
+        }
+    }
+
+    // finest time unit the sink's formatter prints
+    virtual time_precision precision() const
+    {
+        return time_precision::nanoseconds;
+    }
+
+    // fields of log_msg the sink needs. base_sink answers those its formatter
+    // prints, sinks reading other fields themselves must add them.
+    virtual msg_fields fields() const
+    {
+        return msg_field::all;
+    }
+
+    // changes whenever the sink's formatter is replaced, never the same for two sinks
+    std::uint64_t formatter_id() const
+    {
+        return formatter_id_.load(std::memory_order_acquire);
+    }
+
+    // changes whenever the formatter of some sink is replaced, after its
+    // formatter_id(): loggers check it first, then the ids of their own sinks
+    static std::uint64_t formatters_version()
+    {
+        return formatters_version_().load(std::memory_order_acquire);
+    }
+
     level::level_enum level() const
     {
         return static_cast<level::level_enum>(level_.load(std::memory_order_relaxed));
@@ -34,8 +134,29 @@ public:
         return lvl >= level_.load(std::memory_order_relaxed);
     }
 
+protected:
+    // to be called by sinks after replacing their formatter, with their lock held
+    void formatter_changed_()
+    {
+        formatter_id_.store(next_formatter_id_(), std::memory_order_release);
+        formatters_version_().fetch_add(1, std::memory_order_release);
+    }
+
 private:
+    static std::atomic<std::uint64_t>& formatters_version_()
+    {
+        static std::atomic<std::uint64_t> version{ 0 };
+        return version;
+    }
+
+    static std::uint64_t next_formatter_id_()
+    {
+        static std::atomic<std::uint64_t> id{ 0 };
+        return id.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
     level_t level_{ level::trace };
+    std::atomic<std::uint64_t> formatter_id_{ next_formatter_id_() };
 };
 
     
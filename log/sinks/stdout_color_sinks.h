@@ -7,6 +7,7 @@
 #include "log/details/console_global.h"
 #include "log/synchronous_factory.h"
 #include "log/pattern_formatter.h"
+#include "log/details/scratch_buffer.h"
 
 #include <array>
 
@@ -50,25 +51,29 @@ public:
     void log(const details::log_msg& msg) override
     {
         std::lock_guard<mutex_t> lock(mutex_);
-        memory_buf_t buf;
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& buf = scratch.get();
         formatter_->format(msg, buf);
-        
-        if (msg.color_range_end > msg.color_range_start)
-        {
-            // 1. 打印颜色前的部分
-            print_range_(0, msg.color_range_start, buf);
-            // 2. 打印颜色部分
-            print_ccode_(colors_[static_cast<size_t>(msg.level)]);
-            print_range_(msg.color_range_start, msg.color_range_end, buf);
-            print_ccode_(reset);
-            // 3. 打印颜色后面的部分
-            print_range_(msg.color_range_end, buf.size(), buf);
-        }
-        else
-        {
-            print_range_(0, buf.size(), buf);
-        }
-        fflush(file_);  // 每条日志都刷新缓冲区
+        print_(msg, buf);
+    }
+
+    // the color range of msg was set when formatted
+    void log_formatted(const details::log_msg& msg, const memory_buf_t& formatted) override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        print_(msg, formatted);
+    }
+
+    std::unique_ptr<mylog::formatter> clone_formatter() const override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        return formatter_->clone();
+    }
+
+    void format(const details::log_msg& msg, memory_buf_t& dest) override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        formatter_->format(msg, dest);
     }
     
     void flush() override
@@ -81,12 +86,26 @@ public:
     {
         std::lock_guard<mutex_t> lock(mutex_);
         formatter_ = std::make_unique<pattern_formatter>(pattern);
+        formatter_changed_();
     }
     
     void set_formatter(std::unique_ptr<mylog::formatter> sink_formatter) override
     {
         std::lock_guard<mutex_t> lock(mutex_);
         formatter_ = std::move(sink_formatter);
+        formatter_changed_();
+    }
+
+    time_precision precision() const override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        return formatter_->precision();
+    }
+
+    msg_fields fields() const override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        return formatter_->fields();
     }
     
     // Formatting codes
@@ -125,6 +144,26 @@ public:
     const string_view_t bold_on_red = "\033[1m\033[41m";
 
 private:
+    void print_(const details::log_msg& msg, const memory_buf_t& buf)
+    {
+        if (msg.color_range_end > msg.color_range_start)
+        {
+            // 1. 打印颜色前的部分
+            print_range_(0, msg.color_range_start, buf);
+            // 2. 打印颜色部分
+            print_ccode_(colors_[static_cast<size_t>(msg.level)]);
+            print_range_(msg.color_range_start, msg.color_range_end, buf);
+            print_ccode_(reset);
+            // 3. 打印颜色后面的部分
+            print_range_(msg.color_range_end, buf.size(), buf);
+        }
+        else
+        {
+            print_range_(0, buf.size(), buf);
+        }
+        fflush(file_);  // 每条日志都刷新缓冲区
+    }
+
     void print_ccode_(const string_view_t& color)
     {
         fwrite(color.data(), sizeof(char), color.size(), file_);
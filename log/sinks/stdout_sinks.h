@@ -6,6 +6,7 @@
 #include "log/sinks/sink.h"
 #include "log/common.h"
 #include "log/pattern_formatter.h"
+#include "log/details/scratch_buffer.h"
 
 namespace mylog {
 namespace sinks {
@@ -32,11 +33,31 @@ public:
     void log(const details::log_msg& msg) override
     {
         std::lock_guard<mutex_t> lock(mutex_);
-        memory_buf_t buf;
+        details::scratch_buffer<details::line_buffer_tag> scratch;
+        auto& buf = scratch.get();
         formatter_->format(msg, buf);
         fwrite(buf.data(), sizeof(char), buf.size(), file_);
         std::fflush(file_); // flush every line to terminal
     }
+
+    void log_formatted(const details::log_msg&, const memory_buf_t& formatted) override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        fwrite(formatted.data(), sizeof(char), formatted.size(), file_);
+        std::fflush(file_);
+    }
+
+    std::unique_ptr<mylog::formatter> clone_formatter() const override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        return formatter_->clone();
+    }
+
+    void format(const details::log_msg& msg, memory_buf_t& dest) override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        formatter_->format(msg, dest);
+    }
     
     void flush() override
     {
@@ -49,12 +70,26 @@ public:
         std::lock_guard<mutex_t> lock(mutex_);
         // formatter_ = std::unique_ptr<mylog::formatter>(new pattern_formatter(pattern));
         formatter_ = std::make_unique<pattern_formatter>(pattern);
+        formatter_changed_();
     }
     
     void set_formatter(std::unique_ptr<mylog::formatter> sink_formatter) override
     {
         std::lock_guard<mutex_t> lock(mutex_);
         formatter_ = std::move(sink_formatter);
+        formatter_changed_();
+    }
+
+    time_precision precision() const override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        return formatter_->precision();
+    }
+
+    msg_fields fields() const override
+    {
+        std::lock_guard<mutex_t> lock(mutex_);
+        return formatter_->fields();
     }
 
 private:
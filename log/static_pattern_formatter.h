@@ -0,0 +1,624 @@
+#pragma once
+
+#include "log/formatter.h"
+#include "log/details/fmt_helper.h"
+#include "log/details/log_msg.h"
+#include "log/details/os.h"
+#include "log/details/scoped_padder.h"
+#include "log/details/time_cache.h"
+#include "log/level.h"
+
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace mylog {
+namespace details {
+namespace static_pattern {
+
+// The flags of pattern_formatter as types. A pattern is parsed at compile time
+// into a sequence of them, and formatting a message calls every flag directly,
+// so the compiler can inline the whole pattern into one function.
+
+// per_second: output depends on the second of the message time only
+// paddable: takes a width spec like %-8l
+// fields: of log_msg read besides the time, which follows from the precision
+template<time_precision Precision = time_precision::none, bool PerSecond = false, bool Paddable = true,
+    msg_fields Fields = msg_field::none>
+struct flag_base
+{
+    static constexpr time_precision precision = Precision;
+    static constexpr bool per_second = PerSecond;
+    static constexpr bool paddable = Paddable;
+    static constexpr msg_fields fields = Fields | (Precision != time_precision::none ? msg_field::time : msg_field::none);
+};
+
+// unknown flags appear as is
+template<char Flag>
+struct flag : flag_base<time_precision::none, false, false>
+{
+    static void format(const log_msg&, const cached_time&, memory_buf_t& dest)
+    {
+        dest.push_back('%');
+        dest.push_back(Flag);
+    }
+};
+
+// same output as full_formatter
+template<>
+struct flag<'+'> : flag_base<time_precision::milliseconds, false, false, msg_field::all>
+{
+    static void format(const log_msg& msg, const cached_time& time, memory_buf_t& dest)
+    {
+        dest.push_back('[');
+        append_string_view(time.date_time_view(), dest);
+        dest.push_back('.');
+        pad3(static_cast<uint32_t>(time_fraction<std::chrono::milliseconds>(msg.time).count()), dest);
+        dest.push_back(']');
+        dest.push_back(' ');
+
+        if (msg.logger_name.size() > 0)
+        {
+            dest.push_back('[');
+            append_string_view(msg.logger_name, dest);
+            dest.push_back(']');
+            dest.push_back(' ');
+        }
+
+        dest.push_back('[');
+        msg.color_range_start = dest.size();
+        append_string_view(level::to_string_view(msg.level), dest);
+        msg.color_range_end = dest.size();
+        dest.push_back(']');
+        dest.push_back(' ');
+
+        if (msg.thread_id != 0)
+        {
+            dest.push_back('[');
+            pad6(msg.thread_id, dest);
+            dest.push_back(']');
+            dest.push_back(' ');
+        }
+
+        if (!msg.source.empty())
+        {
+            dest.push_back('[');
+            append_string_view(os::basename(msg.source.filename), dest);
+            dest.push_back(':');
+            append_int(msg.source.line, dest);
+            dest.push_back(' ');
+            append_string_view(msg.source.funname, dest);
+            dest.push_back(']');
+            dest.push_back(' ');
+        }
+
+        append_string_view(msg.payload, dest);
+    }
+};
+
+template<>
+struct flag<'Y'> : flag_base<time_precision::seconds, true>
+{
+    static void format(const log_msg&, const cached_time& time, memory_buf_t& dest)
+    {
+        append_int(time.tm_time.tm_year + 1900, dest);
+    }
+};
+
+template<>
+struct flag<'m'> : flag_base<time_precision::seconds, true>
+{
+    static void format(const log_msg&, const cached_time& time, memory_buf_t& dest)
+    {
+        pad2(time.tm_time.tm_mon + 1, dest);
+    }
+};
+
+template<>
+struct flag<'d'> : flag_base<time_precision::seconds, true>
+{
+    static void format(const log_msg&, const cached_time& time, memory_buf_t& dest)
+    {
+        pad2(time.tm_time.tm_mday, dest);
+    }
+};
+
+template<>
+struct flag<'H'> : flag_base<time_precision::seconds, true>
+{
+    static void format(const log_msg&, const cached_time& time, memory_buf_t& dest)
+    {
+        pad2(time.tm_time.tm_hour, dest);
+    }
+};
+
+template<>
+struct flag<'M'> : flag_base<time_precision::seconds, true>
+{
+    static void format(const log_msg&, const cached_time& time, memory_buf_t& dest)
+    {
+        pad2(time.tm_time.tm_min, dest);
+    }
+};
+
+template<>
+struct flag<'S'> : flag_base<time_precision::seconds, true>
+{
+    static void format(const log_msg&, const cached_time& time, memory_buf_t& dest)
+    {
+        pad2(time.tm_time.tm_sec, dest);
+    }
+};
+
+template<>
+struct flag<'e'> : flag_base<time_precision::milliseconds>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        pad3(static_cast<uint32_t>(time_fraction<std::chrono::milliseconds>(msg.time).count()), dest);
+    }
+};
+
+template<>
+struct flag<'f'> : flag_base<time_precision::microseconds>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        pad3(static_cast<size_t>(time_fraction<std::chrono::microseconds>(msg.time).count()), dest);
+    }
+};
+
+template<>
+struct flag<'F'> : flag_base<time_precision::nanoseconds>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        pad3(static_cast<size_t>(time_fraction<std::chrono::nanoseconds>(msg.time).count()), dest);
+    }
+};
+
+template<>
+struct flag<'n'> : flag_base<time_precision::none, false, true, msg_field::logger_name>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        append_string_view(msg.logger_name, dest);
+    }
+};
+
+template<>
+struct flag<'l'> : flag_base<>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        append_string_view(level::to_string_view(msg.level), dest);
+    }
+};
+
+template<>
+struct flag<'t'> : flag_base<time_precision::none, false, true, msg_field::thread_id>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        append_int(msg.thread_id, dest);
+    }
+};
+
+template<>
+struct flag<'g'> : flag_base<time_precision::none, false, true, msg_field::source>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        if (!msg.source.empty())
+        {
+            append_string_view(msg.source.filename, dest);
+        }
+    }
+};
+
+template<>
+struct flag<'s'> : flag_base<time_precision::none, false, true, msg_field::source>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        if (!msg.source.empty())
+        {
+            append_string_view(os::basename(msg.source.filename), dest);
+        }
+    }
+};
+
+template<>
+struct flag<'L'> : flag_base<time_precision::none, false, true, msg_field::source>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        if (!msg.source.empty())
+        {
+            append_int(msg.source.line, dest);
+        }
+    }
+};
+
+template<>
+struct flag<'@'> : flag_base<time_precision::none, false, true, msg_field::source>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        if (!msg.source.empty())
+        {
+            append_string_view(msg.source.funname, dest);
+        }
+    }
+};
+
+template<>
+struct flag<'^'> : flag_base<time_precision::none, false, false>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        msg.color_range_start = dest.size();
+    }
+};
+
+template<>
+struct flag<'$'> : flag_base<time_precision::none, false, false>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        msg.color_range_end = dest.size();
+    }
+};
+
+template<>
+struct flag<'v'> : flag_base<>
+{
+    static void format(const log_msg& msg, const cached_time&, memory_buf_t& dest)
+    {
+        append_string_view(msg.payload, dest);
+    }
+};
+
+// only reached as "%8%", plain "%%" is folded into the user characters
+template<>
+struct flag<'%'> : flag_base<time_precision::none, true, false>
+{
+    static void format(const log_msg&, const cached_time&, memory_buf_t& dest)
+    {
+        dest.push_back('%');
+    }
+};
+
+// a flag with a width spec. Sizes aren't known before the flag appends, so
+// the field is padded or truncated after it in place.
+template<typename Flag, padding_info::pad_side Side, std::size_t Width, bool Truncate>
+struct padded : flag_base<Flag::precision, Flag::per_second, true, Flag::fields>
+{
+    static void format(const log_msg& msg, const cached_time& time, memory_buf_t& dest)
+    {
+        auto start = dest.size();
+        Flag::format(msg, time, dest);
+        pad_appended(dest, start, padding_info{ Width, Side, Truncate });
+    }
+};
+
+// user characters between flags
+template<char... Cs>
+struct literal : flag_base<time_precision::none, true>
+{
+    static void format(const log_msg&, const cached_time&, memory_buf_t& dest)
+    {
+        static constexpr char str[] = { Cs... };
+        dest.append(str, str + sizeof...(Cs));
+    }
+};
+
+constexpr msg_fields all_of(std::initializer_list<msg_fields> fields)
+{
+    auto result = msg_field::none;
+    for (auto f : fields)
+    {
+        result |= f;
+    }
+    return result;
+}
+
+constexpr time_precision finest(std::initializer_list<time_precision> precisions)
+{
+    auto result = time_precision::none;
+    for (auto precision : precisions)
+    {
+        if (precision > result)
+        {
+            result = precision;
+        }
+    }
+    return result;
+}
+
+template<typename... Flags>
+struct sequence
+{
+    static constexpr time_precision precision = finest({ time_precision::none, Flags::precision... });
+    static constexpr msg_fields fields = all_of({ msg_field::none, Flags::fields... });
+
+    static void format(const log_msg& msg, const cached_time& time, memory_buf_t& dest)
+    {
+        int expand[] = { 0, (Flags::format(msg, time, dest), 0)... };
+        (void)expand;
+    }
+};
+
+template<char... Cs>
+struct chars
+{};
+
+template<typename Sequence, typename Flag>
+struct append;
+
+template<typename... Flags, typename Flag>
+struct append<sequence<Flags...>, Flag>
+{
+    using type = sequence<Flags..., Flag>;
+};
+
+// close the pending user characters
+template<typename Sequence, typename Pending>
+struct flush
+{
+    using type = typename append<Sequence, Pending>::type;
+};
+
+template<typename Sequence>
+struct flush<Sequence, literal<>>
+{
+    using type = Sequence;
+};
+
+// same rules as pattern_formatter::compile_pattern_
+template<typename Sequence, typename Pending, typename Rest>
+struct parser;
+
+template<typename Sequence, char... Ls>
+struct parser<Sequence, literal<Ls...>, chars<>>
+{
+    using type = typename flush<Sequence, literal<Ls...>>::type;
+};
+
+// a '%' ending the pattern is dropped
+template<typename Sequence, char... Ls>
+struct parser<Sequence, literal<Ls...>, chars<'%'>> : parser<Sequence, literal<Ls...>, chars<>>
+{};
+
+template<typename Sequence, char... Ls, char C, char... Rest>
+struct parser<Sequence, literal<Ls...>, chars<C, Rest...>> : parser<Sequence, literal<Ls..., C>, chars<Rest...>>
+{};
+
+template<typename Sequence, char... Ls, char... Rest>
+struct parser<Sequence, literal<Ls...>, chars<'%', '%', Rest...>> : parser<Sequence, literal<Ls..., '%'>, chars<Rest...>>
+{};
+
+// the width spec of a flag, [!][-|=]width[!] as in pattern_formatter::handle_padspec_.
+// Stage: 0 nothing read, 1 after the leading '!', 2 after the side, 3 in the width, 4 after the closing '!'
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, typename Rest>
+struct spec_parser;
+
+template<typename Sequence, char... Ls, char F, char... Rest>
+struct parser<Sequence, literal<Ls...>, chars<'%', F, Rest...>>
+    : spec_parser<typename flush<Sequence, literal<Ls...>>::type, 0, padding_info::pad_side::left, 0, false, chars<F, Rest...>>
+{};
+
+enum class spec_action
+{
+    truncate,
+    align_left,
+    center,
+    digit,
+    flag
+};
+
+constexpr spec_action classify_spec_char(int stage, char c)
+{
+    return (c == '!' && (stage == 0 || stage == 3))  ? spec_action::truncate
+        : (c == '-' && stage <= 1)                   ? spec_action::align_left
+        : (c == '=' && stage <= 1)                   ? spec_action::center
+        : (c >= '0' && c <= '9' && stage <= 3)       ? spec_action::digit
+                                                     : spec_action::flag;
+}
+
+// pattern ends inside the spec: dropped
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate>
+struct spec_parser<Sequence, Stage, Side, Width, Truncate, chars<>> : parser<Sequence, literal<>, chars<>>
+{};
+
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, typename Rest,
+    spec_action Action = classify_spec_char(Stage, C)>
+struct spec_step;
+
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, char... Rest>
+struct spec_parser<Sequence, Stage, Side, Width, Truncate, chars<C, Rest...>>
+    : spec_step<Sequence, Stage, Side, Width, Truncate, C, chars<Rest...>>
+{};
+
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, typename Rest>
+struct spec_step<Sequence, Stage, Side, Width, Truncate, C, Rest, spec_action::truncate>
+    : spec_parser<Sequence, Stage == 0 ? 1 : 4, Side, Width, true, Rest>
+{};
+
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, typename Rest>
+struct spec_step<Sequence, Stage, Side, Width, Truncate, C, Rest, spec_action::align_left>
+    : spec_parser<Sequence, 2, padding_info::pad_side::right, Width, Truncate, Rest>
+{};
+
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, typename Rest>
+struct spec_step<Sequence, Stage, Side, Width, Truncate, C, Rest, spec_action::center>
+    : spec_parser<Sequence, 2, padding_info::pad_side::center, Width, Truncate, Rest>
+{};
+
+// widths past max_width are clamped, stop accumulating before they overflow
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, typename Rest>
+struct spec_step<Sequence, Stage, Side, Width, Truncate, C, Rest, spec_action::digit>
+    : spec_parser<Sequence, 3, Side, (Width > padding_info::max_width ? Width : Width * 10 + static_cast<std::size_t>(C - '0')), Truncate, Rest>
+{};
+
+// no width read: the spec is dropped and the flag is not padded
+template<typename Sequence, int Stage, padding_info::pad_side Side, std::size_t Width, bool Truncate, char C, typename Rest>
+struct spec_step<Sequence, Stage, Side, Width, Truncate, C, Rest, spec_action::flag>
+    : parser<typename append<Sequence,
+                 typename std::conditional<(Stage >= 3 && flag<C>::paddable), padded<flag<C>, Side, Width, Truncate>, flag<C>>::type>::type,
+          literal<>, Rest>
+{};
+
+constexpr std::size_t length(const char* str)
+{
+    std::size_t n = 0;
+    while (str[n] != '\0')
+    {
+        ++n;
+    }
+    return n;
+}
+
+template<typename String, std::size_t... I>
+chars<String::value()[I]...> to_chars(std::index_sequence<I...>);
+
+// String::value() returns the pattern, see MYLOG_PATTERN
+template<typename String>
+using parse = typename parser<sequence<>, literal<>,
+    decltype(to_chars<String>(std::make_index_sequence<length(String::value())>{}))>::type;
+
+template<typename Flag, typename Sequence>
+struct prepend;
+
+template<typename Flag, typename... Flags>
+struct prepend<Flag, sequence<Flags...>>
+{
+    using type = sequence<Flag, Flags...>;
+};
+
+// leading per_second flags and the rest
+template<typename Sequence>
+struct split_per_second;
+
+template<bool PerSecond, typename Flag, typename... Flags>
+struct split_per_second_;
+
+template<>
+struct split_per_second<sequence<>>
+{
+    using prefix = sequence<>;
+    using rest = sequence<>;
+};
+
+template<typename Flag, typename... Flags>
+struct split_per_second<sequence<Flag, Flags...>> : split_per_second_<Flag::per_second, Flag, Flags...>
+{};
+
+template<typename Flag, typename... Flags>
+struct split_per_second_<false, Flag, Flags...>
+{
+    using prefix = sequence<>;
+    using rest = sequence<Flag, Flags...>;
+};
+
+template<typename Flag, typename... Flags>
+struct split_per_second_<true, Flag, Flags...>
+{
+    using prefix = typename prepend<Flag, typename split_per_second<sequence<Flags...>>::prefix>::type;
+    using rest = typename split_per_second<sequence<Flags...>>::rest;
+};
+
+} // namespace static_pattern
+} // namespace details
+
+// Formatter for a pattern known at compile time, with the same flags and
+// output as pattern_formatter. Flags is a parsed pattern, build one with
+// make_static_formatter(MYLOG_PATTERN("...")).
+// A leading date and time like "[%Y-%m-%d %H:%M:%S." is formatted once per second.
+template<typename Flags>
+class static_pattern_formatter final : public formatter
+{
+    using split = details::static_pattern::split_per_second<Flags>;
+    // cache the prefix only if it prints the time
+    static constexpr bool cache_prefix = split::prefix::precision != time_precision::none;
+    using prefix = typename std::conditional<cache_prefix, typename split::prefix, details::static_pattern::sequence<>>::type;
+    using rest = typename std::conditional<cache_prefix, typename split::rest, Flags>::type;
+
+public:
+    explicit static_pattern_formatter(pattern_time_type time_type = pattern_time_type::local)
+        : time_type_(time_type)
+    {
+        std::memset(&time_.tm_time, 0, sizeof(time_.tm_time));
+    }
+
+    void format(const details::log_msg& msg, memory_buf_t& dest) override
+    {
+        if (Flags::precision != time_precision::none)
+        {
+            auto sec = std::chrono::duration_cast<std::chrono::seconds>(msg.time.time_since_epoch());
+            if (sec != time_.secs)
+            {
+                details::time_cache::get(sec, time_, time_type_);
+                prefix_.clear();
+                prefix::format(msg, time_, prefix_);
+            }
+            dest.append(prefix_.begin(), prefix_.end());
+        }
+
+        rest::format(msg, time_, dest);
+        dest.push_back('\n');
+    }
+
+    std::unique_ptr<formatter> clone() const override
+    {
+        return std::make_unique<static_pattern_formatter>(time_type_);
+    }
+
+    time_precision precision() const override
+    {
+        return Flags::precision;
+    }
+
+    msg_fields fields() const override
+    {
+        return Flags::fields;
+    }
+
+    bool equivalent(const formatter& other) const override
+    {
+        auto* other_static = dynamic_cast<const static_pattern_formatter*>(&other);
+        return other_static != nullptr && other_static->time_type_ == time_type_;
+    }
+
+private:
+    pattern_time_type time_type_;
+    details::cached_time time_;      // from details::time_cache
+    memory_buf_t prefix_;   // output of the prefix flags for time_
+};
+
+// A pattern string as a type, for make_static_formatter().
+#define MYLOG_PATTERN(pattern) \
+    [] { \
+        struct pattern_string \
+        { \
+            static constexpr const char* value() \
+            { \
+                return pattern; \
+            } \
+        }; \
+        return pattern_string{}; \
+    }()
+
+// Example:
+//   logger->set_formatter(mylog::make_static_formatter(MYLOG_PATTERN("[%H:%M:%S.%e] [%l] %v")));
+template<typename String>
+std::unique_ptr<static_pattern_formatter<details::static_pattern::parse<String>>> make_static_formatter(
+    String, pattern_time_type time_type = pattern_time_type::local)
+{
+    return std::make_unique<static_pattern_formatter<details::static_pattern::parse<String>>>(time_type);
+}
+
+} // namespace mylog
@@ -19,13 +19,21 @@
 #define MYLOG_ACTIVE_LEVEL MYLOG_LEVEL_DEBUG
 
 #include "log/pattern_formatter.h"
+#include "log/static_pattern_formatter.h"
 #include "log/common.h"
 #include "log/details/file_helper.h"
+#include "log/details/fd_file_helper.h"
 #include "log/mylog.h"
 #include "log/details/os.h"
+#include "log/details/time_cache.h"
+#include "log/details/time_zone.h"
+#include "log/details/scratch_buffer.h"
 #include "log/sinks/basic_file_sink.h"
 #include "log/sinks/rotating_file_sink.h"
 #include "log/sinks/daily_file_sink.h"
 #include "log/details/mpmc_blocking_queue.h"
+#include "log/details/mpmc_lockfree_queue.h"
+#include "log/details/spsc_merge_queue.h"
+#include "log/details/byte_ring_queue.h"
 
 #define MYLOG_FILENAME_T(t) t
\ No newline at end of file
@@ -0,0 +1,171 @@
+#include "includes.h"
+
+#include "log/async.h"
+#include "log/sinks/rotating_file_sink.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// counts the allocations of all threads while counting is on, so the async
+// workers are counted too. the only other threads are the ones the tests start
+static std::atomic<bool> counting{ false };
+static std::atomic<size_t> allocations{ 0 };
+
+static void *counted_alloc(std::size_t size) noexcept
+{
+    if (counting.load(std::memory_order_relaxed))
+    {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new(std::size_t size)
+{
+    if (void *ptr = counted_alloc(size))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return counted_alloc(size);
+}
+
+// the replacements pair malloc with free, gcc only sees operator new and free
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    std::free(ptr);
+}
+#pragma GCC diagnostic pop
+
+template<typename Fn>
+static size_t count_allocations(Fn fn)
+{
+    allocations = 0;
+    counting = true;
+    fn();
+    counting = false;
+    return allocations.load();
+}
+
+TEST_CASE("no allocations for long messages", "[scratch_buffer]")
+{
+    prepare_logdir();
+    auto logger = mylog::create<mylog::sinks::basic_file_sink_mt>("alloc_logger", "test_logs/alloc_log");
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%l] %v");
+
+    std::string request(3000, 'x');
+    auto log_requests = [&] {
+        for (int i = 0; i < 100; i++)
+        {
+            logger->info("request {}: {}", i, request);
+        }
+    };
+
+    // the scratch buffers grow on the first message, then are reused
+    log_requests();
+    REQUIRE(count_allocations(log_requests) == 0);
+
+    // logging while the buffer is in use gets a buffer of its own
+    auto inner = mylog::create<mylog::sinks::basic_file_sink_mt>("alloc_inner", "test_logs/alloc_log");
+    inner->set_pattern("%v");
+    mylog::details::scratch_buffer<mylog::details::payload_buffer_tag> outer;
+    outer.get().append(request.data(), request.data() + request.size());
+    inner->info("inner {}", 1);
+    REQUIRE(fmt::to_string(outer.get()) == request);
+
+    mylog::drop("alloc_logger");
+    mylog::drop("alloc_inner");
+}
+
+static void test_async_allocations(mylog::sink_ptr sink, size_t threads, mylog::async_lane_policy lane_policy)
+{
+    // small batches, so allocating once per batch would show
+    auto tp = std::make_shared<mylog::details::thread_pool>(
+        1024 * 1024, threads, mylog::async_queue_type::byte_ring, 4, mylog::async_wait_strategy::park, lane_policy);
+    auto logger = std::make_shared<mylog::async_logger>("alloc_async", sink, tp);
+    logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%n] [%l] %v");
+
+    std::string request(3000, 'x');
+    auto log_requests = [&] {
+        for (int i = 0; i < 100; i++)
+        {
+            logger->info("request {}: {}", i, request);
+        }
+        logger->flush_async().get();
+    };
+
+    // the records are written into the ring and the message buffers are kept
+    // once grown, only the flush barrier allocates, whatever the message count.
+    // on lanes every slot of the batches and of the lane ring grows first
+    for (int i = 0; i < 10; i++)
+    {
+        log_requests();
+    }
+    REQUIRE(count_allocations(log_requests) < 20);
+}
+
+TEST_CASE("no allocations for long async messages", "[scratch_buffer]")
+{
+    prepare_logdir();
+    auto sink = std::make_shared<mylog::sinks::basic_file_sink_mt>("test_logs/alloc_async_log");
+    test_async_allocations(sink, 1, mylog::async_lane_policy::shared);
+}
+
+TEST_CASE("no allocations for long async messages on lanes", "[scratch_buffer]")
+{
+    // the messages go through the dispatcher's batch, a lane ring and the lane's
+    // batch: their buffers are swapped along the way, not moved and regrown
+    prepare_logdir();
+    auto sink = std::make_shared<mylog::sinks::basic_file_sink_mt>("test_logs/alloc_async_log");
+    test_async_allocations(sink, 2, mylog::async_lane_policy::per_logger);
+}
+
+TEST_CASE("no allocations for long async messages to a rotating file", "[scratch_buffer]")
+{
+    // large enough to never rotate: renaming the files allocates
+    prepare_logdir();
+    auto sink = std::make_shared<mylog::sinks::rotating_file_sink_mt>("test_logs/alloc_async_rotating_log", 64 * 1024 * 1024, 1);
+    test_async_allocations(sink, 1, mylog::async_lane_policy::shared);
+}
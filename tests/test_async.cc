@@ -3,6 +3,8 @@
 #include "log/sinks/basic_file_sink.h"
 #include "test_sink.h"
 
+#include <map>
+
 #define TEST_FILENAME "test_logs/async_test.log"
 
 TEST_CASE("basic async test", "[async]")
@@ -82,6 +84,111 @@ TEST_CASE("flush", "[async]")
     REQUIRE(test_sink->flush_counter() == 1);
 }
 
+TEST_CASE("flush barrier", "[async]")
+{
+    size_t messages = 256;
+    for (auto lane_policy : {mylog::async_lane_policy::shared, mylog::async_lane_policy::per_logger})
+    {
+        auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+        auto tp = std::make_shared<mylog::details::thread_pool>(
+            64, 3, mylog::async_queue_type::blocking, 8, mylog::async_wait_strategy::park, lane_policy);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+        for (size_t i = 0; i < messages; i++)
+        {
+            logger->info("Hello message #{}", i);
+        }
+
+        logger->flush_async().get();
+        REQUIRE(test_sink->msg_counter() == messages);
+        REQUIRE(test_sink->flush_counter() == 1);
+
+        test_sink->set_delay(std::chrono::milliseconds(5));
+        for (size_t i = 0; i < 20; i++)
+        {
+            logger->info("Hello message #{}", i);
+        }
+        REQUIRE_FALSE(logger->flush_for(std::chrono::milliseconds(1)));
+        REQUIRE(logger->flush_for(std::chrono::seconds(10)));
+        REQUIRE(test_sink->msg_counter() == messages + 20);
+    }
+}
+
+TEST_CASE("flush barriers on a full queue", "[async]")
+{
+    // workers passing barrier messages on to each other must not block on the
+    // full queue they are draining
+    size_t loggers = 4;
+    size_t rounds = 20;
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    auto tp = std::make_shared<mylog::details::thread_pool>(4, 4, mylog::async_queue_type::blocking, 1);
+    std::vector<std::thread> producers;
+    for (size_t l = 0; l < loggers; l++)
+    {
+        producers.emplace_back([&, l] {
+            auto logger = std::make_shared<mylog::async_logger>("barrier_logger" + std::to_string(l), test_sink, tp);
+            for (size_t r = 0; r < rounds; r++)
+            {
+                for (int i = 0; i < 10; i++)
+                {
+                    logger->info("Hello message #{}", i);
+                }
+                logger->flush_async().get();
+            }
+        });
+    }
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+    REQUIRE(test_sink->msg_counter() == loggers * rounds * 10);
+    REQUIRE(test_sink->flush_counter() == loggers * rounds);
+}
+
+TEST_CASE("shutdown with deadline", "[async]")
+{
+    for (auto lane_policy : {mylog::async_lane_policy::shared, mylog::async_lane_policy::per_logger})
+    {
+        auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+        auto tp = std::make_shared<mylog::details::thread_pool>(
+            256, 2, mylog::async_queue_type::blocking, 8, mylog::async_wait_strategy::park, lane_policy);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+        for (size_t i = 0; i < 100; i++)
+        {
+            logger->info("Hello message #{}", i);
+        }
+
+        auto stats = tp->shutdown(std::chrono::seconds(10));
+        REQUIRE(stats.drained);
+        REQUIRE(stats.dropped == 0);
+        REQUIRE(test_sink->msg_counter() == 100);
+        REQUIRE(test_sink->flush_counter() == 1);
+
+        // refused once shut down
+        logger->info("Too late");
+        REQUIRE(logger->dropped_count() == 1);
+        REQUIRE(tp->shutdown(std::chrono::seconds(10)).rejected == 1);
+        REQUIRE(logger->flush_for(std::chrono::seconds(1)));
+        logger.reset();
+        REQUIRE(test_sink->msg_counter() == 100);
+    }
+
+    // a slow sink: whatever is still queued at the deadline is dropped
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    test_sink->set_delay(std::chrono::milliseconds(5));
+    auto tp = std::make_shared<mylog::details::thread_pool>(256, 1);
+    auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+    size_t messages = 200;
+    for (size_t i = 0; i < messages; i++)
+    {
+        logger->info("Hello message #{}", i);
+    }
+    auto stats = tp->shutdown(std::chrono::milliseconds(50));
+    REQUIRE_FALSE(stats.drained);
+    REQUIRE(stats.dropped > 0);
+    REQUIRE(test_sink->msg_counter() + stats.dropped == messages);
+    REQUIRE(test_sink->flush_counter() == 1);
+}
+
 TEST_CASE("async periodic flush", "[async]")
 {
     auto logger = mylog::create_async<mylog::sinks::test_sink_mt>("async_logger");
@@ -108,11 +215,47 @@ TEST_CASE("tp->wait_empty() ", "[async]")
     }
     logger->flush();
     tp.reset();
+    // the logger keeps the pool alive: destroying it waits for its messages
+    logger.reset();
 
     REQUIRE(test_sink->msg_counter() == messages);
     REQUIRE(test_sink->flush_counter() == 1);
 }
 
+TEST_CASE("pool released while logging", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    size_t n_threads = 4;
+    size_t messages = 2000;
+
+    auto tp = std::make_shared<mylog::details::thread_pool>(128, 1);
+    auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::block);
+    std::atomic<size_t> started{0};
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < n_threads; i++)
+    {
+        threads.emplace_back([&] {
+            started++;
+            for (size_t j = 0; j < messages; j++)
+            {
+                logger->info("Hello message #{}", j);
+            }
+        });
+    }
+    while (started < n_threads)
+    {
+        std::this_thread::yield();
+    }
+    tp.reset();
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    logger.reset();
+
+    REQUIRE(test_sink->msg_counter() == n_threads * messages);
+}
+
 TEST_CASE("multi threads", "[async]")
 {
     auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
@@ -186,3 +329,883 @@ TEST_CASE("to_file multi-workers", "[async]")
 
     require_message_count(TEST_FILENAME, messages);
 }
+
+TEST_CASE("multi threads lockfree queue", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    size_t queue_size = 128;
+    size_t messages = 256;
+    size_t n_threads = 10;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(queue_size, 1, mylog::async_queue_type::lockfree);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::block);
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            threads.emplace_back([logger, messages] {
+                for (size_t j = 0; j < messages; j++)
+                {
+                    logger->info("Hello message #{}", j);
+                }
+            });
+        }
+
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        logger->flush();
+    }
+
+    REQUIRE(test_sink->msg_counter() == messages * n_threads);
+    REQUIRE(test_sink->flush_counter() == 1);
+}
+
+TEST_CASE("discard policy lockfree queue", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    test_sink->set_delay(std::chrono::milliseconds(1));
+    size_t queue_size = 4;
+    size_t messages = 1024;
+
+    auto tp = std::make_shared<mylog::details::thread_pool>(queue_size, 1, mylog::async_queue_type::lockfree);
+    auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::overrun_oldest);
+    for (size_t i = 0; i < messages; i++)
+    {
+        logger->info("Hello message");
+    }
+    REQUIRE(test_sink->msg_counter() < messages);
+    REQUIRE(tp->overrun_counter() > 0);
+}
+
+TEST_CASE("multi threads per-thread queues", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    size_t queue_size = 64;
+    size_t messages = 256;
+    size_t n_threads = 10;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(queue_size, 1, mylog::async_queue_type::per_thread);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::block);
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            threads.emplace_back([logger, messages] {
+                for (size_t j = 0; j < messages; j++)
+                {
+                    logger->info("Hello message #{}", j);
+                }
+            });
+        }
+
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        logger->flush();
+    }
+
+    REQUIRE(test_sink->msg_counter() == messages * n_threads);
+    REQUIRE(test_sink->flush_counter() == 1);
+}
+
+TEST_CASE("logger destroyed before its messages are processed", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    test_sink->set_delay(std::chrono::milliseconds(1));
+    size_t messages = 64;
+    size_t tp_threads = 4;
+
+    auto tp = std::make_shared<mylog::details::thread_pool>(messages, tp_threads);
+    {
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+        for (size_t i = 0; i < messages; i++)
+        {
+            logger->info("Hello message #{}", i);
+        }
+        // the destructor waits for the queued messages
+    }
+    REQUIRE(test_sink->msg_counter() == messages);
+
+    // the released handle is reused by the next logger
+    auto logger = std::make_shared<mylog::async_logger>("async_logger2", test_sink, tp);
+    logger->info("Hello again");
+    logger.reset();
+    REQUIRE(test_sink->msg_counter() == messages + 1);
+}
+
+// drops the last reference to a logger from the thread pool's worker
+class releasing_sink : public mylog::sinks::base_sink<std::mutex>
+{
+public:
+    explicit releasing_sink(std::shared_ptr<mylog::logger> held)
+        : held_(std::move(held))
+    {}
+
+    bool released()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return held_ == nullptr;
+    }
+
+protected:
+    void sink_it_(const mylog::details::log_msg &) override
+    {
+        held_.reset();
+    }
+
+    void flush_() override {}
+
+private:
+    std::shared_ptr<mylog::logger> held_;
+};
+
+TEST_CASE("logger destroyed on a worker thread", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    size_t messages = 16;
+
+    auto tp = std::make_shared<mylog::details::thread_pool>(128, 1);
+    auto held = std::make_shared<mylog::async_logger>("held", test_sink, tp);
+    REQUIRE(held->shared_from_this() == held);
+    for (size_t i = 0; i < messages; i++)
+    {
+        held->info("Hello message #{}", i);
+    }
+    auto sink = std::make_shared<releasing_sink>(std::move(held));
+    auto logger = std::make_shared<mylog::async_logger>("releasing", sink, tp);
+    std::weak_ptr<mylog::details::thread_pool> weak_tp = tp;
+    tp.reset();
+
+    // the destructor runs on the worker and must not wait for itself, nor
+    // destroy the pool there
+    logger->info("release");
+    logger->flush_async().wait();
+    REQUIRE(sink->released());
+    REQUIRE(test_sink->msg_counter() == messages);
+
+    // the pool goes with its last logger, whichever thread drops it
+    logger.reset();
+    for (int i = 0; i < 1000 && !weak_tp.expired(); i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    REQUIRE(weak_tp.expired());
+}
+
+TEST_CASE("cloned async logger", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    size_t messages = 100;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(128, 2);
+        auto logger = std::make_shared<mylog::async_logger>("orig", test_sink, tp);
+        auto cloned = logger->clone("clone");
+        for (size_t i = 0; i < messages; i++)
+        {
+            logger->info("Hello message");
+            cloned->info("Hello message");
+        }
+        logger.reset();
+        cloned->info("Last message");
+    }
+    REQUIRE(test_sink->msg_counter() == 2 * messages + 1);
+}
+
+struct point
+{
+    int x;
+    int y;
+};
+
+template<>
+struct fmt::formatter<point> : fmt::formatter<std::string>
+{
+    auto format(point p, format_context &ctx) const -> decltype(ctx.out())
+    {
+        return fmt::format_to(ctx.out(), "({}, {})", p.x, p.y);
+    }
+};
+
+TEST_CASE("deferred formatting", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(128, 1);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+        logger->set_pattern("%v");
+        logger->set_deferred_formatting(true);
+        REQUIRE(logger->deferred_formatting());
+
+        logger->info("x={} y={:.2f} c={} b={}", 42, 3.14159, 'c', true);
+        {
+            std::string temp = "temporary";
+            char chars[] = "chars";
+            logger->info("{} {} {}", temp, chars, "literal");
+        }
+        logger->info("{:>6}|{:<4}|", mylog::string_view_t("ab"), -1L);
+        logger->info("no args");
+        logger->info("{}", std::vector<int>{}.size());
+        // not deferrable, formatted on the calling thread
+        logger->info("{} {}", point{1, 2}, 3);
+    }
+
+    auto lines = test_sink->lines();
+    REQUIRE(lines.size() == 6);
+    REQUIRE(lines[0] == "x=42 y=3.14 c=c b=true");
+    REQUIRE(lines[1] == "temporary chars literal");
+    REQUIRE(lines[2] == "    ab|-1  |");
+    REQUIRE(lines[3] == "no args");
+    REQUIRE(lines[4] == "0");
+    REQUIRE(lines[5] == "(1, 2) 3");
+}
+
+TEST_CASE("deferred formatting null string", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    std::string err_msg;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(128, 1);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+        logger->set_pattern("%v");
+        logger->set_deferred_formatting(true);
+        logger->set_error_handler([&err_msg](const std::string &msg) { err_msg = msg; });
+
+        // formatted on the calling thread, where fmt rejects it as usual
+        const char *null_str = nullptr;
+        logger->info("{} {}", 1, null_str);
+        logger->info("{} {}", 2, "ok");
+    }
+
+    REQUIRE(err_msg == "string pointer is null");
+    auto lines = test_sink->lines();
+    REQUIRE(lines.size() == 1);
+    REQUIRE(lines[0] == "2 ok");
+}
+
+TEST_CASE("multi threads byte ring queue", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    size_t queue_bytes = 4096;
+    size_t messages = 256;
+    size_t n_threads = 10;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(queue_bytes, 2, mylog::async_queue_type::byte_ring);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::block);
+        logger->set_deferred_formatting(true);
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < n_threads; i++)
+        {
+            threads.emplace_back([logger, messages] {
+                for (size_t j = 0; j < messages; j++)
+                {
+                    logger->info("Hello message #{} {}", j, std::string(j, 'x'));
+                }
+            });
+        }
+
+        for (auto &t : threads)
+        {
+            t.join();
+        }
+        logger->flush();
+    }
+
+    REQUIRE(test_sink->msg_counter() == messages * n_threads);
+    REQUIRE(test_sink->flush_counter() == 1);
+}
+
+TEST_CASE("byte budget", "[async]")
+{
+    size_t max_bytes = 4096;
+    size_t messages = 1024;
+    mylog::init_thread_pool_bytes(max_bytes, 1);
+    auto tp = mylog::thread_pool();
+    REQUIRE(tp->queue_capacity_bytes() == max_bytes);
+    REQUIRE(tp->queue_bytes() == 0);
+
+    auto logger = mylog::create_async_nb<mylog::sinks::test_sink_mt>("async_logger");
+    auto test_sink = std::static_pointer_cast<mylog::sinks::test_sink_mt>(logger->sinks()[0]);
+    test_sink->set_delay(std::chrono::milliseconds(1));
+    for (size_t i = 0; i < messages; i++)
+    {
+        logger->info("Hello message {}", std::string(100, 'x'));
+    }
+
+    REQUIRE(tp->overrun_counter() > 0);
+    REQUIRE(tp->queue_bytes() <= max_bytes);
+    REQUIRE(tp->peak_queue_bytes() <= max_bytes);
+    REQUIRE(tp->peak_queue_bytes() > max_bytes / 2);
+
+    // a budget too small for shutting the pool down is rejected up front
+    REQUIRE_THROWS_AS(mylog::init_thread_pool_bytes(64, 1), mylog::log_ex);
+    REQUIRE(mylog::thread_pool() == tp);
+    mylog::drop_all();
+}
+
+TEST_CASE("wait strategies", "[async]")
+{
+    size_t messages = 512;
+    for (auto queue_type : {mylog::async_queue_type::blocking, mylog::async_queue_type::byte_ring, mylog::async_queue_type::lockfree})
+    {
+        for (auto strategy : {mylog::async_wait_strategy::park, mylog::async_wait_strategy::busy_spin,
+                 mylog::async_wait_strategy::spin_yield, mylog::async_wait_strategy::spin_park})
+        {
+            auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+            {
+                auto tp = std::make_shared<mylog::details::thread_pool>(
+                    4096, 2, queue_type, mylog::details::thread_pool::default_batch_size, strategy);
+                auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+                for (size_t i = 0; i < messages; i++)
+                {
+                    logger->info("Hello message #{}", i);
+                }
+            }
+            REQUIRE(test_sink->msg_counter() == messages);
+        }
+    }
+}
+
+TEST_CASE("discard_new policy", "[async]")
+{
+    size_t messages = 256;
+    for (auto queue_type : {mylog::async_queue_type::blocking, mylog::async_queue_type::lockfree, mylog::async_queue_type::per_thread,
+             mylog::async_queue_type::byte_ring})
+    {
+        auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+        test_sink->set_delay(std::chrono::milliseconds(1));
+        size_t queue_size = queue_type == mylog::async_queue_type::byte_ring ? 1024 : 4;
+        {
+            auto tp = std::make_shared<mylog::details::thread_pool>(queue_size, 1, queue_type);
+            auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::discard_new);
+            for (size_t i = 0; i < messages; i++)
+            {
+                logger->info("Hello message #{}", i);
+                logger->error("Hello message #{}", i);
+            }
+
+            REQUIRE(logger->dropped_count(mylog::level::info) > 0);
+            REQUIRE(logger->dropped_count(mylog::level::error) > 0);
+            REQUIRE(logger->dropped_count(mylog::level::warning) == 0);
+            REQUIRE(logger->dropped_count() == logger->dropped_count(mylog::level::info) + logger->dropped_count(mylog::level::error));
+            // the new messages are the ones dropped, nothing was overrun
+            REQUIRE(tp->overrun_counter() == 0);
+            auto dropped = logger->dropped_count();
+            logger.reset();
+            REQUIRE(test_sink->msg_counter() == 2 * messages - dropped);
+        }
+    }
+}
+
+// counts how many times it was formatted
+struct format_counted
+{
+    static size_t formats;
+};
+
+size_t format_counted::formats = 0;
+
+template<>
+struct fmt::formatter<format_counted> : fmt::formatter<std::string>
+{
+    auto format(format_counted, format_context &ctx) const -> decltype(ctx.out())
+    {
+        format_counted::formats++;
+        return fmt::format_to(ctx.out(), "counted");
+    }
+};
+
+TEST_CASE("try_log", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    test_sink->set_delay(std::chrono::milliseconds(1));
+    size_t messages = 256;
+    size_t accepted = 0;
+    format_counted::formats = 0;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(4, 1);
+        // the logger blocks, but try_log never does
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp, mylog::async_overflow_policy::block);
+        for (size_t i = 0; i < messages; i++)
+        {
+            if (logger->try_log(mylog::level::info, "Hello message #{} {}", i, format_counted{}))
+            {
+                accepted++;
+            }
+        }
+        REQUIRE(accepted < messages);
+        REQUIRE(logger->dropped_count(mylog::level::info) == messages - accepted);
+        // only this thread fills the queue: a message found room once it was formatted,
+        // the dropped ones were never formatted
+        REQUIRE(format_counted::formats == accepted);
+
+        // filtered by level: nothing to drop
+        REQUIRE(logger->try_log(mylog::level::trace, "Filtered message"));
+    }
+    REQUIRE(test_sink->msg_counter() == accepted);
+}
+
+// records whether the messages of each logger arrive in order, and whether
+// the sink was ever written by two threads at once
+class ordered_sink : public mylog::sinks::base_sink<mylog::details::null_mutex>
+{
+public:
+    size_t count() const
+    {
+        return count_;
+    }
+
+    bool in_order() const
+    {
+        return in_order_;
+    }
+
+    bool overlapped() const
+    {
+        return overlapped_;
+    }
+
+    // reads the logger name itself, the "%v" pattern doesn't print it
+    mylog::msg_fields fields() const override
+    {
+        return base_sink::fields() | mylog::msg_field::logger_name;
+    }
+
+protected:
+    void sink_it_(const mylog::details::log_msg &msg) override
+    {
+        if (busy_.exchange(true))
+        {
+            overlapped_ = true;
+        }
+        auto &expected = next_[std::string(msg.logger_name.data(), msg.logger_name.size())];
+        if (std::stoul(std::string(msg.payload.data(), msg.payload.size())) != expected++)
+        {
+            in_order_ = false;
+        }
+        // slow enough for lanes to build a backlog
+        if (++count_ % 64 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        busy_.store(false);
+    }
+
+    void flush_() override {}
+
+private:
+    std::atomic<bool> busy_{false};
+    std::map<std::string, size_t> next_;
+    size_t count_{0};
+    bool in_order_{true};
+    bool overlapped_{false};
+};
+
+TEST_CASE("ordered lanes", "[async]")
+{
+    size_t messages = 10000;
+    for (auto policy : {mylog::async_lane_policy::per_logger, mylog::async_lane_policy::per_sink})
+    {
+        // with per_sink, pairs of loggers share a sink
+        std::vector<std::shared_ptr<ordered_sink>> sinks;
+        for (size_t i = 0; i < 4; i++)
+        {
+            sinks.push_back(std::make_shared<ordered_sink>());
+        }
+        {
+            auto tp = std::make_shared<mylog::details::thread_pool>(
+                1024, 2, mylog::async_queue_type::blocking, 16, mylog::async_wait_strategy::park, policy);
+            std::vector<std::shared_ptr<mylog::async_logger>> loggers;
+            for (size_t i = 0; i < 4; i++)
+            {
+                auto &sink = policy == mylog::async_lane_policy::per_sink ? sinks[i / 2] : sinks[i];
+                loggers.push_back(std::make_shared<mylog::async_logger>("logger" + std::to_string(i), sink, tp));
+                loggers.back()->set_pattern("%v");
+            }
+
+            // with per_logger, loggers 0 and 2 share the first lane and only
+            // they keep logging, so one of them is moved while its lane is busy
+            for (size_t i = 0; i < 4; i++)
+            {
+                loggers[i]->info("0");
+            }
+            for (size_t j = 1; j < messages; j++)
+            {
+                loggers[0]->info("{}", j);
+                loggers[2]->info("{}", j);
+            }
+        }
+
+        size_t total = 2 * messages + 2;
+        size_t received = 0;
+        for (auto &sink : sinks)
+        {
+            REQUIRE(sink->in_order());
+            REQUIRE_FALSE(sink->overlapped());
+            received += sink->count();
+        }
+        REQUIRE(received == total);
+    }
+}
+
+TEST_CASE("ordered lanes with overlapping sinks", "[async]")
+{
+    size_t messages = 4000;
+    std::vector<std::shared_ptr<ordered_sink>> sinks;
+    for (size_t i = 0; i < 4; i++)
+    {
+        sinks.push_back(std::make_shared<ordered_sink>());
+    }
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(
+            1024, 2, mylog::async_queue_type::blocking, 16, mylog::async_wait_strategy::park, mylog::async_lane_policy::per_sink);
+        auto make_logger = [&](const std::string &name, mylog::sinks_init_list logger_sinks) {
+            auto logger = std::make_shared<mylog::async_logger>(name, logger_sinks, tp);
+            logger->set_pattern("%v");
+            return logger;
+        };
+        // a and b share only the second sink of a
+        auto a = make_logger("a", {sinks[0], sinks[1]});
+        auto b = make_logger("b", {sinks[1]});
+        auto c = make_logger("c", {sinks[2]});
+        auto d = make_logger("d", {sinks[3]});
+        for (size_t j = 0; j < messages / 2; j++)
+        {
+            a->info("{}", j);
+            b->info("{}", j);
+            c->info("{}", j);
+            d->info("{}", j);
+        }
+
+        // m joins the groups of a and d while their lanes may be busy
+        auto m = make_logger("m", {sinks[3], sinks[0]});
+        for (size_t j = messages / 2; j < messages; j++)
+        {
+            a->info("{}", j);
+            b->info("{}", j);
+            c->info("{}", j);
+            d->info("{}", j);
+            m->info("{}", j - messages / 2);
+        }
+    }
+
+    for (auto &sink : sinks)
+    {
+        REQUIRE(sink->in_order());
+        REQUIRE_FALSE(sink->overlapped());
+    }
+    REQUIRE(sinks[0]->count() == messages + messages / 2);
+    REQUIRE(sinks[1]->count() == 2 * messages);
+    REQUIRE(sinks[2]->count() == messages);
+    REQUIRE(sinks[3]->count() == messages + messages / 2);
+}
+
+TEST_CASE("ordered lanes with a sink added later", "[async]")
+{
+    size_t messages = 4000;
+    auto first = std::make_shared<ordered_sink>();
+    auto second = std::make_shared<ordered_sink>();
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(
+            1024, 2, mylog::async_queue_type::blocking, 16, mylog::async_wait_strategy::park, mylog::async_lane_policy::per_sink);
+        auto a = std::make_shared<mylog::async_logger>("a", first, tp);
+        auto b = std::make_shared<mylog::async_logger>("b", second, tp);
+        a->set_pattern("%v");
+        b->set_pattern("%v");
+        for (size_t j = 0; j < messages / 2; j++)
+        {
+            a->info("{}", j);
+            b->info("{}", j);
+        }
+
+        // b now writes the sink of a as well, while a's lane may be busy.
+        // b's own queued messages would be written to the new sink too
+        b->flush_async().wait();
+        b->sinks().push_back(first);
+        for (size_t j = messages / 2; j < messages; j++)
+        {
+            a->info("{}", j);
+            b->info("{}", j);
+        }
+    }
+
+    // b's messages start halfway in the first sink, only the second one sees them all
+    REQUIRE(second->in_order());
+    REQUIRE_FALSE(first->overlapped());
+    REQUIRE_FALSE(second->overlapped());
+    REQUIRE(first->count() == messages + messages / 2);
+    REQUIRE(second->count() == messages);
+}
+
+TEST_CASE("thread pool options", "[async]")
+{
+    auto test_sink = std::make_shared<mylog::sinks::test_sink_mt>();
+    std::atomic<int> started{0};
+    std::atomic<int> stopped{0};
+    std::atomic<int> named{0};
+    std::atomic<int> pinned{0};
+
+    mylog::details::thread_pool_options options;
+    options.thread_name = "mylog-test";
+    options.thread_cpus = {{0}};
+    options.sched_policy = mylog::thread_sched_policy::batch;
+    options.nice = 1;
+    options.on_thread_start = [&] {
+        started++;
+        char name[16];
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        if (std::string(name).find("mylog-test-") == 0)
+        {
+            named++;
+        }
+        cpu_set_t set;
+        pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+        if (CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set))
+        {
+            pinned++;
+        }
+    };
+    options.on_thread_stop = [&] { stopped++; };
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(128, 2, options);
+        auto logger = std::make_shared<mylog::async_logger>("async_logger", test_sink, tp);
+        logger->info("Hello message");
+    }
+    REQUIRE(test_sink->msg_counter() == 1);
+    REQUIRE(started == 2);
+    REQUIRE(stopped == 2);
+    REQUIRE(named == 2);
+    REQUIRE(pinned == 2);
+
+    // with lanes the dispatcher is one more thread
+    started = 0;
+    options.lane_policy = mylog::async_lane_policy::per_logger;
+    {
+        mylog::details::thread_pool tp(128, 2, options);
+    }
+    REQUIRE(started == 3);
+
+    // a thread that cannot be set up fails the construction
+    options.thread_cpus = {{CPU_SETSIZE - 1}};
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(128, 2, options), mylog::log_ex);
+    options.thread_cpus.clear();
+    options.on_thread_start = [] { throw std::runtime_error("start hook"); };
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(128, 2, options), std::runtime_error);
+
+    // the other threads are still stopped: two workers and the dispatcher, one fails
+    started = 0;
+    stopped = 0;
+    options.on_thread_start = [&] {
+        if (started++ == 1)
+        {
+            throw std::runtime_error("start hook");
+        }
+    };
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(128, 2, options), std::runtime_error);
+    REQUIRE(started == 3);
+    REQUIRE(stopped == 2);
+}
+
+// keeps the time and tsc ticks of the last message
+class time_sink : public mylog::sinks::base_sink<std::mutex>
+{
+public:
+    mylog::log_clock::time_point last_time()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_time_;
+    }
+
+    std::uint64_t last_tsc_ticks()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_tsc_ticks_;
+    }
+
+protected:
+    void sink_it_(const mylog::details::log_msg &msg) override
+    {
+        last_time_ = msg.time;
+        last_tsc_ticks_ = msg.tsc_ticks;
+    }
+
+    void flush_() override {}
+
+private:
+    mylog::log_clock::time_point last_time_;
+    std::uint64_t last_tsc_ticks_{1};
+};
+
+TEST_CASE("tsc clock source", "[async]")
+{
+    using std::chrono::milliseconds;
+    auto close_to_now = [](mylog::log_clock::time_point time) {
+        auto diff = mylog::log_clock::now() - time;
+        return diff < milliseconds(500) && diff > -milliseconds(500);
+    };
+
+    // a sync logger would have to convert on the calling thread: it uses the system clock
+    auto sink = std::make_shared<time_sink>();
+    auto logger = std::make_shared<mylog::logger>("sync_logger", sink);
+    logger->set_clock_source(mylog::log_clock_source::tsc);
+    REQUIRE(logger->clock_source() == mylog::log_clock_source::system);
+    logger->info("Hello message");
+    REQUIRE(sink->last_tsc_ticks() == 0);
+    REQUIRE(close_to_now(sink->last_time()));
+
+    // per_thread merges messages by their time, which tsc messages only get on the backend
+    {
+        mylog::details::thread_pool_options options;
+        options.queue_type = mylog::async_queue_type::per_thread;
+        options.clock_source = mylog::log_clock_source::tsc;
+        REQUIRE_THROWS_AS(mylog::details::thread_pool(128, 1, options), mylog::log_ex);
+
+        auto tp = std::make_shared<mylog::details::thread_pool>(128, 1, mylog::async_queue_type::per_thread);
+        REQUIRE_FALSE(tp->converts_tsc());
+        auto per_thread_logger = std::make_shared<mylog::async_logger>("per_thread_logger", sink, tp);
+        per_thread_logger->set_clock_source(mylog::log_clock_source::tsc);
+        REQUIRE(per_thread_logger->clock_source() == mylog::log_clock_source::system);
+        per_thread_logger->info("Hello message");
+        per_thread_logger->flush_async().get();
+        REQUIRE(sink->last_tsc_ticks() == 0);
+        REQUIRE(close_to_now(sink->last_time()));
+    }
+
+    if (!mylog::details::tsc_clock::available())
+    {
+        return;
+    }
+    REQUIRE(close_to_now(mylog::details::tsc_clock::now()));
+
+    // converted by the backend, with the clock source taken from the pool
+    for (auto queue_type : {mylog::async_queue_type::blocking, mylog::async_queue_type::byte_ring})
+    {
+        auto async_sink = std::make_shared<time_sink>();
+        mylog::details::thread_pool_options options;
+        options.queue_type = queue_type;
+        options.clock_source = mylog::log_clock_source::tsc;
+        auto tp = std::make_shared<mylog::details::thread_pool>(4096, 1, options);
+        auto async_logger = std::make_shared<mylog::async_logger>("async_logger", async_sink, tp);
+        REQUIRE(async_logger->clock_source() == mylog::log_clock_source::tsc);
+        async_logger->info("Hello message");
+        async_logger->flush_async().get();
+        REQUIRE(async_sink->last_tsc_ticks() == 0);
+        REQUIRE(close_to_now(async_sink->last_time()));
+    }
+}
+
+TEST_CASE("coarse clock source", "[async]")
+{
+    auto close_to_now = [](mylog::log_clock::time_point time) {
+        auto diff = mylog::log_clock::now() - time;
+        return diff < std::chrono::milliseconds(500) && diff > -std::chrono::milliseconds(500);
+    };
+    REQUIRE(close_to_now(mylog::details::coarse_clock::now()));
+
+    auto sink = std::make_shared<time_sink>();
+    auto logger = std::make_shared<mylog::logger>("sync_logger", sink);
+    logger->set_clock_source(mylog::log_clock_source::coarse);
+    logger->info("Hello message");
+    REQUIRE(close_to_now(sink->last_time()));
+
+    // chosen from the pattern
+    logger->set_pattern("%H:%M:%S %v");
+    logger->set_clock_source(mylog::log_clock_source::automatic);
+    REQUIRE(logger->clock_source() == mylog::log_clock_source::coarse);
+    logger->set_pattern("%H:%M:%S.%F %v");
+    REQUIRE(logger->clock_source() == mylog::log_clock_source::system);
+    logger->set_pattern("%H:%M:%S.%e %v");
+    auto millis_ok = mylog::details::coarse_clock::resolution() <= std::chrono::milliseconds(1);
+    REQUIRE(logger->clock_source() == (millis_ok ? mylog::log_clock_source::coarse : mylog::log_clock_source::system));
+
+    // an explicit source is kept whatever the pattern
+    logger->set_clock_source(mylog::log_clock_source::system);
+    logger->set_pattern("%v");
+    REQUIRE(logger->clock_source() == mylog::log_clock_source::system);
+}
+
+class fields_sink : public mylog::sinks::base_sink<std::mutex>
+{
+public:
+    mylog::details::log_msg_buffer last()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_;
+    }
+
+protected:
+    void sink_it_(const mylog::details::log_msg &msg) override
+    {
+        last_.assign(msg);
+    }
+
+    void flush_() override {}
+
+private:
+    mylog::details::log_msg_buffer last_;
+};
+
+TEST_CASE("captured fields", "[async]")
+{
+    using mylog::msg_field::logger_name;
+    using mylog::msg_field::source;
+    using mylog::msg_field::thread_id;
+    using mylog::msg_field::time;
+    REQUIRE(mylog::pattern_formatter().fields() == mylog::msg_field::all);
+    REQUIRE(mylog::pattern_formatter("%v").fields() == mylog::msg_field::none);
+    REQUIRE(mylog::pattern_formatter("[%n] %H %v").fields() == (logger_name | time));
+    REQUIRE(mylog::pattern_formatter("%t %-8s:%L %v").fields() == (thread_id | source));
+    REQUIRE(mylog::make_static_formatter(MYLOG_PATTERN("%v"))->fields() == mylog::msg_field::none);
+    REQUIRE(mylog::make_static_formatter(MYLOG_PATTERN("[%n] %5L %e %v"))->fields() == (logger_name | source | time));
+    REQUIRE(mylog::make_static_formatter(MYLOG_PATTERN("%+"))->fields() == mylog::msg_field::all);
+
+    auto sink = std::make_shared<fields_sink>();
+    auto logger = std::make_shared<mylog::logger>("fields_logger", sink);
+    mylog::source_loc loc{"file.cc", 42, "func"};
+    logger->log(loc, mylog::level::info, "message");
+    auto msg = sink->last();
+    REQUIRE(msg.logger_name == "fields_logger");
+    REQUIRE(msg.thread_id != 0);
+    REQUIRE(msg.source.line == 42);
+    REQUIRE(msg.time != mylog::log_clock::time_point{});
+
+    // "%v" only: nothing but the level and the payload
+    logger->set_pattern("%v");
+    logger->log(loc, mylog::level::info, "message");
+    msg = sink->last();
+    REQUIRE(msg.logger_name.size() == 0);
+    REQUIRE(msg.thread_id == 0);
+    REQUIRE(msg.source.empty());
+    REQUIRE(msg.time == mylog::log_clock::time_point{});
+    REQUIRE(msg.payload == "message");
+
+    // the formatter of the sink itself changed
+    sink->set_formatter(std::make_unique<mylog::pattern_formatter>("%t %v"));
+    logger->log(loc, mylog::level::info, "message");
+    msg = sink->last();
+    REQUIRE(msg.thread_id != 0);
+    REQUIRE(msg.logger_name.size() == 0);
+
+    // a sink added through sinks()
+    auto full_sink = std::make_shared<fields_sink>();
+    logger->sinks().push_back(full_sink);
+    logger->log(loc, mylog::level::info, "message");
+    msg = sink->last();
+    REQUIRE(msg.logger_name == "fields_logger");
+    REQUIRE(msg.source.line == 42);
+
+    // async loggers order messages by time
+    auto tp = std::make_shared<mylog::details::thread_pool>(16, 1);
+    auto async_sink = std::make_shared<fields_sink>();
+    auto async_logger = std::make_shared<mylog::async_logger>("fields_async", async_sink, tp);
+    async_logger->set_pattern("%v");
+    async_logger->info("message");
+    async_logger->flush_async().get();
+    msg = async_sink->last();
+    REQUIRE(msg.payload == "message");
+    REQUIRE(msg.time != mylog::log_clock::time_point{});
+    REQUIRE(msg.thread_id == 0);
+}
@@ -146,3 +146,52 @@ TEST_CASE("daily_logger rotate", "[daily_file_sink]")
     test_rotate(days_to_run, 11, 10);
     test_rotate(days_to_run, 20, 10);
 }
+
+// sets TZ for libc only: the zone engine read it already
+struct libc_tz_guard
+{
+    explicit libc_tz_guard(const char *zone)
+    {
+        const char *old_tz = std::getenv("TZ");
+        had_tz = old_tz != nullptr;
+        saved = had_tz ? old_tz : "";
+        ::setenv("TZ", zone, 1);
+        ::tzset();
+    }
+
+    ~libc_tz_guard()
+    {
+        if (had_tz)
+        {
+            ::setenv("TZ", saved.c_str(), 1);
+        }
+        else
+        {
+            ::unsetenv("TZ");
+        }
+        ::tzset();
+    }
+
+    bool had_tz;
+    std::string saved;
+};
+
+TEST_CASE("daily_file_sink rotates in the zone of its file names", "[daily_file_sink]")
+{
+    using mylog::log_clock;
+
+    // whatever the zone of the engine, libc is set to one hours away from it
+    auto engine_offset = mylog::details::os::localtime().tm_gmtoff;
+    libc_tz_guard tz(std::abs(engine_offset - 19800) >= 3600 ? "Asia/Kolkata" : "America/New_York");
+
+    prepare_logdir();
+    auto rotation_tm = mylog::details::os::localtime(log_clock::to_time_t(log_clock::now() + std::chrono::minutes(2)));
+    mylog::sinks::daily_file_format_sink_st sink{
+        MYLOG_FILENAME_T("test_logs/daily_tz_%H-%M-%S.txt"), rotation_tm.tm_hour, rotation_tm.tm_min};
+
+    // the rotation is between one and two minutes from now
+    sink.log(create_msg(std::chrono::seconds(55)));
+    REQUIRE(count_files("test_logs") == 1);
+    sink.log(create_msg(std::chrono::seconds(125)));
+    REQUIRE(count_files("test_logs") == 2);
+}
@@ -111,3 +111,46 @@ TEST_CASE("file_helper_open", "[file_helper]")
     target_filename += "/invalid";
     REQUIRE_THROWS_AS(helper.open(target_filename), mylog::log_ex);
 }
+
+TEST_CASE("fd_file_helper_buffering", "[fd_file_helper]")
+{
+    prepare_logdir();
+    mylog::filename_t target_filename = TEST_FILENAME;
+    mylog::details::fd_file_helper helper(64);
+    helper.open(target_filename, true);
+
+    mylog::memory_buf_t line;
+    fmt::format_to(std::back_inserter(line), "{}", std::string(40, '1'));
+    // buffered until flushed, size() counts it
+    helper.write(line);
+    REQUIRE(get_filesize(TEST_FILENAME) == 0);
+    REQUIRE(helper.size() == 40);
+    helper.flush();
+    REQUIRE(get_filesize(TEST_FILENAME) == 40);
+
+    // a line that doesn't fit goes out with the buffered one
+    helper.write(line);
+    helper.write(line);
+    REQUIRE(get_filesize(TEST_FILENAME) == 120);
+
+    // longer than the buffer
+    mylog::memory_buf_t long_line;
+    fmt::format_to(std::back_inserter(long_line), "{}", std::string(100, '2'));
+    helper.write(long_line);
+    REQUIRE(get_filesize(TEST_FILENAME) == 220);
+
+    helper.set_buffer_size(0);
+    helper.write(line);
+    REQUIRE(get_filesize(TEST_FILENAME) == 260);
+    helper.write(mylog::memory_buf_t());
+    REQUIRE(get_filesize(TEST_FILENAME) == 260);
+
+    helper.set_buffer_size(mylog::details::fd_file_helper::default_buffer_size);
+    helper.write(line);
+    helper.close();
+    REQUIRE(file_contents(TEST_FILENAME) ==
+            std::string(120, '1') + std::string(100, '2') + std::string(80, '1'));
+
+    helper.reopen(true);
+    REQUIRE(helper.size() == 0);
+}
@@ -2,6 +2,8 @@
  * This content is released under the MIT License as specified in https://raw.githubusercontent.com/gabime/mylog/master/LICENSE
  */
 #include "includes.h"
+#include "log/async.h"
+#include "test_sink.h"
 
 #define SIMPLE_LOG "test_logs/simple_log"
 #define ROTATING_LOG "test_logs/rotating_log"
@@ -59,6 +61,27 @@ TEST_CASE("rotating_file_logger1", "[rotating_logger]]")
     require_message_count(ROTATING_LOG, 10);
 }
 
+TEST_CASE("rotating_fd_file_logger", "[rotating_logger]]")
+{
+    prepare_logdir();
+    size_t max_size = 1024 * 10;
+    auto sink = std::make_shared<mylog::sinks::rotating_fd_file_sink_mt>(ROTATING_LOG, max_size, 1);
+    sink->set_buffer_size(1024);
+    mylog::logger logger("fd_logger", sink);
+
+    for (int i = 0; i < 500; ++i)
+    {
+        logger.info("Test message {}", i);
+    }
+
+    // rotates by the buffered size too
+    logger.flush();
+    REQUIRE(get_filesize(ROTATING_LOG) <= max_size);
+    REQUIRE(get_filesize(ROTATING_LOG ".1") <= max_size);
+    REQUIRE(count_lines(ROTATING_LOG) + count_lines(ROTATING_LOG ".1") < 500);
+    REQUIRE(ends_with(file_contents(ROTATING_LOG), fmt::format("Test message 499{}", default_eol)));
+}
+
 TEST_CASE("rotating_file_logger2", "[rotating_logger]]")
 {
     prepare_logdir();
@@ -108,6 +131,323 @@ TEST_CASE("rotating_file_logger3", "[rotating_logger]]")
 }
 
 
+TEST_CASE("file_sink_log_batch", "[simple_logger]]")
+{
+    prepare_logdir();
+    mylog::filename_t filename = MYLOG_FILENAME_T(SIMPLE_LOG);
+
+    auto sink = std::make_shared<mylog::sinks::basic_file_sink_st>(filename);
+    sink->set_formatter(std::make_unique<mylog::pattern_formatter>("%v"));
+    sink->set_level(mylog::level::info);
+
+    std::string logger_name = "batch";
+    mylog::details::log_msg msg1(logger_name, mylog::level::info, "Test message 1");
+    mylog::details::log_msg msg2(logger_name, mylog::level::debug, "Filtered by sink level");
+    mylog::details::log_msg msg3(logger_name, mylog::level::error, "Test message 2");
+    const mylog::details::log_msg *msgs[] = {&msg1, &msg2, &msg3};
+    sink->log_batch(mylog::details::log_msg_span(msgs, 3));
+    sink->flush();
+
+    REQUIRE(file_contents(SIMPLE_LOG) == fmt::format("Test message 1{}Test message 2{}", default_eol, default_eol));
+}
+
+TEST_CASE("rotating_file_sink_log_batch", "[rotating_logger]]")
+{
+    prepare_logdir();
+    size_t max_size = 1024;
+    mylog::filename_t basename = MYLOG_FILENAME_T(ROTATING_LOG);
+    auto sink = std::make_shared<mylog::sinks::rotating_file_sink_st>(basename, max_size, 2);
+
+    std::string logger_name = "batch";
+    std::vector<mylog::details::log_msg> msgs;
+    std::vector<const mylog::details::log_msg *> ptrs;
+    for (int i = 0; i < 100; ++i)
+    {
+        msgs.emplace_back(logger_name, mylog::level::info, "Test message in a batch");
+    }
+    for (auto &m : msgs)
+    {
+        ptrs.push_back(&m);
+    }
+    sink->log_batch(mylog::details::log_msg_span(ptrs.data(), ptrs.size()));
+    sink->flush();
+
+    REQUIRE(get_filesize(ROTATING_LOG) <= max_size);
+    REQUIRE(get_filesize(ROTATING_LOG ".1") <= max_size);
+    REQUIRE(get_filesize(ROTATING_LOG ".2") <= max_size);
+}
+
+// pattern_formatter counting the messages formatted by it and its clones
+class counting_formatter : public mylog::pattern_formatter
+{
+public:
+    counting_formatter(std::string pattern, std::shared_ptr<std::atomic<size_t>> count)
+        : mylog::pattern_formatter(pattern)
+        , pattern_(std::move(pattern))
+        , count_(std::move(count))
+    {}
+
+    void format(const mylog::details::log_msg &msg, mylog::memory_buf_t &dest) override
+    {
+        ++*count_;
+        mylog::pattern_formatter::format(msg, dest);
+    }
+
+    std::unique_ptr<mylog::formatter> clone() const override
+    {
+        return std::make_unique<counting_formatter>(pattern_, count_);
+    }
+
+private:
+    std::string pattern_;
+    std::shared_ptr<std::atomic<size_t>> count_;
+};
+
+TEST_CASE("sinks_sharing_a_format", "[simple_logger]]")
+{
+    prepare_logdir();
+    auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG, true);
+    auto rotating_sink = std::make_shared<mylog::sinks::rotating_file_sink_mt>(ROTATING_LOG, 1024 * 1024, 1);
+    auto other_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG ".other", true);
+    mylog::logger logger("shared_format", {file_sink, rotating_sink, other_sink});
+
+    auto count = std::make_shared<std::atomic<size_t>>(0);
+    logger.set_formatter(std::make_unique<counting_formatter>("[%l] %v", count));
+    other_sink->set_formatter(std::make_unique<mylog::pattern_formatter>("%v"));
+    REQUIRE(file_sink->clone_formatter()->equivalent(*rotating_sink->clone_formatter()));
+    REQUIRE_FALSE(other_sink->clone_formatter()->equivalent(*rotating_sink->clone_formatter()));
+    REQUIRE(mylog::pattern_formatter("%v").equivalent(*other_sink->clone_formatter()));
+    REQUIRE_FALSE(mylog::pattern_formatter("%v").equivalent(mylog::pattern_formatter("%v", mylog::pattern_time_type::utc)));
+
+    logger.info("Test message {}", 1);
+    logger.info("Test message {}", 2);
+    // formatted once for the two sinks with equal patterns
+    REQUIRE(*count == 2);
+
+    // the rotating sink no longer takes info messages: the file sink alone
+    rotating_sink->set_level(mylog::level::warning);
+    logger.info("Test message {}", 3);
+    REQUIRE(*count == 3);
+    // and now the rotating sink alone formats
+    file_sink->set_level(mylog::level::fatal);
+    logger.error("Test message {}", 4);
+    REQUIRE(*count == 4);
+
+    logger.flush();
+    REQUIRE(file_contents(SIMPLE_LOG) ==
+            fmt::format("[info] Test message 1{0}[info] Test message 2{0}[info] Test message 3{0}", default_eol));
+    REQUIRE(file_contents(ROTATING_LOG) ==
+            fmt::format("[info] Test message 1{0}[info] Test message 2{0}[error] Test message 4{0}", default_eol));
+    REQUIRE(file_contents(SIMPLE_LOG ".other") ==
+            fmt::format("Test message 1{0}Test message 2{0}Test message 3{0}Test message 4{0}", default_eol));
+
+    // a sink formatting by itself in sink_it_ would format the line it is handed again
+    REQUIRE(std::make_shared<mylog::sinks::test_sink_mt>()->clone_formatter() == nullptr);
+}
+
+// counts its clones
+class clone_counting_formatter : public mylog::pattern_formatter
+{
+public:
+    clone_counting_formatter(std::string pattern, std::shared_ptr<std::atomic<size_t>> clones)
+        : mylog::pattern_formatter(pattern)
+        , pattern_(std::move(pattern))
+        , clones_(std::move(clones))
+    {}
+
+    std::unique_ptr<mylog::formatter> clone() const override
+    {
+        ++*clones_;
+        return std::make_unique<clone_counting_formatter>(pattern_, clones_);
+    }
+
+private:
+    std::string pattern_;
+    std::shared_ptr<std::atomic<size_t>> clones_;
+};
+
+// tells how many format plans are kept
+class plan_logger : public mylog::logger
+{
+public:
+    using mylog::logger::logger;
+
+    size_t kept_plans()
+    {
+        std::lock_guard<std::mutex> lock(format_plans_mutex_);
+        return format_plans_.size();
+    }
+};
+
+TEST_CASE("format_plans", "[simple_logger]]")
+{
+    prepare_logdir();
+    auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG, true);
+    auto other_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG ".other", true);
+    plan_logger logger("plans", {file_sink, other_sink});
+    auto clones = std::make_shared<std::atomic<size_t>>(0);
+    logger.set_formatter(std::make_unique<clone_counting_formatter>("%v", clones));
+    logger.info("Test message {}", 1);
+    auto cloned = clones->load();
+
+    // the formatter of another logger's sink: this one's are not cloned again
+    auto unrelated_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG ".unrelated", true);
+    unrelated_sink->set_pattern("%v");
+    logger.info("Test message {}", 2);
+    REQUIRE(*clones == cloned);
+
+    // the sinks are grouped, then not: every message gets another plan, one
+    // of the two kept
+    for (int i = 0; i < 10; i++)
+    {
+        if (i % 2 == 0)
+        {
+            other_sink->set_pattern("[%l] %v");
+        }
+        else
+        {
+            other_sink->set_formatter(std::make_unique<clone_counting_formatter>("%v", clones));
+        }
+        logger.info("Test message {}", 3 + i);
+    }
+    REQUIRE(logger.kept_plans() == 2);
+    logger.flush();
+    REQUIRE(count_lines(SIMPLE_LOG) == 12);
+
+    // replaced while other threads log with them
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++)
+    {
+        workers.emplace_back([&] {
+            while (!done)
+            {
+                logger.info("Test message");
+            }
+        });
+    }
+    for (int i = 0; i < 200; i++)
+    {
+        other_sink->set_pattern(i % 2 == 0 ? "%v" : "[%l] %v");
+    }
+    done = true;
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    REQUIRE(logger.kept_plans() == 2);
+}
+
+TEST_CASE("async_sinks_sharing_a_format", "[simple_logger]]")
+{
+    prepare_logdir();
+    auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG, true);
+    auto rotating_sink = std::make_shared<mylog::sinks::rotating_file_sink_mt>(ROTATING_LOG, 1024 * 1024, 1);
+    auto count = std::make_shared<std::atomic<size_t>>(0);
+    size_t messages = 100;
+    {
+        auto tp = std::make_shared<mylog::details::thread_pool>(128, 1);
+        auto logger = std::make_shared<mylog::async_logger>("shared_format", mylog::sinks_init_list{file_sink, rotating_sink}, tp);
+        logger->set_formatter(std::make_unique<counting_formatter>("[%l] %v", count));
+        // the rotating sink skips info messages, the batches are formatted for the file sink still
+        rotating_sink->set_level(mylog::level::warning);
+        for (size_t i = 0; i < messages; i++)
+        {
+            logger->log(i % 2 == 0 ? mylog::level::info : mylog::level::warning, "Test message {}", i);
+        }
+        logger->flush_async().get();
+    }
+    // the batches were formatted once for both sinks
+    REQUIRE(*count == messages);
+    REQUIRE(count_lines(SIMPLE_LOG) == messages);
+    REQUIRE(count_lines(ROTATING_LOG) == messages / 2);
+    REQUIRE(file_contents(ROTATING_LOG).substr(0, 24) == "[warning] Test message 1");
+}
+
+TEST_CASE("format_outside_lock", "[simple_logger]]")
+{
+    prepare_logdir();
+    auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(SIMPLE_LOG, true);
+    file_sink->set_format_outside_lock(true);
+    REQUIRE(file_sink->format_outside_lock());
+    auto logger = std::make_shared<mylog::logger>("outside_lock", file_sink);
+
+    auto count = std::make_shared<std::atomic<size_t>>(0);
+    logger->set_formatter(std::make_unique<counting_formatter>("[%l] %v", count));
+
+    size_t threads = 4;
+    size_t messages = 100;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&] {
+            for (size_t i = 0; i < messages; i++)
+            {
+                logger->info("Test message {}", i);
+            }
+        });
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    // every thread formats with a copy of its own
+    REQUIRE(*count == threads * messages);
+
+    // a new formatter is copied again
+    file_sink->set_formatter(std::make_unique<mylog::pattern_formatter>("%v"));
+    logger->info("Last");
+    logger->flush();
+    REQUIRE(*count == threads * messages);
+    REQUIRE(count_lines(SIMPLE_LOG) == threads * messages + 1);
+    auto contents = file_contents(SIMPLE_LOG);
+    REQUIRE(contents.substr(contents.size() - 5) == fmt::format("Last{}", default_eol));
+    REQUIRE(contents.substr(0, 21) == "[info] Test message 0");
+
+    // one copy per thread, and one for the logger's format plan
+    auto clones = std::make_shared<std::atomic<size_t>>(0);
+    file_sink->set_formatter(std::make_unique<clone_counting_formatter>("%v", clones));
+    workers.clear();
+    for (size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&] {
+            for (size_t i = 0; i < messages; i++)
+            {
+                logger->info("Test message {}", i);
+            }
+        });
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+    REQUIRE(*clones == threads + 1);
+}
+
+TEST_CASE("format_outside_lock_many_sinks", "[simple_logger]]")
+{
+    prepare_logdir();
+    auto clones = std::make_shared<std::atomic<size_t>>(0);
+    size_t sink_count = mylog::details::thread_formatters::min_entries + 4;
+    std::vector<mylog::sink_ptr> sinks;
+    for (size_t i = 0; i < sink_count; i++)
+    {
+        auto file_sink = std::make_shared<mylog::sinks::basic_file_sink_mt>(fmt::format("{}.{}", SIMPLE_LOG, i), true);
+        file_sink->set_format_outside_lock(true);
+        // not equivalent: every sink formats by itself
+        file_sink->set_formatter(std::make_unique<clone_counting_formatter>(fmt::format("{} %v", i), clones));
+        sinks.push_back(std::move(file_sink));
+    }
+    mylog::logger logger("many_sinks", sinks.begin(), sinks.end());
+
+    for (size_t i = 0; i < 100; i++)
+    {
+        logger.info("Test message {}", i);
+    }
+    // a copy per sink for this thread, and the format plan's: none cloned again
+    REQUIRE(*clones == 2 * sink_count);
+}
+
 /*
  * File name calculations
  */
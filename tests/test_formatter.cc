@@ -30,4 +30,156 @@ TEST_CASE("clone-default-formatter2", "[pattern_formatter]")
     formatter_2->format(msg, formatted_2);
     
     REQUIRE(fmt::to_string(formatted_1) == fmt::to_string(formatted_2));
-}
\ No newline at end of file
+}
+TEST_CASE("pattern precision", "[pattern_formatter]")
+{
+    using mylog::time_precision;
+    REQUIRE(mylog::pattern_formatter().precision() == time_precision::milliseconds);
+    REQUIRE(mylog::pattern_formatter("%+").precision() == time_precision::milliseconds);
+    REQUIRE(mylog::pattern_formatter("[%n] %v").precision() == time_precision::none);
+    REQUIRE(mylog::pattern_formatter("%Y-%m-%d %H:%M:%S %v").precision() == time_precision::seconds);
+    REQUIRE(mylog::pattern_formatter("%H:%M:%S.%e").precision() == time_precision::milliseconds);
+    REQUIRE(mylog::pattern_formatter("%S.%f %v").precision() == time_precision::microseconds);
+    REQUIRE(mylog::pattern_formatter("%F %H").precision() == time_precision::nanoseconds);
+    REQUIRE(mylog::pattern_formatter("%F").clone()->precision() == time_precision::nanoseconds);
+}
+
+template<typename Formatter>
+static std::string format_with(Formatter &formatter, const mylog::details::log_msg &msg)
+{
+    memory_buf_t formatted;
+    formatter.format(msg, formatted);
+    return fmt::to_string(formatted);
+}
+
+TEST_CASE("static pattern formatter", "[pattern_formatter]")
+{
+    std::string logger_name = "test";
+    mylog::source_loc loc{"/some/dir/file.cc", 42, "func"};
+    mylog::details::log_msg msg(loc, logger_name, mylog::level::warning, "some message");
+
+    mylog::pattern_formatter full("%+");
+    auto static_full = mylog::make_static_formatter(MYLOG_PATTERN("%+"));
+    REQUIRE(format_with(*static_full, msg) == format_with(full, msg));
+    REQUIRE(static_full->precision() == mylog::time_precision::milliseconds);
+
+    const char *custom_pattern = "[%Y-%m-%d %H:%M:%S.%e.%f.%F] [%n] [%^%l%$] [%t] %g %s:%L %@ %% %x %v%";
+    mylog::pattern_formatter custom(custom_pattern);
+    auto static_custom = mylog::make_static_formatter(
+        MYLOG_PATTERN("[%Y-%m-%d %H:%M:%S.%e.%f.%F] [%n] [%^%l%$] [%t] %g %s:%L %@ %% %x %v%"));
+    auto static_formatted = format_with(*static_custom, msg);
+    auto color_start = msg.color_range_start;
+    auto color_end = msg.color_range_end;
+    REQUIRE(static_formatted == format_with(custom, msg));
+    REQUIRE(msg.color_range_start == color_start);
+    REQUIRE(msg.color_range_end == color_end);
+    REQUIRE(static_custom->clone()->precision() == mylog::time_precision::nanoseconds);
+
+    // the cached date and time follow the message time
+    auto static_time = mylog::make_static_formatter(MYLOG_PATTERN("[%Y-%m-%d %H:%M:%S.%e] %v"));
+    mylog::pattern_formatter time_formatter("[%Y-%m-%d %H:%M:%S.%e] %v");
+    for (int i = 0; i < 3; i++)
+    {
+        msg.time += std::chrono::milliseconds(700);
+        REQUIRE(format_with(*static_time, msg) == format_with(time_formatter, msg));
+        REQUIRE(format_with(*static_full, msg) == format_with(full, msg));
+    }
+
+    auto static_message = mylog::make_static_formatter(MYLOG_PATTERN("%v"));
+    REQUIRE(format_with(*static_message, msg) == "some message\n");
+    REQUIRE(static_message->precision() == mylog::time_precision::none);
+}
+
+TEST_CASE("time segments cached per second", "[pattern_formatter]")
+{
+    std::string logger_name = "test";
+    mylog::details::log_msg msg(logger_name, mylog::level::info, "msg");
+    mylog::pattern_formatter formatter("%v %H:%M:%S %% %Y [%l] %e");
+
+    for (int i = 0; i < 4; i++)
+    {
+        msg.time += std::chrono::milliseconds(600);
+        auto tm_time = mylog::details::os::localtime(mylog::log_clock::to_time_t(msg.time));
+        auto millis = mylog::details::time_fraction<std::chrono::milliseconds>(msg.time).count();
+        auto expected = fmt::format("msg {:02}:{:02}:{:02} % {} [info] {:03}\n", tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec,
+            tm_time.tm_year + 1900, millis);
+        REQUIRE(format_with(formatter, msg) == expected);
+    }
+}
+
+TEST_CASE("padding and truncation", "[pattern_formatter]")
+{
+    std::string logger_name = "test";
+    mylog::details::log_msg msg(logger_name, mylog::level::info, "some message");
+
+    auto format_pattern = [&msg](const char *pattern) {
+        mylog::pattern_formatter formatter(pattern);
+        return format_with(formatter, msg);
+    };
+
+    REQUIRE(format_pattern("[%8l]") == "[    info]\n");
+    REQUIRE(format_pattern("[%-8l]") == "[info    ]\n");
+    REQUIRE(format_pattern("[%=8l]") == "[  info  ]\n");
+    REQUIRE(format_pattern("[%=7l]") == "[ info  ]\n");
+    REQUIRE(format_pattern("[%-6n] %v") == "[test  ] some message\n");
+    REQUIRE(format_pattern("[%3l]") == "[info]\n");
+    REQUIRE(format_pattern("[%3!v]") == "[som]\n");
+    REQUIRE(format_pattern("[%!3v]") == "[som]\n");
+    REQUIRE(format_pattern("[%!-20v]") == "[some message        ]\n");
+    REQUIRE(format_pattern("[%100v]") == fmt::format("[{:>64}]\n", "some message"));
+    // no source location: an empty field
+    REQUIRE(format_pattern("[%4L]") == "[    ]\n");
+    // specs without a width are dropped, as are specs of flags that aren't fields
+    REQUIRE(format_pattern("[%-l]") == "[info]\n");
+    REQUIRE(format_pattern("[%5%] [%5^%l%5$]") == "[%] [info]\n");
+    REQUIRE(format_pattern("%v %5") == "some message \n");
+
+    // the static formatter parses the same specs
+    mylog::pattern_formatter custom("[%-8l] [%=10n] [%5t] [%!4v] [%6Y] %5% %-x %8+");
+    auto static_custom = mylog::make_static_formatter(MYLOG_PATTERN("[%-8l] [%=10n] [%5t] [%!4v] [%6Y] %5% %-x %8+"));
+    for (int i = 0; i < 2; i++)
+    {
+        msg.time += std::chrono::milliseconds(700);
+        REQUIRE(format_with(*static_custom, msg) == format_with(custom, msg));
+    }
+}
+
+TEST_CASE("shared time cache", "[pattern_formatter]")
+{
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(mylog::log_clock::now().time_since_epoch());
+    auto check = [](std::chrono::seconds secs, const mylog::details::cached_time &time) {
+        auto tm_time = mylog::details::os::localtime(static_cast<std::time_t>(secs.count()));
+        auto date_time = fmt::format("{}-{:02}-{:02} {:02}-{:02}-{:02}", tm_time.tm_year + 1900, tm_time.tm_mon + 1, tm_time.tm_mday,
+            tm_time.tm_hour, tm_time.tm_min, tm_time.tm_sec);
+        return time.secs == secs && time.tm_time.tm_sec == tm_time.tm_sec && time.tm_time.tm_min == tm_time.tm_min &&
+               time.tm_time.tm_hour == tm_time.tm_hour && fmt::to_string(time.date_time_view()) == date_time;
+    };
+
+    mylog::details::cached_time time;
+    mylog::details::time_cache::get(now, time);
+    REQUIRE(check(now, time));
+    // older seconds are computed, not served from the cache
+    mylog::details::time_cache::get(now - std::chrono::seconds(61), time);
+    REQUIRE(check(now - std::chrono::seconds(61), time));
+
+    // readers never see a torn second while others publish newer ones
+    std::atomic<int> bad{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+    {
+        threads.emplace_back([&, t] {
+            mylog::details::cached_time thread_time;
+            for (int i = 0; i < 2000; i++)
+            {
+                auto secs = now + std::chrono::seconds(i / 100 + t % 2);
+                mylog::details::time_cache::get(secs, thread_time);
+                bad += check(secs, thread_time) ? 0 : 1;
+            }
+        });
+    }
+    for (auto &t : threads)
+    {
+        t.join();
+    }
+    REQUIRE(bad == 0);
+}
@@ -105,3 +105,318 @@ TEST_CASE("full_queue", "[mpmc_blocking_q]")
     q.dequeue_for(item, milliseconds(0));
     REQUIRE(item == 123456);
 }
+
+TEST_CASE("lockfree-dequeue-empty-wait", "[mpmc_lockfree_q]")
+{
+    size_t q_size = 100;
+    milliseconds wait_ms(250);
+    milliseconds tolerance_wait(250);
+
+    mylog::details::mpmc_lockfree_queue<int> q(q_size);
+    int popped_item = 0;
+    auto start = test_clock::now();
+    auto rv = q.dequeue_for(popped_item, wait_ms);
+    auto delta_ms = millis_from(start);
+
+    REQUIRE(rv == false);
+
+    INFO("Delta " << delta_ms.count() << " millis");
+    REQUIRE(delta_ms >= wait_ms - tolerance_wait);
+    REQUIRE(delta_ms <= wait_ms + tolerance_wait);
+}
+
+TEST_CASE("lockfree-bad_queue", "[mpmc_lockfree_q]")
+{
+    // a blocking enqueue would wait forever
+    REQUIRE_THROWS_AS(mylog::details::mpmc_lockfree_queue<int>(0), mylog::log_ex);
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(0, 1, mylog::async_queue_type::lockfree), mylog::log_ex);
+}
+
+TEST_CASE("lockfree-full_queue", "[mpmc_lockfree_q]")
+{
+    size_t q_size = 100;
+    mylog::details::mpmc_lockfree_queue<int> q(q_size);
+    for (int i = 0; i < static_cast<int>(q_size); i++)
+    {
+        q.enqueue(i + 0);
+    }
+    REQUIRE(q.size() == q_size);
+
+    q.enqueue_nowait(123456);
+    REQUIRE(q.overrun_counter() == 1);
+
+    for (int i = 1; i < static_cast<int>(q_size); i++)
+    {
+        int item = -1;
+        q.dequeue_for(item, milliseconds(0));
+        REQUIRE(item == i);
+    }
+
+    // last item pushed has overridden the oldest.
+    int item = -1;
+    q.dequeue_for(item, milliseconds(0));
+    REQUIRE(item == 123456);
+    REQUIRE(q.size() == 0);
+}
+
+TEST_CASE("lockfree-multi_producers", "[mpmc_lockfree_q]")
+{
+    size_t q_size = 64;
+    int n_threads = 4;
+    int per_thread = 10000;
+    mylog::details::mpmc_lockfree_queue<int> q(q_size);
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < n_threads; t++)
+    {
+        producers.emplace_back([&q, per_thread] {
+            for (int i = 1; i <= per_thread; i++)
+            {
+                q.enqueue(i + 0);
+            }
+        });
+    }
+
+    long long sum = 0;
+    for (int i = 0; i < n_threads * per_thread; i++)
+    {
+        int item = 0;
+        REQUIRE(q.dequeue_for(item, milliseconds(1000)));
+        sum += item;
+    }
+
+    for (auto &t : producers)
+    {
+        t.join();
+    }
+
+    REQUIRE(sum == static_cast<long long>(n_threads) * per_thread * (per_thread + 1) / 2);
+    REQUIRE(q.overrun_counter() == 0);
+}
+
+namespace {
+struct timed_item
+{
+    int time{ 0 };
+    int value{ 0 };
+};
+} // namespace
+
+TEST_CASE("spsc_merge-order_by_time", "[spsc_merge_q]")
+{
+    mylog::details::spsc_merge_queue<timed_item> q(16);
+
+    // each thread writes its own ring, with interleaved times
+    std::thread t1([&q] {
+        for (int i = 0; i < 5; i++)
+        {
+            q.enqueue(timed_item{ i * 2, 1 });
+        }
+    });
+    t1.join();
+    std::thread t2([&q] {
+        for (int i = 0; i < 5; i++)
+        {
+            q.enqueue(timed_item{ i * 2 + 1, 2 });
+        }
+    });
+    t2.join();
+
+    for (int i = 0; i < 10; i++)
+    {
+        timed_item item;
+        REQUIRE(q.dequeue_for(item, milliseconds(0)));
+        REQUIRE(item.time == i);
+    }
+    timed_item item;
+    REQUIRE(q.dequeue_for(item, milliseconds(0)) == false);
+}
+
+TEST_CASE("spsc_merge-reclaim_exited_threads", "[spsc_merge_q]")
+{
+    mylog::details::spsc_merge_queue<timed_item> q(16);
+    std::thread t([&q] {
+        q.enqueue(timed_item{ 1, 1 });
+        q.enqueue(timed_item{ 2, 2 });
+    });
+    t.join();
+    REQUIRE(q.rings_count() == 1);
+    REQUIRE(q.size() == 2);
+
+    // the exited thread's items are still delivered
+    timed_item item;
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item.value == 1);
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item.value == 2);
+
+    // and its ring is released once drained
+    REQUIRE(q.dequeue_for(item, milliseconds(0)) == false);
+    REQUIRE(q.rings_count() == 0);
+}
+
+TEST_CASE("spsc_merge-reclaim_while_busy", "[spsc_merge_q]")
+{
+    mylog::details::spsc_merge_queue<timed_item> q(64);
+    int rounds = 20;
+    for (int i = 0; i < rounds; i++)
+    {
+        // this thread keeps its ring from ever running empty
+        q.enqueue(timed_item{ 1000 + 2 * i, 0 });
+        q.enqueue(timed_item{ 1000 + 2 * i + 1, 0 });
+        std::thread t([&q, i] { q.enqueue(timed_item{ i, i }); });
+        t.join();
+
+        // the exited thread's item is the oldest, and its ring goes with it
+        timed_item items[2];
+        REQUIRE(q.dequeue_bulk_for(items, 2, milliseconds(0)) == 2);
+        REQUIRE(items[0].value == i);
+        REQUIRE(q.rings_count() == 1);
+    }
+    REQUIRE(q.size() == static_cast<size_t>(rounds));
+}
+
+TEST_CASE("spsc_merge-full_ring", "[spsc_merge_q]")
+{
+    size_t q_size = 4;
+    mylog::details::spsc_merge_queue<timed_item> q(q_size);
+    for (int i = 0; i < static_cast<int>(q_size); i++)
+    {
+        q.enqueue(timed_item{ i, i });
+    }
+
+    // the new item is dropped, the ring keeps the oldest ones
+    q.enqueue_nowait(timed_item{ 100, 100 });
+    REQUIRE(q.overrun_counter() == 1);
+    REQUIRE(q.size() == q_size);
+
+    timed_item item;
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item.value == 0);
+}
+
+TEST_CASE("spsc_merge-zero_capacity", "[spsc_merge_q]")
+{
+    REQUIRE_THROWS_AS(mylog::details::spsc_merge_queue<timed_item>(0), mylog::log_ex);
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(0, 1, mylog::async_queue_type::per_thread), mylog::log_ex);
+}
+
+static void post_to_byte_ring(mylog::details::byte_ring_queue &q, const std::string &payload,
+    mylog::async_overflow_policy policy = mylog::async_overflow_policy::block)
+{
+    mylog::details::log_msg msg("ring", mylog::level::info, payload);
+    q.enqueue_log(0, msg, nullptr, policy);
+}
+
+TEST_CASE("byte_ring-fifo_and_wrap", "[byte_ring_q]")
+{
+    mylog::details::byte_ring_queue q(512);
+    mylog::details::async_msg item;
+    // records of varying size go around the ring several times
+    for (int i = 0; i < 50; i++)
+    {
+        auto payload = std::string(static_cast<size_t>(i * 7 % 60), 'x') + std::to_string(i);
+        post_to_byte_ring(q, payload);
+        post_to_byte_ring(q, payload + "!");
+        REQUIRE(q.size() == 2);
+
+        REQUIRE(q.dequeue_for(item, milliseconds(0)));
+        REQUIRE(std::string(item.payload.data(), item.payload.size()) == payload);
+        REQUIRE(std::string(item.logger_name.data(), item.logger_name.size()) == "ring");
+        REQUIRE(q.dequeue_for(item, milliseconds(0)));
+        REQUIRE(std::string(item.payload.data(), item.payload.size()) == payload + "!");
+    }
+    REQUIRE(q.size() == 0);
+    REQUIRE(q.bytes_used() == 0);
+    REQUIRE(q.overrun_counter() == 0);
+}
+
+TEST_CASE("byte_ring-long_message", "[byte_ring_q]")
+{
+    mylog::details::byte_ring_queue q(8192);
+    std::string payload(4000, 'a');
+    post_to_byte_ring(q, payload);
+    REQUIRE(q.bytes_used() > payload.size());
+
+    mylog::details::async_msg item;
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item.payload.size() == payload.size());
+
+    // a message larger than the whole ring can never be queued
+    REQUIRE_THROWS_AS(post_to_byte_ring(q, std::string(8192, 'b')), mylog::log_ex);
+}
+
+TEST_CASE("byte_ring-too_small", "[byte_ring_q]")
+{
+    auto min_capacity = mylog::details::byte_ring_queue::min_capacity();
+    REQUIRE_THROWS_AS(mylog::details::byte_ring_queue(0), mylog::log_ex);
+    REQUIRE_THROWS_AS(mylog::details::byte_ring_queue(min_capacity - 1), mylog::log_ex);
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(16, 1, mylog::async_queue_type::byte_ring), mylog::log_ex);
+    REQUIRE_THROWS_AS(mylog::details::thread_pool(64, 1, mylog::async_queue_type::byte_ring), mylog::log_ex);
+
+    // the smallest ring still takes the control messages of a pool shutdown
+    mylog::details::thread_pool tp(min_capacity, 1, mylog::async_queue_type::byte_ring);
+    REQUIRE(tp.queue_capacity_bytes() == min_capacity);
+}
+
+TEST_CASE("byte_ring-overrun_oldest", "[byte_ring_q]")
+{
+    mylog::details::byte_ring_queue q(1024);
+    for (int i = 0; i < 100; i++)
+    {
+        post_to_byte_ring(q, std::to_string(i), mylog::async_overflow_policy::overrun_oldest);
+    }
+    REQUIRE(q.overrun_counter() > 0);
+    REQUIRE(q.size() + q.overrun_counter() == 100);
+    REQUIRE(q.bytes_used() <= q.capacity());
+
+    // the newest messages are kept
+    std::vector<mylog::details::async_msg> items(q.size());
+    auto count = q.dequeue_bulk_for(items.data(), items.size(), milliseconds(0));
+    REQUIRE(count == items.size());
+    REQUIRE(std::string(items.back().payload.data(), items.back().payload.size()) == "99");
+}
+
+TEST_CASE("dequeue-empty-wait-strategies", "[mpmc_blocking_q]")
+{
+    milliseconds wait_ms(50);
+    milliseconds tolerance_wait(250);
+    for (auto strategy : {mylog::async_wait_strategy::busy_spin, mylog::async_wait_strategy::spin_yield, mylog::async_wait_strategy::spin_park})
+    {
+        mylog::details::mpmc_blocking_queue<int> q(10, strategy);
+        int popped_item = 0;
+        auto start = test_clock::now();
+        REQUIRE(q.dequeue_for(popped_item, wait_ms) == false);
+        auto delta_ms = millis_from(start);
+        REQUIRE(delta_ms >= wait_ms);
+        REQUIRE(delta_ms <= wait_ms + tolerance_wait);
+
+        // an item posted while the consumer spins or sleeps is picked up
+        std::thread producer([&q] {
+            std::this_thread::sleep_for(milliseconds(10));
+            q.enqueue(42);
+        });
+        REQUIRE(q.dequeue_for(popped_item, milliseconds(5000)));
+        REQUIRE(popped_item == 42);
+        producer.join();
+    }
+}
+
+TEST_CASE("try_enqueue", "[mpmc_blocking_q]")
+{
+    size_t q_size = 2;
+    mylog::details::mpmc_blocking_queue<int> q(q_size);
+    REQUIRE(q.try_enqueue(1));
+    REQUIRE(q.try_enqueue(2));
+    REQUIRE_FALSE(q.try_enqueue(3));
+    REQUIRE(q.overrun_counter() == 0);
+
+    int item = 0;
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item == 1);
+    REQUIRE(q.try_enqueue(4));
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item == 2);
+    REQUIRE(q.dequeue_for(item, milliseconds(0)));
+    REQUIRE(item == 4);
+}
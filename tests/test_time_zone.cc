@@ -0,0 +1,152 @@
+#include "includes.h"
+
+#include <cstdlib>
+
+using mylog::details::time_zone;
+
+// broken-down time of glibc for the zone, TZ is restored afterwards
+static std::vector<std::tm> libc_times(const char *zone, const std::vector<std::time_t> &times)
+{
+    const char *old_tz = std::getenv("TZ");
+    std::string saved = old_tz != nullptr ? old_tz : "";
+    ::setenv("TZ", zone, 1);
+    ::tzset();
+
+    std::vector<std::tm> result;
+    for (auto t : times)
+    {
+        std::tm tm;
+        ::localtime_r(&t, &tm);
+        result.push_back(tm);
+    }
+
+    if (old_tz != nullptr)
+    {
+        ::setenv("TZ", saved.c_str(), 1);
+    }
+    else
+    {
+        ::unsetenv("TZ");
+    }
+    ::tzset();
+    return result;
+}
+
+static bool same_tm(const std::tm &a, const std::tm &b)
+{
+    return a.tm_year == b.tm_year && a.tm_mon == b.tm_mon && a.tm_mday == b.tm_mday && a.tm_hour == b.tm_hour && a.tm_min == b.tm_min &&
+           a.tm_sec == b.tm_sec && a.tm_wday == b.tm_wday && a.tm_yday == b.tm_yday && a.tm_isdst == b.tm_isdst &&
+           a.tm_gmtoff == b.tm_gmtoff && std::string(a.tm_zone) == b.tm_zone;
+}
+
+// 1901 to 2110, around every transition season
+static std::vector<std::time_t> sample_times()
+{
+    std::vector<std::time_t> times;
+    for (std::int64_t t = -2147483648LL; t < 4450000000LL; t += 86400 * 7 + 3607)
+    {
+        times.push_back(static_cast<std::time_t>(t));
+    }
+    return times;
+}
+
+TEST_CASE("time zone matches libc", "[time_zone]")
+{
+    auto times = sample_times();
+    for (auto name : {"Europe/Berlin", "America/New_York", "Australia/Sydney", "Asia/Kolkata", "America/Sao_Paulo", "Pacific/Chatham",
+             "Africa/Casablanca", "UTC"})
+    {
+        auto zone = time_zone::load(name);
+        if (!zone)
+        {
+            WARN("zone not installed: " << name);
+            continue;
+        }
+        auto expected = libc_times(name, times);
+        std::size_t mismatches = 0;
+        for (std::size_t i = 0; i < times.size(); i++)
+        {
+            mismatches += same_tm(zone->to_tm(times[i]), expected[i]) ? 0 : 1;
+        }
+        INFO("zone " << name);
+        REQUIRE(mismatches == 0);
+    }
+}
+
+TEST_CASE("time zone inverse", "[time_zone]")
+{
+    auto times = sample_times();
+    for (auto name : {"Europe/Berlin", "America/New_York", "Australia/Sydney", "Pacific/Chatham", "UTC"})
+    {
+        auto zone = time_zone::load(name);
+        if (!zone)
+        {
+            WARN("zone not installed: " << name);
+            continue;
+        }
+        std::size_t mismatches = 0;
+        for (auto t : times)
+        {
+            mismatches += zone->to_time_t(zone->to_tm(t)) == t ? 0 : 1;
+        }
+        INFO("zone " << name);
+        REQUIRE(mismatches == 0);
+    }
+
+    auto berlin = time_zone::load("Europe/Berlin");
+    if (berlin)
+    {
+        // 2021-03-28 02:30 was skipped, 2021-10-31 02:30 came twice
+        std::tm tm{};
+        tm.tm_year = 121;
+        tm.tm_mon = 2;
+        tm.tm_mday = 28;
+        tm.tm_hour = 2;
+        tm.tm_min = 30;
+        tm.tm_isdst = -1;
+        REQUIRE(berlin->to_time_t(tm) == 1616895000);
+        tm.tm_mon = 9;
+        tm.tm_mday = 31;
+        tm.tm_isdst = 1;
+        REQUIRE(berlin->to_time_t(tm) == 1635640200);
+        tm.tm_isdst = 0;
+        REQUIRE(berlin->to_time_t(tm) == 1635643800);
+        // normalized like mktime: month 13 is January of the next year
+        tm.tm_mon = 12;
+        tm.tm_mday = 1;
+        tm.tm_hour = 0;
+        tm.tm_min = 0;
+        REQUIRE(berlin->to_time_t(tm) == 1640991600);
+    }
+}
+
+TEST_CASE("time zone load", "[time_zone]")
+{
+    REQUIRE(time_zone::load("No/Such_Zone") == nullptr);
+    REQUIRE(time_zone::load("../../etc/passwd") == nullptr);
+    REQUIRE(time_zone::load("") == nullptr);
+}
+
+TEST_CASE("utc time", "[time_zone]")
+{
+    for (auto t : sample_times())
+    {
+        std::tm expected;
+        ::gmtime_r(&t, &expected);
+        auto tm = time_zone::utc_tm(t);
+        REQUIRE(tm.tm_year == expected.tm_year);
+        REQUIRE(tm.tm_yday == expected.tm_yday);
+        REQUIRE(tm.tm_wday == expected.tm_wday);
+        REQUIRE(tm.tm_mday == expected.tm_mday);
+        REQUIRE(tm.tm_hour == expected.tm_hour);
+        REQUIRE(tm.tm_sec == expected.tm_sec);
+    }
+
+    std::string logger_name = "test";
+    mylog::details::log_msg msg(logger_name, mylog::level::info, "msg");
+    msg.time = mylog::log_clock::from_time_t(1700000000);
+    mylog::pattern_formatter formatter("%Y-%m-%d %H:%M:%S %v", mylog::pattern_time_type::utc);
+    mylog::memory_buf_t formatted;
+    formatter.format(msg, formatted);
+    REQUIRE(fmt::to_string(formatted) == "2023-11-14 22:13:20 msg\n");
+}